@@ -0,0 +1,38 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <iostream>
+#include "GL/glew.h"
+
+//Copies GPU buffers into a persistently mapped staging buffer without stalling the render loop.
+//begin() only queues the copies and a fence, ready() polls the fence without waiting. Once ready, data() points to the
+//copied bytes (all ranges back to back) and stays valid until the next begin(), so a worker thread can read it directly.
+class AsyncReadback
+{
+public:
+    struct Range {
+        unsigned int buffer;
+        size_t size;
+    };
+private:
+    unsigned int stagingBuffer = 0;
+    size_t capacity = 0;
+    size_t byteCount = 0;
+    void* mapped = nullptr;
+    GLsync fence = nullptr;
+    bool complete = false;
+
+    void reserve(size_t bytes);
+public:
+    AsyncReadback() = default;
+    AsyncReadback(const AsyncReadback&) = delete;
+    AsyncReadback& operator=(const AsyncReadback&) = delete;
+
+    void begin(const std::vector<Range>& ranges);
+    bool ready();
+    //Blocks until the copies are done, only for shutting down
+    bool wait();
+    const void* data() const;
+    size_t size() const;
+    ~AsyncReadback();
+};
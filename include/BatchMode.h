@@ -0,0 +1,7 @@
+#pragma once
+#include "CommandLine.h"
+
+//Runs the simulation described by the command line without a window: creates a headless OpenGL context, simulates
+//options.steps fixed steps, optionally renders every frame into an offscreen framebuffer that gets captured,
+//records the trajectory and saves the final state. Returns the exit code of the program
+int runBatchMode(const CommandLineOptions& options);
@@ -0,0 +1,196 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <cstdio>
+#include <vector>
+#include "Helpers.h"
+
+//Options that can be passed on the command line. Without any options the interactive simulation starts as usual
+struct CommandLineOptions {
+    std::string goldenRecordPath; //run the seeded scenario and store the resulting particle state as golden file
+    std::string goldenCheckPath;  //run the scenario stored in the golden file and compare against its particle state
+    std::string snapshotPath;     //snapshot to restore at startup
+    int steps = 300;              //fixed physics steps of the seeded run
+    int leafCount = 1024;
+    unsigned int seed = 1;
+    bool tumbling = false;
+    bool spiralingMotion = false;
+    bool sceneColliders = false;
+    std::vector<std::string> colliderPaths; //OBJ meshes that are added to the scene colliders, in world units
+    std::string shaderCachePath = "shader_cache"; //linked shader programs are cached here between runs
+    bool shaderCache = true;
+    bool simulationThread = true; //interactive runs step the physics on their own thread and GL context
+    float governorFps = 0.0f;     //frame rate the governor holds from the start, 0 leaves it off
+
+    //batch mode: no window and no UI, runs the simulation for --steps fixed steps in a headless context and exits
+    bool batch = false;
+    std::string outputPath;       //rendered frames, a .y4m file or a directory for a PNG sequence
+    std::string saveSnapshotPath; //snapshot of the final state
+    std::string recordPath;       //trajectory recording of the whole run
+    int width = 1280, height = 720;
+    float fps = 60.0f;
+    //emitter parameters of the batch run, the defaults match the interactive simulation
+    glm::vec3 windForce = glm::vec3(0.0f);
+    float gravity = 9.81f;
+    float size = 1.0f;
+    float emitRadius = 10.0f, emitHeight = 15.0f;
+    float blackHoleMass = 10.0f, blackHoleSpeed = 1.0f, blackHoleRadius = 6.0f;
+    EmitterShape emitterShape = EmitterShape::circleShape;
+    float spawnRate = 0.0f, lifetime = 0.0f;
+    std::vector<glm::vec2> rateCurve;
+    int burstCount = 0;
+    float burstInterval = 0.0f;
+    ParticleShape particleShape = ParticleShape::sphereShape;
+    bool valid = true;
+};
+
+inline void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --golden-record <file>  run a seeded simulation and write the particle state to <file>\n"
+              << "  --golden-check <file>   rerun the simulation stored in <file> and compare, exit code 1 on mismatch\n"
+              << "  --load-snapshot <file>  resume the simulation from a snapshot saved in the UI\n"
+              << "  --steps <n>             fixed physics steps of the seeded run (default 300)\n"
+              << "  --leaves <n>            particle count of the seeded run (default 1024)\n"
+              << "  --seed <n>              random seed of the seeded run (default 1)\n"
+              << "  --tumbling              enable the tumbling motion model\n"
+              << "  --spiraling             enable the spiraling motion model (needs --tumbling)\n"
+              << "  --colliders             collide with the static scene geometry\n"
+              << "  --collider <file.obj>   add a closed OBJ mesh to the scene colliders, can be given more than once\n"
+              << "  --shader-cache <dir>    directory for compiled shader programs (default shader_cache)\n"
+              << "  --no-shader-cache       always compile the shaders from source\n"
+              << "  --no-sim-thread         step the physics on the render thread\n"
+              << "  --governor <fps>        lower the physics rate and particle count automatically to hold <fps>\n"
+              << "\nBatch mode (no window, needs a build with EGL):\n"
+              << "  --batch                 run --steps fixed steps headless and exit, with --golden-* the golden run is headless\n"
+              << "  --output <path>         render every frame, to a .y4m video or a directory of PNGs\n"
+              << "  --width <n>, --height <n>, --fps <n>  size and frame rate of the rendered frames (default 1280x720 at 60)\n"
+              << "  --save-snapshot <file>  save the final state as snapshot\n"
+              << "  --record <file>         record the trajectory of the whole run\n"
+              << "  --wind <x,y,z>          wind force (default 0,0,0)\n"
+              << "  --gravity <g>           gravity (default 9.81)\n"
+              << "  --size <s>              leaf size (default 1)\n"
+              << "  --emit-radius <r>       emitter radius (default 10)\n"
+              << "  --emit-height <h>       emitter height (default 15)\n"
+              << "  --emitter circle|box|disc|sphere|mesh  emitter shape (default circle), mesh spawns on the tree crown\n"
+              << "  --spawn-rate <n>        new particles per second, --leaves is the most alive at once (default 0 = all in the air)\n"
+              << "  --lifetime <s>          seconds until a particle fades out and dies (default 0 = until it lands)\n"
+              << "  --rate-curve <t:f,...>  factor on the spawn rate over time, e.g. 0:0,5:1 ramps up over 5 seconds\n"
+              << "  --burst <n>             spawn n particles at once at the start, with a spawn rate or without\n"
+              << "  --burst-interval <s>    repeat the burst every s seconds (default 0 = once)\n"
+              << "  --particle leaf|sphere|point  particle shape (default sphere)\n"
+              << "  --black-hole-mass <m>, --black-hole-speed <s>, --black-hole-radius <r>  (default 10, 1, 6)\n"
+              << "  --help                  show this message" << std::endl;
+}
+
+inline CommandLineOptions parseCommandLine(int argc, char* argv[]) {
+    CommandLineOptions options;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        //all options with a value expect it as the next argument
+        bool hasValue = i + 1 < argc;
+        if(arg == "--golden-record" && hasValue) options.goldenRecordPath = argv[++i];
+        else if(arg == "--golden-check" && hasValue) options.goldenCheckPath = argv[++i];
+        else if(arg == "--load-snapshot" && hasValue) options.snapshotPath = argv[++i];
+        else if(arg == "--steps" && hasValue) options.steps = std::atoi(argv[++i]);
+        else if(arg == "--leaves" && hasValue) options.leafCount = std::atoi(argv[++i]);
+        else if(arg == "--seed" && hasValue) options.seed = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+        else if(arg == "--tumbling") options.tumbling = true;
+        else if(arg == "--spiraling") options.spiralingMotion = true;
+        else if(arg == "--colliders") options.sceneColliders = true;
+        else if(arg == "--collider" && hasValue) options.colliderPaths.push_back(argv[++i]);
+        else if(arg == "--shader-cache" && hasValue) options.shaderCachePath = argv[++i];
+        else if(arg == "--no-shader-cache") options.shaderCache = false;
+        else if(arg == "--no-sim-thread") options.simulationThread = false;
+        else if(arg == "--governor" && hasValue) options.governorFps = std::strtof(argv[++i], nullptr);
+        else if(arg == "--batch") options.batch = true;
+        else if(arg == "--output" && hasValue) options.outputPath = argv[++i];
+        else if(arg == "--save-snapshot" && hasValue) options.saveSnapshotPath = argv[++i];
+        else if(arg == "--record" && hasValue) options.recordPath = argv[++i];
+        else if(arg == "--width" && hasValue) options.width = std::atoi(argv[++i]);
+        else if(arg == "--height" && hasValue) options.height = std::atoi(argv[++i]);
+        else if(arg == "--fps" && hasValue) options.fps = std::strtof(argv[++i], nullptr);
+        else if(arg == "--wind" && hasValue) {
+            glm::vec3& wind = options.windForce;
+            if(std::sscanf(argv[++i], "%f,%f,%f", &wind.x, &wind.y, &wind.z) != 3) {
+                std::cerr << "--wind expects three comma separated values, e.g. 1,0,0.5" << std::endl;
+                options.valid = false;
+            }
+        }
+        else if(arg == "--gravity" && hasValue) options.gravity = std::strtof(argv[++i], nullptr);
+        else if(arg == "--size" && hasValue) options.size = std::strtof(argv[++i], nullptr);
+        else if(arg == "--emit-radius" && hasValue) options.emitRadius = std::strtof(argv[++i], nullptr);
+        else if(arg == "--emit-height" && hasValue) options.emitHeight = std::strtof(argv[++i], nullptr);
+        else if(arg == "--spawn-rate" && hasValue) options.spawnRate = std::strtof(argv[++i], nullptr);
+        else if(arg == "--lifetime" && hasValue) options.lifetime = std::strtof(argv[++i], nullptr);
+        else if(arg == "--rate-curve" && hasValue) {
+            //time:factor pairs separated by commas, the times have to increase
+            std::string keys = argv[++i];
+            options.rateCurve.clear();
+            size_t start = 0;
+            while (start <= keys.size()) {
+                size_t end = keys.find(',', start);
+                std::string key = keys.substr(start, end == std::string::npos ? std::string::npos : end - start);
+                glm::vec2 point;
+                if(std::sscanf(key.c_str(), "%f:%f", &point.x, &point.y) != 2
+                   || (!options.rateCurve.empty() && point.x <= options.rateCurve.back().x)) {
+                    std::cerr << "--rate-curve expects time:factor pairs with increasing times, e.g. 0:0,5:1" << std::endl;
+                    options.valid = false;
+                    break;
+                }
+                options.rateCurve.push_back(point);
+                if(end == std::string::npos) break;
+                start = end + 1;
+            }
+        }
+        else if(arg == "--burst" && hasValue) options.burstCount = std::atoi(argv[++i]);
+        else if(arg == "--burst-interval" && hasValue) options.burstInterval = std::strtof(argv[++i], nullptr);
+        else if(arg == "--black-hole-mass" && hasValue) options.blackHoleMass = std::strtof(argv[++i], nullptr);
+        else if(arg == "--black-hole-speed" && hasValue) options.blackHoleSpeed = std::strtof(argv[++i], nullptr);
+        else if(arg == "--black-hole-radius" && hasValue) options.blackHoleRadius = std::strtof(argv[++i], nullptr);
+        else if(arg == "--emitter" && hasValue) {
+            std::string shape = argv[++i];
+            if(shape == "circle") options.emitterShape = EmitterShape::circleShape;
+            else if(shape == "box") options.emitterShape = EmitterShape::boxShape;
+            else if(shape == "disc") options.emitterShape = EmitterShape::discShape;
+            else if(shape == "sphere") options.emitterShape = EmitterShape::sphereShape;
+            else if(shape == "mesh") options.emitterShape = EmitterShape::meshShape;
+            else {
+                std::cerr << "Unknown emitter shape: " << shape << std::endl;
+                options.valid = false;
+            }
+        }
+        else if(arg == "--particle" && hasValue) {
+            std::string shape = argv[++i];
+            if(shape == "leaf") options.particleShape = ParticleShape::leafShape;
+            else if(shape == "sphere") options.particleShape = ParticleShape::sphereShape;
+            else if(shape == "point") options.particleShape = ParticleShape::pointShape;
+            else {
+                std::cerr << "Unknown particle shape: " << shape << std::endl;
+                options.valid = false;
+            }
+        }
+        else {
+            if(arg != "--help") std::cerr << "Unknown or incomplete option: " << arg << std::endl;
+            options.valid = false;
+        }
+    }
+    if(options.steps <= 0 || options.leafCount <= 0) {
+        std::cerr << "--steps and --leaves have to be positive" << std::endl;
+        options.valid = false;
+    }
+    if(options.width <= 0 || options.height <= 0 || options.fps <= 0.0f) {
+        std::cerr << "--width, --height and --fps have to be positive" << std::endl;
+        options.valid = false;
+    }
+    if(options.spawnRate < 0.0f || options.lifetime < 0.0f || options.burstCount < 0 || options.burstInterval < 0.0f) {
+        std::cerr << "--spawn-rate, --lifetime, --burst and --burst-interval can't be negative" << std::endl;
+        options.valid = false;
+    }
+    if(options.governorFps < 0.0f) {
+        std::cerr << "--governor has to be positive" << std::endl;
+        options.valid = false;
+    }
+    return options;
+}
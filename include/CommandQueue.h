@@ -0,0 +1,87 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+
+//Requests from the UI (or any other single source) to the main loop, the parameters themselves travel in EmitterParams
+enum class CommandType {
+    startSimulation,
+    stopSimulation,
+    resizeParticles,   //leafCount changed
+    changeEmitArea,    //respawns all particles with the current emitter parameters
+    benchmarkPhysics,
+    benchmarkSpawn,
+    saveSnapshot,
+    loadSnapshot,
+    toggleRecording,
+    togglePlayback,
+    pausePlayback,
+    seekPlayback,      //value is the frame to jump to
+    toggleCapture
+};
+
+struct Command {
+    CommandType type;
+    int value = 0;
+};
+
+//Fixed size ring buffer for exactly one producer and one consumer thread, neither side ever takes a lock.
+//Each side only writes its own index, the release store publishes the slot it just filled or emptied
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "the capacity has to be a power of two");
+private:
+    T items[Capacity];
+    //on separate cache lines, otherwise both threads keep stealing the line from each other
+    alignas(64) std::atomic<size_t> head = 0; //next slot to read, only the consumer writes it
+    alignas(64) std::atomic<size_t> tail = 0; //next slot to write, only the producer writes it
+public:
+    //Returns false if the queue is full, the item is dropped then
+    bool push(const T& item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if(t - head.load(std::memory_order_acquire) == Capacity) return false;
+        items[t & (Capacity - 1)] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if(h == tail.load(std::memory_order_acquire)) return false;
+        item = items[h & (Capacity - 1)];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+//Commands for the main loop. drain() hands out everything queued since the last call, a burst of the same rebuild
+//(e.g. dragging the particle count) collapses into one command at the position of the last one
+class CommandQueue
+{
+private:
+    SpscQueue<Command, 256> queue;
+
+    static bool coalesces(CommandType type) {
+        //toggles can't be merged, two of them cancel out. Start and stop depend on their order
+        return type == CommandType::resizeParticles || type == CommandType::changeEmitArea || type == CommandType::seekPlayback;
+    }
+public:
+    bool push(CommandType type, int value = 0) {
+        return queue.push(Command{type, value});
+    }
+
+    void drain(std::vector<Command>& commands) {
+        commands.clear();
+        Command command;
+        while (queue.pop(command)) {
+            if(coalesces(command.type)) {
+                commands.erase(std::remove_if(commands.begin(), commands.end(),
+                                              [&command](const Command& queued) { return queued.type == command.type; }),
+                               commands.end());
+            }
+            commands.push_back(command);
+        }
+    }
+};
@@ -2,9 +2,13 @@
 #include <vector>
 #include "Leaf.h"
 #include "glm/glm.hpp"
-#include <random>
+#include "glm/gtc/packing.hpp"
+#include "Random.h"
 #include "Helpers.h"
 #include "Profiler.h"
+#include "SdfCollider.h"
+#include "AsyncReadback.h"
+#include "Spawn.h"
 #include <iostream>
 #include <utility>
 
@@ -25,9 +29,26 @@ static float pointVertices[] = {
     0.0f, 0.0f, 0.0f
 };
 
+class TrajectoryRecorder;
+
+//A contiguous part of the particle buffers, e.g. the particles of one emitter
+struct ParticleRange {
+    int first;
+    int count;
+};
+
+//The buffers a draw reads, the emitter's own ones or a copy made by the simulation thread
+struct ParticleBuffers {
+    unsigned int positions, previousPositions, orientations;
+    unsigned int drawList;    //indices of the alive particles, every emitter's part starts at its first particle
+    unsigned int aliveCounts; //one uint per emitter, the length of its part of drawList
+};
+
 class Emitter
 {
 private:
+    //CPU side of the first particles, built with initialSeed. Only the initial orientations need them, so they are
+    //created when those are uploaded and never for particles that come from a snapshot
     std::vector<Leaf> leaves;
     unsigned int leafVAO, leafVBO, leafEBO;
     std::vector<glm::vec3>* sphereCoordinates, *sphereNormals;
@@ -35,25 +56,131 @@ private:
     unsigned int sphereVAO, sphereVBO, sphereEBO, sphereNormalsVBO;
     unsigned int pointVAO, pointVBO;
 
-    //store the rotation matrices, positions, rotations and current velocity for each leaf.
-    unsigned int transformationsSSBO, rotationsSSBO, velocitySSBO; 
+    //All emitters of the scene share the particle buffers, programs and textures of one Emitter: every emitter owns a range of
+    //the particles and a parameter block, one compute dispatch steps all of them and one indirect draw call draws them.
+    //store the positions, packed orientations (snorm16 quaternion + half float angular velocity) and current velocity for each leaf.
+    //The model matrices are only built in the vertex shaders
+    unsigned int positionsSSBO, orientationsSSBO, velocitySSBO;
+    //positions before the last fixed step, drawing blends them with the current ones by the time left in the accumulator
+    unsigned int previousPositionsSSBO;
+    //packed orientations every restart begins with, they only depend on the seed and the leaf index
+    unsigned int initialOrientationsSSBO;
+    int initialCount = -1; //particles in initialOrientationsSSBO, -1 until it is built
+    unsigned int initialSeed = 0;
+    //EmitterShape::meshShape spawns on these triangles, laid out by Spawn::MeshTable
+    unsigned int spawnTrianglesSSBO = 0;
+    unsigned int spawnTriangleCount = 0;
+    std::vector<glm::vec4> spawnTriangles;
+    Shader spawnBenchmarkShader;
+    //same layout as EmitterBlock in compute.glsl
+    struct EmitterBlock {
+        glm::vec4 area;   //origin, emit radius
+        glm::vec4 spawn;  //emit height
+        glm::uvec4 range; //first particle, particle count, active particles, shape
+        glm::vec4 life;   //lifetime, fade out duration
+        glm::uvec4 spawning; //new particles this step, first spawn invocation, 1 with a spawn rate
+    };
+    std::vector<ParticleRange> emitterRanges; //the particles of every emitter, in the order of allEmitters()
+    std::vector<EmitterBlock> emitterBlocks;  //as uploaded to emitterBlocksSSBO
+    std::vector<EmitterSource> spawnSources;  //rate, curve and bursts of every emitter
+    std::vector<float> spawnCarry;            //spawns that didn't make a whole particle yet
+    float spawnClock = 0.0f;                  //seconds since the particles were reset, the time of the rate curves and bursts
+    unsigned int emitterBlocksSSBO;
+    unsigned int drawCommandsBuffer; //indirect draw commands, one per emitter
+    //written by every step: the alive particles of every emitter and their count. The draw list is the instanced particle
+    //index of the draw calls, the alive counts are copied into their instance counts
+    unsigned int drawListSSBO, aliveCountsSSBO;
+    //dead particles of the spawn rate emitters per work group and per emitter, the spawn pass ranks them with these
+    unsigned int deadBlocksSSBO, deadCountsSSBO;
+    int particleCapacity = 0; //particles the per particle buffers have room for, at least numInstances
     Shader computeShader;
     int numInstances;
     Shader leafShader, sphereShader, pointShader;
     Texture leafTexture;
+    const SdfCollider* colliders = nullptr;
+    TrajectoryRecorder* recorder = nullptr;
+    const unsigned int sdfTextureUnit = 5;
 
     float rotationSpeed = 0.3f;
     float physicsAccumulator = 0.0f; // for fixed timestep
-    const float fixedDT = 0.016f; // for fixed timestep
-     Leaf createLeaf(const EmitterParams &params, std::mt19937 &gen, std::uniform_real_distribution<float> &rotDist);
+    float fixedDT = 0.016f; // for fixed timestep, 1 / params.physicsRate
+    float activeFraction = 1.0f; // params.activeFraction of the last update, playback always shows everything
+    unsigned int stepIndex = 0; // fixed steps since the particles were initialized, part of the random number key
+    Leaf createLeaf(const EmitterParams &params, int leafIndex);
+    void buildLeaves(int count);
+    static std::vector<ParticleRange> layoutOf(const EmitterParams& params);
+    int getActiveCount(size_t emitter) const;
+    void bindParticleIndices();
+    //One block per emitter of the current ranges, returns true if the draw list doesn't match them anymore
+    bool uploadEmitterBlocks(const std::vector<EmitterSource>& sources);
+    //number of new particles of every spawn rate emitter in the next step, returns the total
+    unsigned int scheduleSpawns(float dT);
+    void bindComputeBuffers();
+    //Refills the draw list from the particle state, after it was replaced instead of stepped
+    void rebuildParticleLists();
 
     void uploadInitialTransforms();
+    void uploadInitialOrientations(int first, int count);
+    void resetParticles();
+    //Initial state for the particles [first, first + count), the others are left alone
+    void initializeParticles(int first, int count);
+    //Makes room for count particles and keeps the ones that fit
+    void reserveParticles(int count);
+    static void reallocateBuffer(unsigned int& buffer, size_t size, size_t keptBytes);
+    static void uploadBuffer(unsigned int buffer, const void* data, size_t size);
+    void setComputeUniforms(const EmitterParams& params, float dT);
 public:
     void fixedUpdatePhysics(float fixedDT);
     void update(float dT, const EmitterParams& params);
     void draw(const glm::mat4& view, const glm::mat4& projection, const EmitterParams& params);
+    //Draws the alive particles of the given emitter ranges from other buffers in the same layout, e.g. a copy made by the
+    //simulation thread. interpolation goes from 0 (previous positions) to 1 (positions of the last step), fixedDT is the
+    //step the buffers were simulated with, the member may be changed by another thread meanwhile
+    void draw(const glm::mat4& view, const glm::mat4& projection, const EmitterParams& params, const ParticleBuffers& buffers,
+              const std::vector<ParticleRange>& ranges, float interpolation, float fixedDT);
+    //Applies the particle counts of all emitters. The particles that stay keep flying, the ones in another emitter now land
+    //in their new one. The buffers grow and shrink in big steps, most resizes don't reallocate anything
     void resizeParticleCount(const EmitterParams& params);
+    //Restarts all particles. Only needed for a fresh, reproducible run: every step already spawns into the current emit
+    //area, so particles that are in flight keep going and only new spawns use a new area
     void changeEmitArea(const EmitterParams& params);
+    void benchmarkPhysics(const EmitterParams& params, int steps);
+    //Spawns count particles per shape with the GPU and the CPU kernels and prints the throughput, the particles are untouched
+    void benchmarkSpawn(const EmitterParams& params, int count);
+    //Respawns all particles and advances the simulation by exactly the given number of fixed steps, independent of the frame time.
+    //Together with the seed this gives reproducible runs
+    void runFixedSteps(const EmitterParams& params, int steps);
+    //Copies the particle buffers back to the CPU, in the same layout as the SSBOs
+    void readParticleState(std::vector<glm::vec4>& positions, std::vector<glm::uvec4>& orientations, std::vector<glm::vec4>& velocities) const;
+    //Same as readParticleState, but only queues the copies, the results show up in the readback a few frames later
+    void readParticleStateAsync(AsyncReadback& readback, bool includeVelocities = true) const;
+    //Replaces all particles with the given buffer contents (SSBO layout, one range per emitter of params) and continues at stepIndex,
+    //with accumulatedTime seconds not stepped yet. The rate curves go on at spawnClock, spawnCarry has one value per emitter
+    void restoreParticleState(const EmitterParams& params, const void* positions, const void* orientations, const void* velocities,
+                              unsigned int stepIndex, float accumulatedTime, float spawnClock, const std::vector<float>& spawnCarry);
+    //Shows a recorded frame instead of the simulated particles (trajectory playback), resizes the buffers if needed
+    void uploadParticleFrame(int count, const glm::vec4* positions, const glm::uvec4* orientations);
+    int getParticleCount() const;
+    //the particles that are simulated, the first ones of every emitter. The others keep their state until they are active again.
+    //Spawn rate emitters are always simulated completely, the frame governor thins out their spawns instead
+    int getActiveParticleCount() const;
+    std::vector<ParticleRange> getActiveRanges() const;
+    //the whole range of every emitter, the main one first
+    const std::vector<ParticleRange>& getEmitterRanges() const;
+    ParticleBuffers getParticleBuffers() const;
+    unsigned int getStepIndex() const;
+    float getFixedDT() const;
+    //simulated time that is not a whole fixed step yet
+    float getAccumulatedTime() const;
+    //seconds the rate curves and bursts are at
+    float getSpawnClock() const;
+    //spawns of every emitter that didn't make a whole particle yet
+    const std::vector<float>& getSpawnCarry() const;
+    void setColliders(const SdfCollider* colliders);
+    //Triangles (3 consecutive points each) for EmitterShape::meshShape
+    void setSpawnMesh(const std::vector<glm::vec3>& triangles);
+    //the recorder gets notified after every fixed physics step
+    void setRecorder(TrajectoryRecorder* recorder);
     Emitter(const EmitterParams& params);
     ~Emitter();
 };
@@ -0,0 +1,79 @@
+#pragma once
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "GL/glew.h"
+#include "ThreadPool.h"
+
+enum class CaptureFormat {
+    pngSequence, //<directory>/frame_000000.png, ...
+    y4mVideo     //one raw YUV 4:2:0 stream with a small header, ffmpeg and most players read it directly
+};
+
+//Renders the scene into an offscreen framebuffer and exports every frame without stalling the render loop.
+//endFrame() only queues a glReadPixels into one buffer of a ring of pixel pack buffers, the pixels are picked up a few
+//frames later once their fence is signaled and then encoded by worker threads straight from the mapped buffer.
+//No frame is ever dropped: if the ring is full the oldest frame is waited for, so the output only depends on what was rendered.
+//Nothing here needs a window, presenting the frame is optional.
+class FrameCapture
+{
+private:
+    static constexpr int slotCount = 4;
+    struct Slot {
+        unsigned int buffer = 0;
+        uint8_t* mapped = nullptr;
+        GLsync fence = nullptr;
+        int frameIndex = -1;
+        std::atomic<bool> encoding = false;
+    };
+    Slot slots[slotCount];
+    unsigned int framebuffer = 0, colorTexture = 0, depthBuffer = 0;
+    int width = 0, height = 0;
+    int savedViewport[4] = {0, 0, 0, 0};
+
+    bool capturing = false;
+    //between beginFrame() and endFrame(), the capture framebuffer is bound
+    bool frameOpen = false;
+    CaptureFormat format = CaptureFormat::pngSequence;
+    std::filesystem::path outputPath;
+    float fps = 60.0f;
+    int nextFrame = 0, nextFrameToEncode = 0;
+    double stallSeconds = 0.0;
+    std::unique_ptr<ThreadPool> encoders;
+
+    //frames have to be appended to the video in order even though they are converted in parallel
+    std::ofstream video;
+    std::mutex writeMutex;
+    std::condition_variable frameWritten, slotReleased;
+    int nextFrameToWrite = 0;
+    bool writeFailed = false;
+
+    void createTargets(int width, int height);
+    void destroyTargets();
+    void encodeSlot(Slot& slot);
+    void waitForSlot(Slot& slot);
+    void encodeFrame(Slot& slot);
+public:
+    FrameCapture() = default;
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    //width and height are rounded down to even numbers, 4:2:0 chroma needs them
+    bool start(const std::filesystem::path& path, CaptureFormat format, int width, int height, float fps = 60.0f);
+    //Redirects all drawing into the capture framebuffer until endFrame()
+    void beginFrame();
+    //Queues the readback of the frame. With a window size the frame is also blitted to the default framebuffer
+    void endFrame(int windowWidth = 0, int windowHeight = 0);
+    //Hands finished readbacks to the encoders, call once per frame
+    void poll();
+    //Waits for all frames to be read back and written. An open frame is dropped and the window framebuffer bound again
+    void stop();
+    bool isCapturing() const;
+    //Fixed time step while capturing, so the simulation advances the same way no matter how long a frame takes
+    float getFrameTime() const;
+    int getCapturedFrames() const;
+    ~FrameCapture();
+};
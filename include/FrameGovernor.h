@@ -0,0 +1,67 @@
+#pragma once
+#include "GL/glew.h"
+#include "Helpers.h"
+
+//Holds a target frame time by lowering the physics rate and then the share of simulated particles when frames get
+//too slow, and by raising them again once there is room. The load of a frame is the larger one of the CPU time the
+//render loop spent on it (without waiting for the swap) and the GPU time measured with timer queries, which arrive a
+//few frames late. The GPU time adds the physics of a simulation thread, its context is timed on its own since the
+//queries here only see the render context. Going down reacts within a fraction of a second, going back up needs a few seconds of clear headroom
+//and each change is measured on its own before the next one, so the quality doesn't oscillate around the target.
+class FrameGovernor
+{
+public:
+    struct Level {
+        float maxPhysicsRate; //caps params.physicsRate, the interpolation keeps low rates smooth
+        float particleShare;
+    };
+private:
+    static constexpr int queryCount = 4;
+    unsigned int queries[queryCount] = {};
+    unsigned int queryGeneration[queryCount] = {};
+    int nextQuery = 0, pendingQueries = 0;
+    bool queryRunning = false;
+
+    bool enabled = false;
+    float targetFrameTime = 1.0f / 60.0f;
+    int level = 0;
+    unsigned int generation = 0;          //bumped on every change, older measurements don't count
+    float cpuTime = 0.0f, gpuTime = 0.0f; //smoothed, seconds
+    float simulationGpuTime = 0.0f;       //smoothed, seconds of the simulation context per frame
+    int samples = 0, gpuSamples = 0;      //frames measured since the last change
+    float headroomTime = 0.0f;            //how long the load has been well below the target
+    float cooldown = 0.0f;
+    float sinceRaise = 1e9f;
+
+    const float smoothing = 0.1f;
+    const float overload = 1.05f, underload = 0.7f; //the gap between both is the hysteresis
+    const float raiseAfter = 3.0f;                  //seconds of headroom before the quality goes up again
+    float raiseDelay = raiseAfter;                  //doubles whenever a raise has to be taken back right away
+    const float failedRaiseWindow = 2.0f;
+    const float settleTime = 0.5f;                  //seconds after a change before the next decision
+    const int minSamples = 8;
+
+    void changeLevel(int newLevel);
+public:
+    FrameGovernor() = default;
+    FrameGovernor(const FrameGovernor&) = delete;
+    FrameGovernor& operator=(const FrameGovernor&) = delete;
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const;
+    void setTargetFps(float fps);
+    //Brackets the GPU work of a frame with a timer query, no other GL_TIME_ELAPSED query may run in between
+    void beginGpuFrame();
+    void endGpuFrame();
+    //Call once per frame with the CPU time of the frame and the GPU time another context spent on the physics since the
+    //last call. Frames that don't simulate, e.g. while capturing or paused, only keep the timer queries going
+    void update(float cpuSeconds, float frameSeconds, bool simulating, float simulationGpuSeconds = 0.0f);
+    //Copy of the parameters with the limits of the current level applied
+    EmitterParams apply(const EmitterParams& params) const;
+    const Level& getLevel() const;
+    int getLevelIndex() const;
+    float getCpuTime() const;
+    //render and simulation context together
+    float getGpuTime() const;
+    ~FrameGovernor();
+};
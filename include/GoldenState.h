@@ -0,0 +1,42 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <filesystem>
+#include "glm/glm.hpp"
+#include "glm/gtc/packing.hpp"
+#include "Helpers.h"
+#include "Emitter.h"
+#include "SdfCollider.h"
+#include "CommandLine.h"
+
+//Particle state after a seeded run of a fixed number of physics steps, together with everything needed to repeat the run.
+//Stored as golden file, a later run with the same scenario is compared against it to make sure that optimizations of the
+//compute step (or another backend) did not change the simulation results.
+//Positions and velocities are written with enough digits to read back the exact floats, orientations stay packed
+class GoldenState
+{
+public:
+    EmitterParams params;
+    int steps = 0;
+    //a particle matches if all its values are within these tolerances, GPUs and drivers may round differently
+    float positionTolerance = 1e-3f;
+    float velocityTolerance = 1e-2f;
+    float orientationTolerance = 2e-3f; //angle between the orientations in radians
+
+    std::vector<glm::vec4> positions;
+    std::vector<glm::uvec4> orientations;
+    std::vector<glm::vec4> velocities;
+
+    //Runs the scenario described by params and steps on the emitter and reads back the particle buffers
+    void capture(Emitter& emitter);
+    //FNV-1a hash over the raw buffer contents, equal hashes mean bit identical results
+    uint64_t checksum() const;
+    bool save(const std::filesystem::path& path) const;
+    bool load(const std::filesystem::path& path);
+    //Prints a report and returns true if every particle is within the tolerances of the reference
+    bool compare(const GoldenState& reference) const;
+};
+
+//Handles --golden-record / --golden-check, returns the process exit code
+int runGoldenMode(const CommandLineOptions& options, SdfCollider* colliders);
@@ -0,0 +1,22 @@
+#pragma once
+
+//OpenGL 4.5 core context without any window or display server, for batch runs on headless machines.
+//Uses a surfaceless EGL display (EGL_MESA_platform_surfaceless, which Mesa llvmpipe supports as well) and falls back to
+//the default EGL display. All rendering has to go into framebuffer objects, there is no default framebuffer.
+//Only available when built with EGL (WITH_EGL in CMake), create() fails otherwise
+class HeadlessContext
+{
+private:
+    //EGL handles, kept as void* so the EGL headers are only needed in the source file
+    void* display = nullptr;
+    void* context = nullptr;
+public:
+    HeadlessContext() = default;
+    HeadlessContext(const HeadlessContext&) = delete;
+    HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+    //Creates the context, makes it current and initializes GLEW
+    bool create();
+    void destroy();
+    ~HeadlessContext();
+};
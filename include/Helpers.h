@@ -3,12 +3,17 @@
 #include "GL/glew.h"
 #include "glm/glm.hpp"
 #include <vector>
+#include <algorithm>
 
 static inline float pi = static_cast<float>(std::numbers::pi);
 
+//the spawn kernels in spawn.glsl use the same numbering
 enum class EmitterShape {
     boxShape,
-    circleShape
+    circleShape,
+    discShape,
+    sphereShape,
+    meshShape //surface of the spawn mesh set on the emitter, e.g. the tree crown
 };
 
 enum class ParticleShape {
@@ -17,6 +22,25 @@ enum class ParticleShape {
     pointShape
 };
 
+//Another emitter next to the main one, which is described by the EmitterParams themselves and sits at the origin.
+//All emitters share one particle pool and are simulated and drawn together, every emitter owns a range of the pool
+struct EmitterSource {
+    glm::vec3 origin = glm::vec3(0.0f);
+    EmitterShape shape = EmitterShape::circleShape;
+    float emitRadius = 3.0f;
+    float emitHeight = 10.0f;
+    int leafCount = 1000;   //with a spawn rate: the most particles that can be alive at once
+    float spawnRate = 0.0f; //particles per second, 0 keeps all leafCount particles alive and respawns them when they land
+    float lifetime = 0.0f;  //seconds until a particle fades out and dies, 0 = until it lands
+    //(seconds since the start, factor on spawnRate) keys, linear in between and the last one holds. Empty = constant rate
+    std::vector<glm::vec2> rateCurve;
+    int burstCount = 0;         //particles at once at the start and then every burstInterval seconds, on top of the rate
+    float burstInterval = 0.0f; //0 = only the burst at the start
+};
+
+//main emitter included
+const int maxEmitters = 8;
+
 //This is the struct that gets passed to the UI and the Emitter. When the user interacts with the UI,
 //the instance of this struct that gets passed around changes. The emitter then applies these changes to the simulation
 //This also gets passed to the leaf update method
@@ -36,8 +60,66 @@ struct EmitterParams {
     float emitHeight;
     EmitterShape shape;
     ParticleShape particleShape;
+    bool sceneColliders = false; //collide with the static scene geometry (house, wall, tree)
+    unsigned int seed = 1; //key for all random numbers, the same seed and parameters give the same simulation
+    float physicsRate = 62.5f; //fixed physics steps per second, the rendering interpolates between the last two steps
+    float activeFraction = 1.0f; //share of the particles of every emitter that is simulated and drawn, the rest stays frozen
+    std::vector<EmitterSource> emitters; //the emitters besides the main one, at most maxEmitters - 1
+    float spawnRate = 0.0f; //of the main emitter, see EmitterSource
+    float lifetime = 0.0f;
+    std::vector<glm::vec2> rateCurve;
+    int burstCount = 0;
+    float burstInterval = 0.0f;
 };
 
+//All emitters in the order of their particle ranges, the main one first
+inline std::vector<EmitterSource> allEmitters(const EmitterParams& params) {
+    std::vector<EmitterSource> sources;
+    sources.push_back(EmitterSource{glm::vec3(0.0f), params.shape, params.emitRadius, params.emitHeight, params.leafCount,
+                                    params.spawnRate, params.lifetime, params.rateCurve, params.burstCount, params.burstInterval});
+    for (size_t i = 0; i < params.emitters.size() && sources.size() < maxEmitters; i++) sources.push_back(params.emitters[i]);
+    return sources;
+}
+
+//Emitters that spawn over time recycle their particles, the others keep all of them in the air
+inline bool spawnsOverTime(const EmitterSource& source) {
+    return source.spawnRate > 0.0f || source.burstCount > 0;
+}
+
+//Particles per second at the given time since the start, without the bursts
+inline float spawnRateAt(const EmitterSource& source, float time) {
+    const std::vector<glm::vec2>& curve = source.rateCurve;
+    float factor = 1.0f;
+    if(!curve.empty()) {
+        factor = curve.back().y;
+        if(time <= curve.front().x) factor = curve.front().y;
+        else {
+            for (size_t i = 1; i < curve.size(); i++) {
+                if(time >= curve[i].x) continue;
+                float t = (time - curve[i - 1].x) / std::max(curve[i].x - curve[i - 1].x, 1e-6f);
+                factor = glm::mix(curve[i - 1].y, curve[i].y, t);
+                break;
+            }
+        }
+    }
+    return std::max(source.spawnRate * factor, 0.0f);
+}
+
+//Places the two black holes opposite each other on their orbit, rotation is the current angle on the circle in radians.
+//The orbit is tilted by blackHoleAngle around the x axis and floats above the ground
+inline void orbitBlackHoles(EmitterParams& params, float rotation) {
+    float r = params.blackHoleRadius;
+    float angle = glm::radians(params.blackHoleAngle);
+    params.blackHolePositions.resize(2);
+    for (int i = 0; i < 2; i++)
+    {
+        //the second black hole is offsetted by pi aka 180 degrees
+        float orbitAngle = rotation - i * pi;
+        float y = sinf(orbitAngle) * r;
+        params.blackHolePositions[i] = glm::vec3{cosf(orbitAngle) * r, cosf(angle) * y + 6.35f, sinf(angle) * y};
+    }
+}
+
 //Used to generate the vertex data for the circle shape gizmos
 inline std::vector<glm::vec3>* generateCirclePoints(int numOfPoints) {
     float degToAdvance = 360.0f / (float)numOfPoints;
@@ -148,6 +230,79 @@ inline std::vector<glm::vec3>* generateSphereNormals(int sectorCount, int stackC
     return result;
 }
 
+//Closed box centered at the origin, used for the collider scene (walls, houses)
+inline std::vector<glm::vec3>* generateBoxPoints(const glm::vec3& halfExtents) {
+    std::vector<glm::vec3>* result = new std::vector<glm::vec3>();
+    for (int i = 0; i < 8; i++)
+    {
+        result->push_back(glm::vec3{(i & 1) ? halfExtents.x : -halfExtents.x,
+                                    (i & 2) ? halfExtents.y : -halfExtents.y,
+                                    (i & 4) ? halfExtents.z : -halfExtents.z});
+    }
+    return result;
+}
+
+inline std::vector<unsigned int>* generateBoxIndices() {
+    //corner index bits: 1 = +x, 2 = +y, 4 = +z
+    return new std::vector<unsigned int> {
+        0, 2, 3,  3, 1, 0,   // -z
+        4, 5, 7,  7, 6, 4,   // +z
+        0, 4, 6,  6, 2, 0,   // -x
+        1, 3, 7,  7, 5, 1,   // +x
+        0, 1, 5,  5, 4, 0,   // -y
+        2, 6, 7,  7, 3, 2    // +y
+    };
+}
+
+//Gable roof standing on y = 0: a rectangle of width x depth with the ridge running along z at the given height
+inline std::vector<glm::vec3>* generateRoofPoints(float width, float depth, float height) {
+    float w = width / 2.0f, d = depth / 2.0f;
+    return new std::vector<glm::vec3> {
+        {-w, 0, -d}, {w, 0, -d}, {0, height, -d},
+        {-w, 0,  d}, {w, 0,  d}, {0, height,  d}
+    };
+}
+
+inline std::vector<unsigned int>* generateRoofIndices() {
+    return new std::vector<unsigned int> {
+        0, 2, 1,            // front gable
+        3, 4, 5,            // back gable
+        0, 3, 5,  5, 2, 0,  // left slope
+        1, 2, 5,  5, 4, 1,  // right slope
+        0, 1, 4,  4, 3, 0   // bottom
+    };
+}
+
+//Closed cylinder standing on y = 0, the last two points are the centers of the bottom and top cap
+inline std::vector<glm::vec3>* generateCylinderPoints(int sectorCount, float radius, float height) {
+    std::vector<glm::vec3>* result = new std::vector<glm::vec3>();
+    float sectorStep = 2 * pi / sectorCount;
+    for (int i = 0; i < sectorCount; i++)
+    {
+        float x = radius * cosf(i * sectorStep);
+        float z = radius * sinf(i * sectorStep);
+        result->push_back(glm::vec3{x, 0, z});
+        result->push_back(glm::vec3{x, height, z});
+    }
+    result->push_back(glm::vec3{0, 0, 0});
+    result->push_back(glm::vec3{0, height, 0});
+    return result;
+}
+
+inline std::vector<unsigned int>* generateCylinderIndices(int sectorCount) {
+    std::vector<unsigned int>* indices = new std::vector<unsigned int>();
+    unsigned int bottomCenter = sectorCount * 2, topCenter = sectorCount * 2 + 1;
+    for (int i = 0; i < sectorCount; i++)
+    {
+        unsigned int b0 = i * 2, t0 = i * 2 + 1;
+        unsigned int b1 = ((i + 1) % sectorCount) * 2, t1 = b1 + 1;
+        indices->insert(indices->end(), {b0, t0, t1,  t1, b1, b0});
+        indices->insert(indices->end(), {bottomCenter, b0, b1});
+        indices->insert(indices->end(), {topCenter, t1, t0});
+    }
+    return indices;
+}
+
 inline GLenum getErrorCode_(const char* file, int line) {
     GLenum errorCode;
     while((errorCode = glGetError()) != GL_NO_ERROR) {
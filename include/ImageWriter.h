@@ -0,0 +1,13 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <filesystem>
+
+//Encoders for captured frames. The input is always tightly packed RGBA8 as read back from OpenGL, i.e. bottom row first
+
+//RGB PNG, encoded with stb_image_write
+bool writePng(const std::filesystem::path& path, int width, int height, const uint8_t* rgba);
+
+//Planar YUV 4:2:0 (I420) with BT.601 limited range, as expected by raw video tools. width and height have to be even
+void rgbaToI420(int width, int height, const uint8_t* rgba, std::vector<uint8_t>& yuv);
@@ -1,5 +1,6 @@
 #pragma once
 #include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
 #include "GL/glew.h"
 #include "Shader.h"
 #include "Helpers.h"
@@ -8,13 +9,12 @@ class Leaf
 {
 private:
     glm::vec3 rotation;
-    glm::mat4 model;
     
 public:
     Leaf() = default;
     Leaf(const glm::vec3& rot);
-    glm::mat4& getLeafModel();
     const glm::vec3& getRotation() const;
+    glm::quat getOrientation() const;
     ~Leaf();    
 };
 
@@ -0,0 +1,26 @@
+#pragma once
+#include <filesystem>
+#include <cstddef>
+
+//Read only memory mapping of a whole file. The OS pages the contents in on demand,
+//so large files can be copied straight into GPU buffers without reading them into a temporary vector first
+class MappedFile
+{
+private:
+    const unsigned char* mappedData = nullptr;
+    size_t mappedSize = 0;
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#endif
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::filesystem::path& path);
+    void close();
+    const unsigned char* data() const;
+    size_t size() const;
+    ~MappedFile();
+};
@@ -2,6 +2,7 @@
 #include <chrono>
 #include <iostream>
 #include <string>
+#include <vector>
 
 #define PROFILING_ACTIVE 1
 
@@ -9,7 +10,8 @@ class Profiler
 {
 private:
     Profiler() = delete;
-    static inline std::chrono::time_point<std::chrono::high_resolution_clock> m_startPoint;
+    //Start/Stop pairs can be nested, e.g. the SDF build inside the startup measurement
+    static inline std::vector<std::chrono::time_point<std::chrono::high_resolution_clock>> m_startPoints;
 public:
     static void Start();
     static void Stop(int granularity);
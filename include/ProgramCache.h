@@ -0,0 +1,32 @@
+#pragma once
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+//On-disk cache of linked shader programs (glGetProgramBinary/glProgramBinary), so startup skips the GLSL compiler.
+//Every program has one file named after its shaders. The file stores a key hashed from the preprocessed sources and the
+//driver vendor, renderer and version: a changed shader or driver update gives a different key and the program is
+//compiled and stored again. Binaries the driver refuses are deleted as well
+class ProgramCache
+{
+private:
+    ProgramCache() = delete;
+    static inline std::filesystem::path directory = "shader_cache";
+    static inline bool enabled = true;
+    static inline int supported = -1; //unknown until the first lookup, needs a current context
+
+    static bool isSupported();
+    static std::filesystem::path filePath(const std::string& name);
+public:
+    static void setDirectory(const std::filesystem::path& directory);
+    static void setEnabled(bool enabled);
+    //Key of a program, the sources are hashed in the given order
+    static uint64_t computeKey(const std::vector<std::string>& sources);
+    //Tries to fill the (freshly created) program with the cached binary, true if it's linked and ready to use
+    static bool load(const std::string& name, uint64_t key, unsigned int program);
+    //Has to be called before linking, otherwise drivers may not keep the binary around
+    static void prepare(unsigned int program);
+    //Writes the binary of a successfully linked program
+    static void store(const std::string& name, uint64_t key, unsigned int program);
+};
@@ -1,6 +1,17 @@
 #pragma once
 #include <random>
 #include <iostream>
+#include <cstdint>
+#include "glm/glm.hpp"
+
+//The counter based generator is written once in GLSL syntax and compiled into both the compute shader and the CPU code,
+//these aliases are all it needs to compile as C++
+namespace RandomShared {
+    using uint = glm::uint;
+    using uvec4 = glm::uvec4;
+    using vec4 = glm::vec4;
+    #include "../shaders/random.glsl"
+}
 
 class Random {
 public: 
@@ -21,6 +32,11 @@ public:
         randomEngine.seed(std::random_device()());
         initialized = true;
     }
+    //Four uniform floats in [0, 1) that only depend on the key, the same numbers the compute shader gets for that key.
+    //Use the RNG_STREAM_* constants from random.glsl as stream
+    static glm::vec4 Float4(uint32_t seed, uint32_t particleId, uint32_t stepIndex, uint32_t stream) {
+        return RandomShared::random4(seed, particleId, stepIndex, stream);
+    }
 private: 
     //If we wouldn't use the inline keyword, we would have to define these member variables in another .cpp file
     //because now they are only declared (but with inline you can define variables inside of a header file)
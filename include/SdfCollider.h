@@ -0,0 +1,61 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <limits>
+#include "GL/glew.h"
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+#include "Shader.h"
+#include "Helpers.h"
+#include "Profiler.h"
+
+//Static scene geometry (trees, roofs, walls) that the leaves collide with.
+//The triangle meshes are converted once into a signed distance field that gets uploaded as a 3D texture,
+//so the compute shader only needs a few texture lookups per leaf instead of testing against every triangle.
+//Negative distances are inside of a mesh, so the meshes have to be closed.
+class SdfCollider
+{
+private:
+    std::vector<glm::vec3> triangles; //3 consecutive entries form a triangle
+    std::vector<int> triangleMesh; //which mesh every triangle belongs to, meshes may overlap (trunk and crown of a tree)
+    int meshCount = 0;
+
+    glm::vec3 boundsMin, boundsMax;
+    glm::ivec3 dimensions;
+    float cellSize;
+    std::vector<float> distances; //x runs fastest, then y, then z
+
+    unsigned int sdfTexture = 0;
+    unsigned int meshVAO = 0, meshVBO = 0;
+    Shader meshShader;
+    bool built = false;
+
+    int voxelIndex(int x, int y, int z) const;
+    glm::vec3 voxelCenter(int x, int y, int z) const;
+    void computeNarrowBand(std::vector<glm::vec3>& closestPoints, int band);
+    void propagateDistances(std::vector<glm::vec3>& closestPoints);
+    void computeSigns();
+public:
+    SdfCollider();
+    void addMesh(const std::vector<glm::vec3>& vertices, const std::vector<unsigned int>& indices, const glm::mat4& transform);
+    bool addObjFile(const std::filesystem::path& objPath, const glm::mat4& transform);
+    void addDefaultScene();
+    //Converts all meshes added so far into the distance field. cellSize is the voxel edge length in world units
+    void build(float cellSize);
+    void draw(const glm::mat4& view, const glm::mat4& projection);
+
+    bool isBuilt() const;
+    //meshes in the order they were added, the default scene adds the tree crown last
+    int getMeshCount() const;
+    //World space triangles of one mesh, 3 consecutive entries form a triangle
+    std::vector<glm::vec3> getMeshTriangles(int mesh) const;
+    unsigned int getTexture() const;
+    const glm::vec3& getBoundsMin() const;
+    const glm::vec3& getBoundsMax() const;
+    glm::vec3 getTexelSize() const;
+    ~SdfCollider();
+};
@@ -3,25 +3,47 @@
 #include <filesystem>
 #include <iostream>
 #include <fstream>
+#include <vector>
+#include <string>
 #include <SDL3/SDL.h>
 #include <glm/glm.hpp>
 #include "glm/gtc/type_ptr.hpp"
 #include "Texture.h"
 #include "Helpers.h"
 
+//createProgram and createComputeProgram only submit the sources, compiling and linking runs in the background
+//(GL_KHR_parallel_shader_compile) while the CPU does other startup work. The results are checked in finish(), which
+//finishPending() does for all programs, or at the latest when a uniform is set
 class Shader
 {
 private:
-    unsigned int vS = 0, fS = 0;
+    unsigned int vS = 0, fS = 0, cS = 0;
+    bool pending = false, linked = false;
+    std::string cacheName;
+    uint64_t cacheKey = 0;
+    static inline std::vector<Shader*> pendingShaders;
+    static inline int parallelCompile = -1; //unknown until the first program is submitted
+
+    static bool enableParallelCompile();
+    void submit();
 public:
     unsigned int ID = 0; //For the shader program
     Shader();
+    Shader(const Shader&) = delete;
+    Shader& operator=(const Shader&) = delete;
     void createProgram(std::filesystem::path vShaderPath, std::filesystem::path fShaderPath);
     void createComputeProgram(std::filesystem::path computeShaderPath);
+    //Never blocks, true once the driver is done compiling and linking (always true without the parallel compile extension)
+    bool isReady() const;
+    //Waits for the program and reports compile and link errors, returns whether it linked
+    bool finish();
+    //Finishes all submitted programs in the order the driver completes them
+    static void finishPending();
     ~Shader();
     void useTexture(const Texture& texture, std::string samplerName);
     const void setBool(const std::string &name, bool value);
     const void setInt(const std::string &name, int value);
+    const void setUInt(const std::string &name, unsigned int value);
     const void setFloat(const std::string &name, float value);
     const void setVec3f(const std::string &name, glm::vec3 value);
     const void setMatrix4(const std::string& name, glm::mat4 matrix);
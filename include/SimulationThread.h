@@ -0,0 +1,86 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include "GL/glew.h"
+#include "Emitter.h"
+
+//Runs the physics of an emitter on its own thread, with a second GL context from the same share group, so a slow
+//physics step no longer holds up the render loop. After the steps of an update the simulation copies the particles
+//into one of two buffer sets and fences the copy. The render loop always draws the newest finished set and fences its
+//draw in turn, the simulation waits for that fence before it writes the set again. Both waits happen on the GPU.
+//Without start() everything runs inline on the calling thread, exactly like calling the emitter directly.
+class SimulationThread
+{
+private:
+    struct Slot {
+        ParticleBuffers buffers = {};
+        std::vector<ParticleRange> ranges; //the active particles of every emitter, at the same offsets as in the emitter
+        int capacity = 0;
+        float accumulated = 0.0f, fixedDT = 0.016f; //accumulator of the emitter when the slot was written
+        GLsync written = nullptr; //the copy into the slot is done
+        GLsync read = nullptr;    //the last draw from the slot is done
+    };
+
+    Emitter& emitter;
+    Slot slots[2];
+    int published = -1, inUse = -1; //newest finished slot, slot the render loop is drawing from
+
+    bool threaded = false;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    bool quit = false;
+    bool needsPublish = true;
+    //commands run between two updates, run() waits for its ticket
+    std::vector<std::function<void(Emitter&)>> commands;
+    uint64_t commandsQueued = 0, commandsDone = 0;
+    //simulated time the render loop asked for but the simulation hasn't stepped yet
+    EmitterParams params;
+    float pendingTime = 0.0f;
+    float unpublishedTime = 0.0f; //simulated already, but not in the published slot yet
+    uint64_t updatesQueued = 0, updatesDone = 0;
+    //runs on the simulation thread every time it wakes up, with the frame time handed to frame() since the last time
+    std::function<bool(Emitter&, float)> poll;
+    float pendingFrameTime = 0.0f;
+    bool framePending = false;
+    bool lockstep = false;
+    //the physics runs on another context, so it is timed with its own queries on the simulation thread
+    static constexpr int queryCount = 8;
+    unsigned int queries[queryCount] = {};
+    int nextQuery = 0, pendingQueries = 0;
+    float gpuTime = 0.0f; //finished measurements the render loop hasn't taken yet
+    const float maxCatchUp = 0.25f; //a simulation that falls further behind drops the time instead of spiraling
+
+    void loop(std::function<bool()> makeCurrent, std::function<void()> doneCurrent);
+    int freeSlot() const;
+    void publish(int target);
+    float collectQueries();
+public:
+    explicit SimulationThread(Emitter& emitter);
+    SimulationThread(const SimulationThread&) = delete;
+    SimulationThread& operator=(const SimulationThread&) = delete;
+
+    //makeCurrent is called on the new thread and has to make the shared context current there
+    bool start(std::function<bool()> makeCurrent, std::function<void()> doneCurrent);
+    void stop();
+    //Runs the command with the emitter between two updates and waits for it, everything but drawing goes through here
+    void run(const std::function<void(Emitter&)>& command);
+    //Work that has to happen once per frame next to the simulation, like polling async writers. It returns whether it
+    //changed the particles, then they are published again. Set it before start()
+    void setPoll(std::function<bool(Emitter&, float)> poll);
+    //Hands the frame time to the poll and returns right away, without a thread the poll runs inline
+    void frame(float dT);
+    //Hands the frame time and the current parameters to the simulation, returns right away unless lockstep is set
+    void update(float dT, const EmitterParams& params);
+    //Makes update() wait until the time is simulated and published, for frame captures that have to be reproducible
+    void setLockstep(bool lockstep);
+    //GPU time the updates took on the simulation context since the last call. Without a thread the physics runs on the
+    //render context and is part of its own timings, then this is 0
+    float takeGpuTime();
+    //Draws the newest published particle state
+    void draw(const glm::mat4& view, const glm::mat4& projection, const EmitterParams& params);
+    ~SimulationThread();
+};
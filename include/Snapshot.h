@@ -0,0 +1,89 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <filesystem>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include "Helpers.h"
+#include "Emitter.h"
+#include "AsyncReadback.h"
+#include "MappedFile.h"
+
+//Binary snapshot of the whole simulation: the EmitterParams plus the raw particle buffers.
+//Layout: SnapshotHeader, one SnapshotEmitter per emitter, the keys of all rate curves, then positions, packed orientations
+//and velocities exactly as they are stored in the SSBOs, at the offsets given in the header. The particle sections are
+//16 byte aligned. Little endian only, the version has to be bumped whenever the layout changes
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t particleCount;
+    uint32_t stepIndex;
+    uint32_t seed;
+    float windForce[3];
+    float blackHoleMass;
+    float blackHoleSpeed;
+    float blackHoleRadius;
+    float blackHoleAngle;
+    float size;
+    float gravity;
+    uint8_t spiralingMotion;
+    uint8_t tumbling;
+    uint8_t sceneColliders;
+    uint8_t particleShape;
+    float physicsAccumulator; //seconds the last update didn't step yet, a restored run goes on step for step
+    uint32_t emitterCount;
+    //as set in the params, the frame governor caps them again after loading
+    float physicsRate;
+    float activeFraction;
+    float spawnClock;         //seconds the rate curves and bursts are at
+    uint32_t padding[3];
+    uint64_t emittersOffset;   //SnapshotEmitter[emitterCount]
+    uint64_t rateCurveOffset;  //(time, factor) float pairs, the keys of every emitter after the ones of the emitters before it
+    uint64_t positionsOffset;
+    uint64_t orientationsOffset;
+    uint64_t velocitiesOffset;
+};
+
+//An emitter of the scene, in the order of allEmitters(): the main one first, then EmitterParams::emitters
+struct SnapshotEmitter {
+    float origin[3];
+    uint32_t shape;
+    float emitRadius;
+    float emitHeight;
+    uint32_t first; //the particles of the emitter in the particle sections
+    uint32_t count;
+    float spawnRate;
+    float lifetime;
+    int32_t burstCount;
+    float burstInterval;
+    uint32_t rateCurveKeys;
+    float spawnCarry; //spawns that didn't make a whole particle yet
+    uint32_t padding[2];
+};
+
+//Saves snapshots without stalling the frame: the particle buffers are copied into a mapped staging buffer on the GPU,
+//and once the fence signals, a worker thread writes the file. poll() has to be called once per frame
+class SnapshotWriter
+{
+private:
+    AsyncReadback readback;
+    SnapshotHeader header;
+    std::vector<uint8_t> sceneData; //the emitters and rate curves between the header and the particles
+    std::filesystem::path path;
+    std::thread writerThread;
+    std::atomic<bool> writing = false;
+    bool waitingForGPU = false;
+
+    void writeFile();
+public:
+    //Returns false if a snapshot is still being saved
+    bool save(const Emitter& emitter, const EmitterParams& params, const std::filesystem::path& path);
+    void poll();
+    bool isBusy() const;
+    ~SnapshotWriter();
+};
+
+//Restores the params and the particle buffers of a snapshot, the file is memory mapped and copied straight into the buffers
+bool loadSnapshot(const std::filesystem::path& path, Emitter& emitter, EmitterParams& params);
@@ -0,0 +1,60 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include "glm/glm.hpp"
+#include "Helpers.h"
+
+//The spawn kernels are written once in GLSL syntax and compiled into both the compute shader and the CPU code,
+//like the random numbers in Random.h
+namespace SpawnShared {
+    using uint = glm::uint;
+    using vec2 = glm::vec2;
+    using vec3 = glm::vec3;
+    using glm::sqrt;
+    using glm::cos;
+    using glm::sin;
+    using glm::pow;
+    using glm::max;
+    #include "../shaders/spawn.glsl"
+}
+
+class Spawn {
+public:
+    Spawn() = delete;
+    //Point of the emitter shape for three uniform random numbers, the same one the compute shader picks for them
+    static glm::vec3 Position(EmitterShape shape, const glm::vec3& r, float radius, float height) {
+        return SpawnShared::spawnPosition(static_cast<uint32_t>(shape), r, radius, height);
+    }
+    //Layout of the spawnTriangles buffer: three vec4 per triangle, the w of the first one is the share of the total area
+    //up to and including this triangle. Degenerate triangles are left out, they have no normal and can't be hit anyway
+    static std::vector<glm::vec4> MeshTable(const std::vector<glm::vec3>& triangles) {
+        std::vector<glm::vec4> table;
+        table.reserve(triangles.size());
+        float totalArea = 0.0f;
+        for (size_t t = 0; t + 2 < triangles.size(); t += 3) {
+            const glm::vec3 &a = triangles[t], &b = triangles[t + 1], &c = triangles[t + 2];
+            float area = 0.5f * glm::length(glm::cross(b - a, c - a));
+            if(area <= 1e-8f) continue;
+            totalArea += area;
+            table.push_back(glm::vec4(a, totalArea));
+            table.push_back(glm::vec4(b, 0.0f));
+            table.push_back(glm::vec4(c, 0.0f));
+        }
+        for (size_t t = 0; t < table.size(); t += 3) table[t].w /= totalArea;
+        //the search relies on the last share being exactly 1, the random numbers stay below it
+        if(!table.empty()) table[table.size() - 3].w = 1.0f;
+        return table;
+    }
+    //CPU counterpart of spawnOnMesh in spawn.glsl
+    static glm::vec3 OnMesh(const std::vector<glm::vec4>& table, const glm::vec3& r, float offset) {
+        size_t triangleCount = table.size() / 3;
+        size_t low = 0, high = triangleCount - 1;
+        while (low < high) {
+            size_t middle = (low + high) / 2;
+            if(table[middle * 3].w < r.x) low = middle + 1;
+            else high = middle;
+        }
+        glm::vec3 a = glm::vec3(table[low * 3]), b = glm::vec3(table[low * 3 + 1]), c = glm::vec3(table[low * 3 + 2]);
+        return SpawnShared::spawnOnTriangle(a, b, c, glm::vec2(r.y, r.z)) + glm::normalize(glm::cross(b - a, c - a)) * offset;
+    }
+};
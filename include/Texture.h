@@ -3,18 +3,59 @@
 #include <string>
 #include <filesystem>
 #include <iostream>
+#include <memory>
+#include <vector>
+#include <atomic>
 #include "GL/glew.h"
 #include "Helpers.h"
+#include "TextureCompression.h"
 
+//Images are decoded on worker threads. Until a texture is uploaded it shows a 1x1 grey placeholder, so startup never
+//waits for stbi_load. pollPending() (once per frame) uploads finished images through a pixel unpack buffer.
+//With S3TC support images are stored block compressed with a precomputed mipmap chain: the first load compresses them
+//into texture_cache/, later loads read the cache, and .ktx2 files are uploaded as they are
 class Texture {
 private: 
+    //filled by the decoding thread, ready is only set once everything else is written
+    struct DecodedImage {
+        unsigned char* pixels = nullptr;
+        int width = 0, height = 0, channels = 0, desiredChannels = 0;
+        CompressedImage compressed; //used instead of pixels if the format is set
+        std::string error;
+        std::atomic<bool> ready = false;
+        ~DecodedImage();
+    };
+
     unsigned int textureHandle; //The handle that his texture is identified with
     unsigned int textureUnitIndex; //Set with glActiveTexture(), sets the active texture unit that the sampler has to use
+    unsigned int target; //GL_TEXTURE_2D, or GL_TEXTURE_2D_ARRAY with one layer per image
+
+    int width, height, nrChannels, layerCount;
+    std::vector<std::string> imagePaths;
+    std::vector<std::shared_ptr<DecodedImage>> decoding; //one per layer, shared with the decoding jobs, which may outlive the texture
+    static inline std::vector<Texture*> pendingTextures;
 
-    int width, height, nrChannels;
+    int initializeLayers(const std::vector<std::string>& imagePaths, unsigned int texUnit, unsigned int target);
+    void upload();
+    void uploadPixels(const std::vector<const DecodedImage*>& layers);
+    void uploadCompressed(const std::vector<const DecodedImage*>& layers);
 public: 
     Texture();
+    Texture(const Texture&) = delete;
+    Texture& operator=(const Texture&) = delete;
+    //Binds the placeholder and queues the decoding, returns 0 if the image doesn't exist
     int initialize(const std::string& imagePath, unsigned int texUnit);
+    //Same for a texture array, every image becomes one layer. The layer count is fixed right away, layers that can't be
+    //loaded or don't match the size of the first one show the first image instead
+    int initializeArray(const std::vector<std::string>& imagePaths, unsigned int texUnit);
+    bool isLoaded() const;
     unsigned int getTextureUnit() const;
     unsigned int getHandle() const;
-};
\ No newline at end of file
+    unsigned int getTarget() const;
+    int getLayerCount() const;
+    //Uploads all textures whose images are decoded by now, never waits
+    static void pollPending();
+    //Waits for all queued images and uploads them, for runs that need the final textures in the first frame
+    static void finishPending();
+    ~Texture();
+};
@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <string>
+#include <filesystem>
+
+//Block compressed textures with their complete mipmap chain, ready for glCompressedTexImage2D.
+//Images are compressed once on a worker thread and cached on disk (.fltex), pre-made KTX2 files with BC1/BC3/BC7 are used as they are
+struct CompressedImage {
+    struct Level {
+        int width, height;
+        size_t offset, size; //into data
+    };
+    unsigned int format = 0; //GL internal format, e.g. GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+    std::vector<Level> levels;
+    std::vector<uint8_t> data;
+};
+
+//Box filtered mipmaps down to 1x1, BC1 (4 bits per pixel) for opaque images and BC3 (8 bits per pixel) if any pixel is transparent.
+//rgba is tightly packed RGBA8
+void compressImage(const uint8_t* rgba, int width, int height, CompressedImage& image);
+
+//KTX2 without supercompression, BC1, BC3 or BC7 payload, 2D only
+bool loadKtx2(const std::filesystem::path& path, CompressedImage& image, std::string& error);
+
+//The cache belongs to one source image, it is only used if the size and modification time of the source still match
+bool loadCompressedCache(const std::filesystem::path& cachePath, const std::filesystem::path& sourcePath, CompressedImage& image);
+bool saveCompressedCache(const std::filesystem::path& cachePath, const std::filesystem::path& sourcePath, const CompressedImage& image);
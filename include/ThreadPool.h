@@ -0,0 +1,32 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+//Fixed number of worker threads that run queued jobs in submission order (but in parallel)
+class ThreadPool
+{
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable jobAvailable, allDone;
+    int runningJobs = 0;
+    bool stopping = false;
+
+    void workerLoop();
+public:
+    //threadCount 0 uses all hardware threads but one, the render thread needs one as well
+    explicit ThreadPool(unsigned int threadCount = 0);
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void enqueue(std::function<void()> job);
+    //Blocks until the queue is empty and no job is running anymore
+    void waitIdle();
+    size_t getPendingJobs();
+    ~ThreadPool();
+};
@@ -0,0 +1,158 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+
+//File format of recorded particle trajectories (.fltraj), shared by the recorder and the playback.
+//
+//  TrajectoryHeader
+//  chunk 0: TrajectoryChunkHeader + payload (compressed if compression != none)
+//  chunk 1: ...
+//  index:   TrajectoryIndexEntry per chunk
+//  TrajectoryFooter
+//
+//Every chunk holds up to framesPerChunk frames and can be decoded on its own: the first frame of a chunk is a keyframe,
+//the following ones store the difference to the previous frame. A frame is the step index followed by eight streams
+//(position xyz, orientation xyzw, variant and fade), each with one zigzag varint per particle. Positions are quantized to
+//1 / positionScale world units, orientations are the snorm16 values of the packed quaternion from the orientation buffer.
+//The last stream holds the texture layer from the upper 16 bits of the orientation w in its upper half and the fade of
+//the particle (position w, 1 alive, 0 dead) as unorm16 in its lower half.
+//The frame governor may change the physics rate while recording, so every chunk stores the step duration of its frames
+//and a new chunk begins whenever it changes
+//The footer is written last, a file without one (e.g. after a crash) can still be read by walking the chunk headers
+
+enum class TrajectoryCompression : uint32_t {
+    none = 0,
+    lz4 = 1,
+    zstd = 2
+};
+
+struct TrajectoryHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t particleCount;
+    uint32_t stepsPerFrame;   //fixed physics steps between two recorded frames
+    float fixedDT;            //step duration at the start, the chunks carry the one of their frames
+    float positionScale;      //quantization steps per world unit
+    uint32_t framesPerChunk;
+    uint32_t compression;     //TrajectoryCompression
+    uint32_t reserved[2];
+};
+
+struct TrajectoryChunkHeader {
+    char magic[4];
+    uint32_t firstFrame;
+    uint32_t frameCount;
+    uint32_t compression;
+    uint64_t rawSize;         //payload size after decompression
+    uint64_t storedSize;      //payload size in the file
+    float fixedDT;            //seconds per physics step of all frames in the chunk
+    uint32_t reserved;
+};
+
+struct TrajectoryIndexEntry {
+    uint64_t offset;          //file offset of the chunk header
+    uint32_t firstFrame;
+    uint32_t frameCount;
+};
+
+struct TrajectoryFooter {
+    uint64_t indexOffset;
+    uint32_t chunkCount;
+    uint32_t frameCount;
+    char magic[8];
+};
+
+inline constexpr char trajectoryMagic[8] = "FLTRAJ";
+inline constexpr char trajectoryChunkMagic[4] = {'T', 'C', 'H', 'K'};
+inline constexpr char trajectoryFooterMagic[8] = "FLTRIDX";
+inline constexpr uint32_t trajectoryVersion = 4;
+//position, orientation, variant and fade
+inline constexpr int trajectoryStreamCount = 8;
+
+//Quantized state of one frame, stream after stream (see above), the unit of delta encoding
+struct TrajectoryFrame {
+    uint32_t stepIndex = 0;
+    std::vector<int32_t> values; //trajectoryStreamCount * particleCount
+};
+
+inline int32_t quantizePosition(float value, float positionScale) {
+    float scaled = std::round(value * positionScale);
+    //NaNs and far away particles are clamped instead of wrapping around
+    if(!(scaled > static_cast<float>(std::numeric_limits<int32_t>::min()))) return std::numeric_limits<int32_t>::min();
+    if(scaled >= static_cast<float>(std::numeric_limits<int32_t>::max())) return std::numeric_limits<int32_t>::max();
+    return static_cast<int32_t>(scaled);
+}
+
+//the fade goes into the lower 16 bits of the last stream, next to the variant
+inline int32_t packVariantAndFade(uint32_t variant, float fade) {
+    float clamped = fade > 0.0f ? std::min(fade, 1.0f) : 0.0f; //NaN counts as dead
+    uint32_t quantized = static_cast<uint32_t>(std::round(clamped * 65535.0f));
+    return static_cast<int32_t>((variant << 16) | quantized);
+}
+
+inline float unpackFade(int32_t value) {
+    return static_cast<float>(static_cast<uint32_t>(value) & 0xffff) / 65535.0f;
+}
+
+inline void writeVarint(std::vector<uint8_t>& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+//Returns false if the varint runs past the end of the data
+inline bool readVarint(const uint8_t*& data, const uint8_t* end, uint32_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 35 && data < end; shift += 7) {
+        uint8_t byte = *data++;
+        value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if((byte & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+//small differences of either sign become small unsigned numbers: 0, -1, 1, -2, 2 ... -> 0, 1, 2, 3, 4 ...
+inline uint32_t zigzagEncode(int32_t value) {
+    return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+inline int32_t zigzagDecode(uint32_t value) {
+    return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+}
+
+//Appends frame as difference to previous (nullptr for a keyframe). Differences are computed with wrap around, so they always round trip
+inline void encodeTrajectoryFrame(std::vector<uint8_t>& out, const TrajectoryFrame& frame, const TrajectoryFrame* previous) {
+    writeVarint(out, frame.stepIndex);
+    for (size_t i = 0; i < frame.values.size(); i++) {
+        uint32_t reference = previous != nullptr ? static_cast<uint32_t>(previous->values[i]) : 0u;
+        writeVarint(out, zigzagEncode(static_cast<int32_t>(static_cast<uint32_t>(frame.values[i]) - reference)));
+    }
+}
+
+//Counterpart of encodeTrajectoryFrame, frame has to be sized already. Returns false on corrupt data
+inline bool decodeTrajectoryFrame(const uint8_t*& data, const uint8_t* end, TrajectoryFrame& frame, const TrajectoryFrame* previous) {
+    if(!readVarint(data, end, frame.stepIndex)) return false;
+    for (size_t i = 0; i < frame.values.size(); i++) {
+        uint32_t delta;
+        if(!readVarint(data, end, delta)) return false;
+        uint32_t reference = previous != nullptr ? static_cast<uint32_t>(previous->values[i]) : 0u;
+        frame.values[i] = static_cast<int32_t>(reference + static_cast<uint32_t>(zigzagDecode(delta)));
+    }
+    return true;
+}
+
+//Chunk compression, LZ4 and zstd are only available if the build enables them (WITH_LZ4 / WITH_ZSTD in CMake)
+bool isCompressionAvailable(TrajectoryCompression compression);
+//the best compression this build supports
+TrajectoryCompression defaultTrajectoryCompression();
+const char* compressionName(TrajectoryCompression compression);
+bool compressChunk(TrajectoryCompression compression, const std::vector<uint8_t>& raw, std::vector<uint8_t>& compressed);
+bool decompressChunk(TrajectoryCompression compression, const uint8_t* data, size_t size, std::vector<uint8_t>& raw, size_t rawSize);
@@ -0,0 +1,59 @@
+#pragma once
+#include <filesystem>
+#include <vector>
+#include "glm/glm.hpp"
+#include "Emitter.h"
+#include "MappedFile.h"
+#include "TrajectoryFormat.h"
+
+//Plays back a recorded .fltraj file instead of running the physics. The file is memory mapped, only the chunk that contains
+//the requested frame is decompressed and only the frames from its keyframe up to the requested one are decoded.
+//Playing forward continues from the last decoded frame, so normal playback decodes a single frame per displayed frame
+class TrajectoryPlayer
+{
+private:
+    MappedFile file;
+    TrajectoryHeader header;
+    std::vector<TrajectoryIndexEntry> index;
+    //playback time at the start of every chunk and the duration of its frames, the step duration may change between chunks
+    std::vector<float> chunkStarts, frameDurations;
+    float duration = 0.0f;
+    uint32_t frameCount = 0;
+    bool opened = false;
+
+    //decoding cursor: decompressed payload of the current chunk and the position after the last decoded frame
+    int currentChunk = -1;
+    std::vector<uint8_t> chunkData;
+    const uint8_t* chunkCursor = nullptr;
+    uint32_t decodedFrame = 0;
+    bool frameValid = false;
+    TrajectoryFrame frame, previousFrame;
+
+    //uploaded to the particle buffers
+    std::vector<glm::vec4> positions;
+    std::vector<glm::uvec4> orientations;
+    int uploadedFrame = -1;
+
+    float playbackTime = 0.0f;
+    bool playing = true;
+
+    bool readIndex();
+    bool scanChunks();
+    bool readChunkTimes();
+    int chunkOf(uint32_t frameIndex) const;
+    bool loadChunk(int chunk);
+    bool decodeFrame(uint32_t frameIndex);
+public:
+    bool open(const std::filesystem::path& path);
+    void close();
+    bool isOpen() const;
+
+    //Advances the playback time (if playing, loops at the end) and uploads the frame for that time into the emitter
+    void update(float dT, Emitter& emitter, float speed = 1.0f);
+    //Jumps to a frame, also while paused
+    void seek(uint32_t frameIndex);
+    void setPlaying(bool playing);
+    bool isPlaying() const;
+    uint32_t getFrameCount() const;
+    uint32_t getCurrentFrame() const;
+};
@@ -0,0 +1,72 @@
+#pragma once
+#include <string>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include "Emitter.h"
+#include "AsyncReadback.h"
+#include "TrajectoryFormat.h"
+
+//Streams particle positions, orientations and leaf variants to a .fltraj file (see TrajectoryFormat.h) while the simulation runs.
+//The Emitter calls onStep() after every fixed step, every stepsPerFrame steps the particle buffers are copied into one of two
+//staging buffers. poll() (once per frame) hands finished copies to the I/O thread, which quantizes, delta encodes, compresses
+//and writes them, so the render loop never waits for the GPU or the disk. If both staging buffers are still busy, the frame is dropped
+class TrajectoryRecorder
+{
+private:
+    enum class SlotState { idle, copying, encoding };
+    struct Slot {
+        AsyncReadback readback;
+        std::atomic<SlotState> state = SlotState::idle;
+        uint32_t stepIndex = 0;
+        float fixedDT = 0.0f; //step duration of the copied frame
+    };
+    static const int slotCount = 2;
+    Slot slots[slotCount];
+
+    TrajectoryHeader header;
+    std::ofstream file;
+    std::filesystem::path path;
+    std::atomic<bool> recording = false;
+    bool lossless = false;
+    int droppedFrames = 0;
+
+    //I/O thread
+    std::thread ioThread;
+    std::mutex queueMutex;
+    std::condition_variable queueCondition, slotFreed;
+    std::deque<int> encodeQueue; //slots that are ready for encoding, in capture order
+    bool stopRequested = false;
+
+    TrajectoryFrame previousFrame, currentFrame;
+    std::vector<uint8_t> chunkData, compressedData;
+    std::vector<TrajectoryIndexEntry> index;
+    uint32_t frameCount = 0, chunkFrameCount = 0;
+    float chunkFixedDT = 0.0f;
+    uint64_t bytesWritten = 0;
+
+    Slot* oldestCopyingSlot();
+    void queueForEncoding(Slot& slot);
+    void ioLoop();
+    void encodeSlot(Slot& slot);
+    void flushChunk();
+    void finishFile();
+public:
+    //positionScale: quantization steps per world unit, 1024 gives ~1mm precision.
+    //framesPerChunk is the keyframe interval, seeking during playback decodes up to that many frames
+    bool start(const std::filesystem::path& path, const Emitter& emitter, int stepsPerFrame = 1,
+               TrajectoryCompression compression = defaultTrajectoryCompression(), int framesPerChunk = 32, float positionScale = 1024.0f);
+    void onStep(const Emitter& emitter);
+    //Lossless recordings wait for a free staging buffer instead of dropping frames, for batch runs where nobody watches the frame time
+    void setLossless(bool lossless);
+    void poll();
+    //Waits for the outstanding copies, writes the last chunk and the index and closes the file
+    void stop();
+    bool isRecording() const;
+    ~TrajectoryRecorder();
+};
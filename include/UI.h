@@ -5,7 +5,7 @@
 #include "SDL3/SDL.h"
 #include "glm/glm.hpp"
 #include "Helpers.h"
-#include "UserEvents.h"
+#include "CommandQueue.h"
 
 extern float wWidth;
 extern float wHeight;
@@ -13,10 +13,48 @@ extern float wHeight;
 class UI
 {
 private:
+    CommandQueue& commands;
     bool show_demo_window = false, show_another_window = false;
+    bool respawnOnAreaChange = false;
+    char snapshotPath[256] = "snapshot.flsnap";
+    char trajectoryPath[256] = "trajectory.fltraj";
+    int recordEverySteps = 1;
+    bool recording = false;
+    char playbackPath[256] = "trajectory.fltraj";
+    float playbackSpeed = 1.0f;
+    bool playbackOpen = false, playbackPlaying = false;
+    int playbackFrame = 0, playbackFrameCount = 0;
+    char capturePath[256] = "capture";
+    int captureFormat = 0;
+    float captureFps = 60.0f;
+    bool capturing = false;
+    int capturedFrames = 0;
+    bool governorEnabled = false;
+    float governorFps = 60.0f;
+    int governorLevel = 0;
+    float governorCpuMs = 0.0f, governorGpuMs = 0.0f, governorPhysicsRate = 0.0f, governorParticleShare = 1.0f;
+
+    void send(CommandType type, int value = 0);
 public:
-    UI(SDL_Window* window, SDL_GLContext context);
+    //everything the main loop has to act on, like starting the simulation or respawning the particles, goes into commands
+    UI(SDL_Window* window, SDL_GLContext context, CommandQueue& commands);
     void update(EmitterParams& emitterParams);
     void draw();
+    const char* getSnapshotPath() const;
+    const char* getTrajectoryPath() const;
+    int getRecordEverySteps() const;
+    void setRecording(bool recording);
+    const char* getPlaybackPath() const;
+    float getPlaybackSpeed() const;
+    void setPlaybackState(bool open, bool playing, int frame, int frameCount);
+    const char* getCapturePath() const;
+    int getCaptureFormat() const;
+    float getCaptureFps() const;
+    void setCaptureState(bool capturing, int frames);
+    bool isGovernorEnabled() const;
+    float getGovernorFps() const;
+    void setGovernorEnabled(bool enabled, float fps);
+    //physicsRate is the rate that is actually simulated, after the governor's cap
+    void setGovernorState(int level, float cpuMs, float gpuMs, float physicsRate, float particleShare);
     ~UI();
 };
@@ -21,7 +21,8 @@ echo '{
       "name": "imgui",
       "features": ["sdl3-binding", "opengl3-binding"]
     },
-    "glm"
+    "glm",
+    "stb"
   ]
 }' > vcpkg.json
 
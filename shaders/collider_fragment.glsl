@@ -0,0 +1,16 @@
+#version 450 core
+
+in vec3 worldPos;
+out vec4 fragmentColor;
+
+void main()
+{
+    //flat shading, the collider meshes don't have normals
+    vec3 normal = normalize(cross(dFdx(worldPos), dFdy(worldPos)));
+    vec3 lightDir = normalize(vec3(0.5, 1.0, 0.3));
+    float diffuse = abs(dot(normal, lightDir));
+
+    vec3 color = vec3(0.55, 0.5, 0.45) * diffuse + vec3(0.2, 0.2, 0.2);
+
+    fragmentColor = vec4(color, 1.0);
+}
@@ -0,0 +1,15 @@
+#version 450 core
+
+layout(location = 0) in vec3 aPos;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+out vec3 worldPos;
+
+void main()
+{
+    //collider meshes are already transformed to world space when they are added
+    worldPos = aPos;
+    gl_Position = projection * view * vec4(aPos, 1.0);
+}
@@ -2,56 +2,265 @@
 
 layout (local_size_x = 16, local_size_y = 16, local_size_z = 1) in;
 
-layout(std430, binding = 0) buffer ModelMatrixBuffer {
-    mat4 modelMatrices[];
+// xyz = position, w = fade out: 1 alive at full size, between 0 and 1 fading, 0 dead (spawn rate emitters only).
+// The model matrix is only built in the vertex shaders
+layout(std430, binding = 0) buffer PositionBuffer {
+    vec4 positions[];
 };
-// layout(std430, binding = 1) buffer InitialPositionsBuffer {
-//     vec4 initialPositions[];
-// };
-layout(std430, binding = 2) buffer rotationsBuffer {
-    vec4 rotations[];
+// positions before this step, the vertex shaders blend between both
+layout(std430, binding = 1) buffer PreviousPositionBuffer {
+    vec4 previousPositions[];
 };
+// xy = orientation quaternion (x, y, z, w) packed as 4 x snorm16
+// zw = angular velocity in world space (rad/s) packed as 3 x half float, the upper 16 bits of w are the leaf variant
+layout(std430, binding = 2) buffer OrientationBuffer {
+    uvec4 orientations[];
+};
+// xyz = velocity, w = age in seconds, only counted for emitters with a lifetime
 layout(std430, binding = 3) buffer velocityBuffer {
     vec4 velocities[];
 };
+// triangles of the spawn mesh, see spawnOnMesh in spawn.glsl
+layout(std430, binding = 4) buffer SpawnTriangleBuffer {
+    vec4 spawnTriangles[];
+};
+// one block per emitter, every emitter owns a range of the particles. Same layout as Emitter::EmitterBlock
+struct EmitterBlock {
+    vec4 area;   // xyz = origin of the emit area, w = emit radius
+    vec4 spawn;  // x = emit height, yzw unused
+    uvec4 range; // x = first particle, y = particle count, z = active particles, w = one of the SPAWN_* shapes
+    vec4 life;   // x = lifetime in seconds (0 = until it lands), y = fade out duration, zw unused
+    uvec4 spawning; // x = new particles this step, y = first spawn invocation of the emitter, z = 1 with a spawn rate
+};
+layout(std430, binding = 5) readonly buffer EmitterBlockBuffer {
+    EmitterBlock emitters[];
+};
+// the alive particles of every emitter in no particular order, written from the start of its range. The draw calls read
+// them as instanced particle index, dead and inactive particles cost nothing there
+layout(std430, binding = 6) buffer DrawListBuffer {
+    uint drawList[];
+};
+// particles in drawList per emitter, cleared before every step
+layout(std430, binding = 7) buffer AliveCountBuffer {
+    uint aliveCounts[];
+};
+// New particles of the spawn rate emitters reuse the dead ones (w = 0), so the buffers never hold more than the peak
+// population. The k-th spawn of an emitter always gets its k-th dead particle by index, no matter in which order the
+// invocations run, so a run with a spawn rate is as reproducible as one without. The rank of a dead particle comes from
+// the dead particles of all work groups before its own, counted and then summed up by the two passes before the spawn
+layout(std430, binding = 8) buffer DeadBlockBuffer {
+    uint deadBlocks[]; // dead particles per work group of 256, then the dead particles before that work group
+};
+// dead particles per emitter, cleared before the counting pass. Atomic sums don't depend on the order
+layout(std430, binding = 9) buffer DeadCountBuffer {
+    uint deadCounts[];
+};
+
+const uint PASS_STEP = 0u;       // advances every active particle by one fixed step
+const uint PASS_SPAWN = 1u;      // hands out the dead particles to the new spawns of this step by their rank
+const uint PASS_REBUILD = 2u;    // fills the draw list from the particle state, after it was replaced
+const uint PASS_COUNT_DEAD = 3u; // dead particles of every work group and every emitter
+const uint PASS_SCAN_DEAD = 4u;  // a single work group turns the counts of the work groups into the ones before them
+uniform uint pass;
+uniform uint blockCount; // work groups of the step, for the scan pass
 
-uniform float time;
-uniform float emitHeight;
-uniform float emitRadius;
-uniform float scale;
+uniform float fixedDT; // seconds per physics step, 1 / physics rate
+uniform uint seed;
+uniform uint emitterCount;
+uniform uint stepIndex; // number of fixed steps since the particles were initialized, keys the random numbers
+uniform uint spawnTriangleCount;
+uniform float spawnMeshOffset; // distance from the mesh surface, keeps new leaves out of the collider
 uniform float gravity;
 uniform vec3 windForce;
 uniform vec3 blackHolePositions[2];
 uniform float blackHoleMass;
+uniform bool tumbling;
+uniform bool spiralingMotion;
+uniform uint leafVariants; // layers of the leaf texture array, every respawn picks one
+// signed distance field of the static scene colliders, negative inside
+uniform bool collidersEnabled;
+uniform sampler3D sdfTexture;
+uniform vec3 sdfBoundsMin;
+uniform vec3 sdfBoundsMax;
+uniform vec3 sdfTexelSize;
+uniform float collisionRadius;
+
+vec4 quatMul(vec4 a, vec4 b);
+vec3 quatRotate(vec4 q, vec3 v);
+void collideWithScene(inout vec3 position, inout vec3 velocity, inout vec3 angularVelocity);
+
+#include "random.glsl"
+#include "spawn.glsl"
+
+vec3 spawnIn(EmitterBlock emitter, vec3 r) {
+    uint shape = emitter.range.w;
+    if(shape == SPAWN_MESH) {
+        // the mesh is in world space already
+        return spawnOnMesh(r, spawnTriangleCount, spawnMeshOffset);
+    }
+    return emitter.area.xyz + spawnPosition(shape, r, emitter.area.w, emitter.spawn.x);
+}
+
+uint pickVariant(float r) {
+    return min(uint(r * float(leafVariants)), max(leafVariants, 1u) - 1u);
+}
+
+// 1 until the last fade out duration of the lifetime, then down to 0
+float fadeOut(EmitterBlock emitter, float age) {
+    if(emitter.life.x <= 0.0) {
+        return 1.0;
+    }
+    return clamp((emitter.life.x - age) / emitter.life.y, 0.0, 1.0);
+}
+
+void appendAlive(uint emitterIndex, EmitterBlock emitter, uint leafID) {
+    uint slot = atomicAdd(aliveCounts[emitterIndex], 1u);
+    if(slot < emitter.range.y) {
+        drawList[emitter.range.x + slot] = leafID;
+    }
+}
+
+uint emitterOf(uint leafID) {
+    // the ranges are sorted, the last one that starts at or before the particle is its emitter. Same loop for all
+    // invocations, there are only a few emitters
+    uint emitterIndex = 0u;
+    for (uint i = 1u; i < emitterCount; i++) {
+        emitterIndex = leafID >= emitters[i].range.x ? i : emitterIndex;
+    }
+    return emitterIndex;
+}
+
+// an active particle of a spawn rate emitter that waits for the spawn pass
+bool isDead(uint leafID) {
+    EmitterBlock emitter = emitters[emitterOf(leafID)];
+    return leafID - emitter.range.x < emitter.range.z && emitter.spawning.z != 0u && positions[leafID].w <= 0.0;
+}
 
-mat3 eulerToMat3(vec3 euler);
-vec3 applyForce(vec3 force, float mass);
+shared uint scanValues[256];
 
-float random (vec2 st) {
-    return fract(sin(dot(st.xy, vec2(2.9898,20.233)))* 557578.5453123);
+// Sum of the values of all invocations of the work group before this one. Every invocation has to call it
+uint workGroupExclusiveScan(uint value) {
+    uint local = gl_LocalInvocationIndex;
+    scanValues[local] = value;
+    barrier();
+    for (uint offset = 1u; offset < 256u; offset <<= 1) {
+        uint before = local >= offset ? scanValues[local - offset] : 0u;
+        barrier();
+        scanValues[local] += before;
+        barrier();
+    }
+    return scanValues[local] - value;
+}
+
+void countDead(uint leafID) {
+    bool dead = isDead(leafID);
+    if(dead) {
+        atomicAdd(deadCounts[emitterOf(leafID)], 1u);
+    }
+    uint before = workGroupExclusiveScan(dead ? 1u : 0u);
+    if(gl_LocalInvocationIndex == 255u) {
+        deadBlocks[gl_WorkGroupID.x] = before + (dead ? 1u : 0u);
+    }
+}
+
+// every invocation sums up a run of work groups, the runs are scanned together and then written back
+void scanDeadBlocks() {
+    uint perInvocation = (blockCount + 255u) / 256u;
+    uint begin = min(gl_LocalInvocationIndex * perInvocation, blockCount);
+    uint end = min(begin + perInvocation, blockCount);
+    uint sum = 0u;
+    for (uint block = begin; block < end; block++) {
+        sum += deadBlocks[block];
+    }
+    uint before = workGroupExclusiveScan(sum);
+    for (uint block = begin; block < end; block++) {
+        uint count = deadBlocks[block];
+        deadBlocks[block] = before;
+        before += count;
+    }
+}
+
+// The k-th dead particle of an emitter makes its k-th new particle of this step. The spawns are numbered emitter after
+// emitter like the particle ranges, the number keys the random numbers
+void spawnDead(uint leafID) {
+    bool dead = isDead(leafID);
+    uint rank = deadBlocks[gl_WorkGroupID.x] + workGroupExclusiveScan(dead ? 1u : 0u);
+    if(!dead) {
+        return;
+    }
+    uint emitterIndex = emitterOf(leafID);
+    EmitterBlock emitter = emitters[emitterIndex];
+    for (uint i = 0u; i < emitterIndex; i++) {
+        rank -= deadCounts[i];
+    }
+    // more spawns than dead particles means the emitter is at its particle count, the rest of the spawns is dropped
+    if(rank >= emitter.spawning.x) {
+        return;
+    }
+
+    uint invocation = emitter.spawning.y + rank;
+    vec4 r = random4(seed, invocation, stepIndex, RNG_STREAM_RECYCLE);
+    vec3 position = spawnIn(emitter, r.xyz);
+    uvec4 packedOrientation = orientations[leafID];
+    positions[leafID] = vec4(position, fadeOut(emitter, 0.0));
+    previousPositions[leafID] = vec4(position, 1.0);
+    velocities[leafID] = vec4(0.0);
+    orientations[leafID] = uvec4(packedOrientation.xy, packHalf2x16(vec2(0.0)), packHalf2x16(vec2(0.0)) | (pickVariant(r.w) << 16));
+    appendAlive(emitterIndex, emitter, leafID);
 }
 
 void main() {
     //Compute a global ID for the current invocation from the workgroup size, workgroup ID and local Invocation IDs
     uint leafID = gl_WorkGroupID.x * gl_WorkGroupSize.x * gl_WorkGroupSize.y
                     + gl_LocalInvocationID.y * 16 + gl_LocalInvocationID.x;
+    // the pass is the same for the whole dispatch, so all invocations reach the barriers of these
+    if(pass == PASS_COUNT_DEAD) {
+        countDead(leafID);
+        return;
+    }
+    if(pass == PASS_SCAN_DEAD) {
+        scanDeadBlocks();
+        return;
+    }
+    if(pass == PASS_SPAWN) {
+        spawnDead(leafID);
+        return;
+    }
 
-    if (leafID >= modelMatrices.length()) {
+    uint emitterIndex = emitterOf(leafID);
+    EmitterBlock emitter = emitters[emitterIndex];
+    // the active particles are the first ones of every range, the frame governor lowers them when frames get too slow.
+    // The rest keeps its state until it is active again
+    if (leafID - emitter.range.x >= emitter.range.z) {
+        return;
+    }
+    bool recycling = emitter.spawning.z != 0u;
+    bool alive = positions[leafID].w > 0.0;
+    if(pass == PASS_REBUILD) {
+        // particles of the other emitters are always drawn, a dead one (w = 0) respawns on its next step
+        if(alive || !recycling) {
+            appendAlive(emitterIndex, emitter, leafID);
+        }
+        return;
+    }
+    if(recycling && !alive) {
         return;
     }
 
-    float fixedDT = 0.016;
     float rotationSpeed = 2.0;
     float mass = 1.0;
     float drag = 0.9;
     vec3 acceleration = vec3(0);
-    vec3 velocity = vec3(velocities[leafID]);
+    vec4 storedVelocity = velocities[leafID];
+    vec3 velocity = vec3(storedVelocity);
     vec3 gravityForce = vec3(0.0, -gravity, 0.0);
 
-    // Get current matrix
-    mat4 model = modelMatrices[leafID];
-    mat4 newModel = mat4(1.0);
-    vec3 position = vec3(model[3]);
+    vec3 position = vec3(positions[leafID]);
+    vec3 previousPosition = position;
+    uvec4 packedOrientation = orientations[leafID];
+    vec4 orientation = normalize(vec4(unpackSnorm2x16(packedOrientation.x), unpackSnorm2x16(packedOrientation.y)));
+    vec3 angularVelocity = vec3(unpackHalf2x16(packedOrientation.z), unpackHalf2x16(packedOrientation.w).x);
+    uint variant = packedOrientation.w >> 16;
 
     vec3 bHVector = blackHolePositions[0] - position;
     float distance = length(bHVector);
@@ -62,53 +271,137 @@ void main() {
     acceleration += gravityForce / mass;
     acceleration += windForce * 5 / mass;
     acceleration += pullForce;
+
+    if(tumbling) {
+        // Thin plate model: the leaf lies in its local xy plane, so the normal is the local z axis.
+        // Pressure drag acts along the normal and is much stronger than skin friction along the blade,
+        // which turns part of the fall into a sideways glide. The aerodynamic moment (center of pressure
+        // ahead of the center of mass) is proportional to sin(2 * angle of attack) and turns the blade
+        // broadside to the flow; together with the angular damping this gives the flutter / tumble regimes.
+        const float normalDrag = 1.2;
+        const float tangentDrag = 0.08;
+        const float pitchTorque = 6.0;
+        const float angularDamping = 1.5;
+
+        vec3 normal = quatRotate(orientation, vec3(0.0, 0.0, 1.0));
+        float speed = length(velocity);
+        float normalSpeed = dot(velocity, normal);
+        vec3 tangentVelocity = velocity - normalSpeed * normal;
+
+        acceleration -= (normalDrag * abs(normalSpeed) * normalSpeed * normal + tangentDrag * speed * tangentVelocity) / mass;
+
+        vec3 torque = pitchTorque * normalSpeed * cross(normal, velocity);
+
+        if(spiralingMotion) {
+            // Circulation around a rotating leaf gives a lift force perpendicular to spin and velocity (Magnus-like),
+            // plus a small per-leaf yaw moment from the asymmetric blade shape, which makes the glide path curve into a helix
+            const float liftCoefficient = 0.35;
+            const float yawTorque = 0.8;
+            float handedness = random4(seed, leafID, 0u, RNG_STREAM_LEAF).x > 0.5 ? 1.0 : -1.0;
+            acceleration += liftCoefficient * cross(angularVelocity, velocity) / mass;
+            torque += vec3(0.0, yawTorque * handedness * min(speed, 4.0), 0.0);
+        }
+
+        angularVelocity += (torque - angularDamping * angularVelocity) * fixedDT;
+    }
+    else {
+        // constant spin around the leaf's local x and z axes
+        angularVelocity = quatRotate(orientation, vec3(rotationSpeed, 0.0, rotationSpeed));
+    }
+
     velocity += acceleration * fixedDT * drag;
     position += velocity * fixedDT;
 
-    if(position.y <= 0.0){
-        float rX = random(vec2(leafID, leafID + gl_LocalInvocationID.x)) * emitRadius * 2 - emitRadius;
-        float rY = random(vec2(leafID + time, time + gl_LocalInvocationID.x)) * emitHeight;
-        float rZ = random(vec2(gl_LocalInvocationID.x + time, gl_LocalInvocationID.y - time)) * emitRadius * 2 - emitRadius;
-        position = vec3(rX, rY, rZ);
+    if(collidersEnabled) {
+        collideWithScene(position, velocity, angularVelocity);
+    }
+
+    // integrate the orientation: dq/dt = 0.5 * (omega, 0) * q
+    // snorm16 steps are ~3e-5, far below the per step increment of a spinning leaf, so the packing does not stall the rotation
+    orientation += 0.5 * fixedDT * quatMul(vec4(angularVelocity, 0.0), orientation);
+    orientation = normalize(orientation);
+
+    // without a lifetime the age stays 0, the particle lives until it lands
+    float age = emitter.life.x > 0.0 ? storedVelocity.w + fixedDT : 0.0;
+    bool expired = emitter.life.x > 0.0 && age >= emitter.life.x;
+    if((position.y <= 0.0 || expired) && recycling) {
+        // dead until the spawn pass hands it out again. Below the ground, so it respawns right away if the emitter
+        // loses its spawn rate
+        positions[leafID] = vec4(position.x, -1.0, position.z, 0.0);
+        velocities[leafID] = vec4(0);
+        return;
+    }
+
+    if(position.y <= 0.0 || expired){
+        vec4 r = random4(seed, leafID, stepIndex, RNG_STREAM_SPAWN);
+        position = spawnIn(emitter, r.xyz);
+        variant = pickVariant(r.w);
+        previousPosition = position; // no blending across the jump back to the emitter
         velocities[leafID] = vec4(0);
+        angularVelocity = vec3(0);
+        age = 0.0;
     }
     else {
-        velocities[leafID] = vec4(velocity, 0.0);
+        velocities[leafID] = vec4(velocity, age);
     }
 
-    //rotate
-    //TODO: Implement this with quaternions
-    mat3 rotationMat = eulerToMat3(vec3(rotations[leafID].x, 0, rotations[leafID].z));
+    positions[leafID] = vec4(position, fadeOut(emitter, age));
+    previousPositions[leafID] = vec4(previousPosition, 1.0);
+    orientations[leafID] = uvec4(packSnorm2x16(orientation.xy), packSnorm2x16(orientation.zw),
+                                 packHalf2x16(angularVelocity.xy), packHalf2x16(vec2(angularVelocity.z, 0.0)) | (variant << 16));
+    appendAlive(emitterIndex, emitter, leafID);
+}
 
-    newModel[0] = vec4(rotationMat[0] * scale * 0.5, 0.0);
-    newModel[1] = vec4(rotationMat[1] * scale * 0.5, 0.0);
-    newModel[2] = vec4(rotationMat[2] * scale * 0.5, 0.0);
-    newModel[3] = vec4(position, 1.0);
+// Hamilton product, quaternions are stored as (x, y, z, w)
+vec4 quatMul(vec4 a, vec4 b) {
+    return vec4(a.w * b.xyz + b.w * a.xyz + cross(a.xyz, b.xyz),
+                a.w * b.w - dot(a.xyz, b.xyz));
+}
 
-    rotations[leafID] = vec4(rotations[leafID].x + fixedDT * rotationSpeed, 0, rotations[leafID].z + fixedDT * rotationSpeed, 0.0);
-    modelMatrices[leafID] = newModel;
+vec3 quatRotate(vec4 q, vec3 v) {
+    vec3 t = 2.0 * cross(q.xyz, v);
+    return v + q.w * t + cross(q.xyz, t);
 }
 
+// Pushes the leaf out of the scene geometry and splits the velocity into a damped bounce along the surface normal
+// and a sliding part with friction. Leaves that come (almost) to rest on an upward facing surface settle there.
+void collideWithScene(inout vec3 position, inout vec3 velocity, inout vec3 angularVelocity) {
+    const float restitution = 0.2;
+    const float friction = 0.4;
+    const float settleSpeed = 0.3;
 
-mat3 eulerToMat3(vec3 euler) {
-    float cx = cos(euler.x);  // cos(pitch)
-    float sx = sin(euler.x);  // sin(pitch)
-    // float cy = cos(euler.y);  // cos(yaw)
-    // float sy = sin(euler.y);  // sin(yaw)
-    float cz = cos(euler.z);  // cos(roll)
-    float sz = sin(euler.z);  // sin(roll)
+    vec3 uvw = (position - sdfBoundsMin) / (sdfBoundsMax - sdfBoundsMin);
+    if(any(lessThan(uvw, vec3(0.0))) || any(greaterThan(uvw, vec3(1.0)))) {
+        return;
+    }
+
+    float distance = textureLod(sdfTexture, uvw, 0.0).r;
+    if(distance >= collisionRadius) {
+        return;
+    }
 
-    mat3 rotX = mat3(1.0, 0.0, 0.0,
-                     0.0, cx, -sx,
-                     0.0, sx, cx);
+    // central differences of the distance field give the surface normal
+    vec3 normal = vec3(
+        textureLod(sdfTexture, uvw + vec3(sdfTexelSize.x, 0.0, 0.0), 0.0).r - textureLod(sdfTexture, uvw - vec3(sdfTexelSize.x, 0.0, 0.0), 0.0).r,
+        textureLod(sdfTexture, uvw + vec3(0.0, sdfTexelSize.y, 0.0), 0.0).r - textureLod(sdfTexture, uvw - vec3(0.0, sdfTexelSize.y, 0.0), 0.0).r,
+        textureLod(sdfTexture, uvw + vec3(0.0, 0.0, sdfTexelSize.z), 0.0).r - textureLod(sdfTexture, uvw - vec3(0.0, 0.0, sdfTexelSize.z), 0.0).r);
+    float gradientLength = length(normal);
+    if(gradientLength < 1e-6) {
+        return;
+    }
+    normal /= gradientLength;
 
-    // mat3 rotY = mat3(cy, 0.0, sy,
-    //                  0.0, 1.0, 0.0,
-    //                  -sy, 0.0, cy);
+    position += normal * (collisionRadius - distance);
 
-    mat3 rotZ = mat3(cz, -sz, 0.0,
-                     sz, cz, 0.0,
-                     0.0, 0.0, 1.0);
+    float normalSpeed = dot(velocity, normal);
+    if(normalSpeed < 0.0) {
+        vec3 tangentVelocity = velocity - normalSpeed * normal;
+        velocity = tangentVelocity * (1.0 - friction) - normalSpeed * restitution * normal;
+        angularVelocity *= 1.0 - friction;
+    }
 
-    return rotZ * rotX;
-}
\ No newline at end of file
+    if(normal.y > 0.5 && length(velocity) < settleSpeed) {
+        velocity = vec3(0.0);
+        angularVelocity = vec3(0.0);
+    }
+}
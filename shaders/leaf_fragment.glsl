@@ -1,13 +1,13 @@
 #version 450 core
 
-in vec2 TexCoord;
+in vec3 TexCoord;
 out vec4 fragmentColor;
 
-uniform sampler2D leafTexture;
+uniform sampler2DArray leafTexture;
 
 void main()
 {
-    // Sample the texture using UVs
+    // Sample the texture using UVs, z is the leaf variant
     vec4 color = texture(leafTexture, TexCoord);
     if(color.a < 0.5) discard;
     fragmentColor = color;
@@ -3,18 +3,59 @@
 layout(location = 0) in vec3 aPos;
 layout(location = 1) in vec2 aTexCoord;
 // layout(location = 2) in mat4 modelMatrix;
-layout(std430, binding = 0) buffer TransformBuffer {
-    mat4 transforms[];
+// index into the particle buffers from the draw list of the compute shader, an instanced attribute so every emitter
+// can be drawn from its own range (baseInstance)
+layout(location = 3) in uint particleIndex;
+layout(std430, binding = 0) buffer PositionBuffer {
+    vec4 positions[];
+};
+layout(std430, binding = 1) buffer PreviousPositionBuffer {
+    vec4 previousPositions[];
+};
+// xy = orientation quaternion packed as 4 x snorm16, zw = angular velocity (only used by the compute shader),
+// the upper 16 bits of w select the layer of the leaf texture array
+layout(std430, binding = 2) buffer OrientationBuffer {
+    uvec4 orientations[];
 };
 
-out vec2 TexCoord;
+out vec3 TexCoord;
 
 uniform mat4 view;
 uniform mat4 projection;
+uniform float scale;
+uniform float interpolation; // 0 = state before the last physics step, 1 = after it
+uniform float fixedDT;
+
+mat3 quatToMat3(vec4 q);
+vec4 quatMul(vec4 a, vec4 b);
 
 void main()
 {
-    TexCoord = aTexCoord;
-    mat4 modelMatrix = transforms[gl_InstanceID];
-    gl_Position = projection * view * modelMatrix * vec4(aPos, 1.0);
-}
\ No newline at end of file
+    uvec4 packedOrientation = orientations[particleIndex];
+    TexCoord = vec3(aTexCoord, float(packedOrientation.w >> 16));
+    vec4 orientation = normalize(vec4(unpackSnorm2x16(packedOrientation.x), unpackSnorm2x16(packedOrientation.y)));
+    // turn the orientation back by the part of the step that hasn't been reached yet, with the stored angular velocity
+    vec3 angularVelocity = vec3(unpackHalf2x16(packedOrientation.z), unpackHalf2x16(packedOrientation.w & 0xFFFFu).x);
+    orientation = normalize(orientation - 0.5 * (1.0 - interpolation) * fixedDT * quatMul(vec4(angularVelocity, 0.0), orientation));
+    vec3 position = mix(previousPositions[particleIndex].xyz, positions[particleIndex].xyz, interpolation);
+    // w shrinks the leaf while it fades out at the end of its lifetime
+    vec3 worldPos = quatToMat3(orientation) * (aPos * (scale * 0.5 * positions[particleIndex].w)) + position;
+    gl_Position = projection * view * vec4(worldPos, 1.0);
+}
+
+// Hamilton product, quaternions are stored as (x, y, z, w)
+vec4 quatMul(vec4 a, vec4 b) {
+    return vec4(a.w * b.xyz + b.w * a.xyz + cross(a.xyz, b.xyz),
+                a.w * b.w - dot(a.xyz, b.xyz));
+}
+
+mat3 quatToMat3(vec4 q) {
+    float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+    // columns
+    return mat3(1.0 - 2.0 * (yy + zz), 2.0 * (xy + wz),       2.0 * (xz - wy),
+                2.0 * (xy - wz),       1.0 - 2.0 * (xx + zz), 2.0 * (yz + wx),
+                2.0 * (xz + wy),       2.0 * (yz - wx),       1.0 - 2.0 * (xx + yy));
+}
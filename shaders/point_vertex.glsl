@@ -1,17 +1,24 @@
 #version 450 core
 
 layout(location = 0) in vec3 aPos;
-layout(std430, binding = 0) buffer TransformBuffer {
-    mat4 transforms[];
+// index into the particle buffers from the draw list of the compute shader, an instanced attribute so every emitter
+// can be drawn from its own range (baseInstance)
+layout(location = 3) in uint particleIndex;
+layout(std430, binding = 0) buffer PositionBuffer {
+    vec4 positions[];
+};
+layout(std430, binding = 1) buffer PreviousPositionBuffer {
+    vec4 previousPositions[];
 };
 
 uniform mat4 view;
 uniform mat4 projection;
 uniform float size;
+uniform float interpolation;
 
 void main()
 {
-    mat4 modelMatrix = transforms[gl_InstanceID];
-    gl_Position = projection * view * modelMatrix * vec4(aPos, 1.0);
-    gl_PointSize = size * 3.0;  // Set point size
-}
\ No newline at end of file
+    vec3 position = mix(previousPositions[particleIndex].xyz, positions[particleIndex].xyz, interpolation);
+    gl_Position = projection * view * vec4(aPos + position, 1.0);
+    gl_PointSize = size * 3.0 * positions[particleIndex].w;  // Set point size, w shrinks it while the particle fades out
+}
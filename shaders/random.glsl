@@ -0,0 +1,41 @@
+#ifndef RANDOM_GLSL
+#define RANDOM_GLSL
+// Counter based random numbers. This file is written in the common subset of GLSL and C++ (with glm types) so that
+// the compute shader (#include "random.glsl") and the CPU code (Random.h) draw exactly the same numbers.
+// Every number is a pure function of (seed, particle id, step, stream), there is no generator state to carry around,
+// which makes runs reproducible and lets any particle draw its numbers independently of all others.
+
+#ifdef __cplusplus
+#define RNG_INLINE inline
+#else
+#define RNG_INLINE
+#endif
+
+// streams separate independent uses of the same (seed, id, step) key
+const uint RNG_STREAM_INIT = 0u;   // initial leaf rotation on the CPU
+const uint RNG_STREAM_SPAWN = 1u;  // respawn position
+const uint RNG_STREAM_LEAF = 2u;   // per leaf constants, e.g. the spiraling direction
+const uint RNG_STREAM_RECYCLE = 3u; // spawns of the spawn rate emitters, keyed by the spawn instead of the particle
+
+// 4D PCG hash (Jarzynski & Olano, "Hash Functions for GPU Rendering", JCGT 2020).
+// One evaluation mixes all four inputs into four independent 32 bit outputs
+RNG_INLINE uvec4 pcg4d(uvec4 v) {
+    v = v * 1664525u + 1013904223u;
+    v.x += v.y * v.w;
+    v.y += v.z * v.x;
+    v.z += v.x * v.y;
+    v.w += v.y * v.z;
+    v ^= v >> 16u;
+    v.x += v.y * v.w;
+    v.y += v.z * v.x;
+    v.z += v.x * v.y;
+    v.w += v.y * v.z;
+    return v;
+}
+
+// four uniformly distributed floats in [0, 1), the top 24 bits map exactly onto the float mantissa
+RNG_INLINE vec4 random4(uint seed, uint particleId, uint stepIndex, uint stream) {
+    return vec4(pcg4d(uvec4(particleId, stepIndex, seed, stream)) >> 8u) * 5.9604645e-08f;
+}
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef SPAWN_GLSL
+#define SPAWN_GLSL
+// Spawn distributions of the emitter shapes. Like random.glsl this is written in the common subset of GLSL and C++,
+// the compute shader and the CPU (Spawn.h) place particles with the same code.
+// Every kernel maps uniform random numbers in [0, 1) straight onto a point of the shape, without branches or rejection
+// loops, so all invocations of a work group run the same instructions and every spawn costs the same.
+
+#ifndef RNG_INLINE
+#ifdef __cplusplus
+#define RNG_INLINE inline
+#else
+#define RNG_INLINE
+#endif
+#endif
+
+// same order as EmitterShape in Helpers.h
+const uint SPAWN_BOX = 0u;    // square column, x and z in [-radius, radius], y in [0, height]
+const uint SPAWN_CIRCLE = 1u; // round column below the circle gizmo
+const uint SPAWN_DISC = 2u;   // flat disc at the emit height, the leaves start as one sheet
+const uint SPAWN_SPHERE = 3u; // ball around (0, height, 0), parts below the ground respawn right away
+const uint SPAWN_MESH = 4u;   // surface of a triangle mesh, area weighted, radius and height are not used
+
+const float SPAWN_TWO_PI = 6.28318531f;
+
+RNG_INLINE vec3 spawnBox(vec3 r, float radius, float height) {
+    return vec3((r.x * 2.0f - 1.0f) * radius, r.y * height, (r.z * 2.0f - 1.0f) * radius);
+}
+
+// the square root of the radius spreads the points evenly over the area instead of bunching them at the center
+RNG_INLINE vec3 spawnCircle(vec3 r, float radius, float height) {
+    float angle = r.x * SPAWN_TWO_PI;
+    float distance = sqrt(r.z) * radius;
+    return vec3(cos(angle) * distance, r.y * height, sin(angle) * distance);
+}
+
+RNG_INLINE vec3 spawnDisc(vec3 r, float radius, float height) {
+    float angle = r.x * SPAWN_TWO_PI;
+    float distance = sqrt(r.z) * radius;
+    return vec3(cos(angle) * distance, height, sin(angle) * distance);
+}
+
+// uniform direction from z and the angle around it, the cube root of the distance gives a uniform volume
+RNG_INLINE vec3 spawnSphere(vec3 r, float radius, float height) {
+    float z = 1.0f - 2.0f * r.x;
+    float angle = r.y * SPAWN_TWO_PI;
+    float ring = sqrt(max(1.0f - z * z, 0.0f));
+    float distance = pow(r.z, 1.0f / 3.0f) * radius;
+    return vec3(ring * cos(angle) * distance, height + z * distance, ring * sin(angle) * distance);
+}
+
+// uniform point on the triangle abc from two random numbers (no folding of the unit square needed)
+RNG_INLINE vec3 spawnOnTriangle(vec3 a, vec3 b, vec3 c, vec2 r) {
+    float s = sqrt(r.x);
+    return a * (1.0f - s) + b * (s * (1.0f - r.y)) + c * (s * r.y);
+}
+
+// the shape is the same for every particle of a dispatch, so this never diverges
+RNG_INLINE vec3 spawnPosition(uint shape, vec3 r, float radius, float height) {
+    if(shape == SPAWN_CIRCLE) return spawnCircle(r, radius, height);
+    if(shape == SPAWN_DISC) return spawnDisc(r, radius, height);
+    if(shape == SPAWN_SPHERE) return spawnSphere(r, radius, height);
+    return spawnBox(r, radius, height);
+}
+
+#ifndef __cplusplus
+// GPU only, the including shader declares spawnTriangles: three vec4 per triangle, a.w is the share of the total area of
+// this triangle and all before it. The triangle is found with a binary search of fixed length, the selects compile
+// to conditional moves. The point is lifted off the surface by offset along the triangle normal
+vec3 spawnOnMesh(vec3 r, uint triangleCount, float offset) {
+    uint low = 0u, high = triangleCount - 1u;
+    for (uint width = triangleCount; width > 1u; width = (width + 1u) / 2u) {
+        uint middle = (low + high) / 2u;
+        bool above = spawnTriangles[middle * 3u].w < r.x;
+        low = above ? middle + 1u : low;
+        high = above ? high : middle;
+    }
+    vec3 a = spawnTriangles[low * 3u].xyz, b = spawnTriangles[low * 3u + 1u].xyz, c = spawnTriangles[low * 3u + 2u].xyz;
+    return spawnOnTriangle(a, b, c, r.yz) + normalize(cross(b - a, c - a)) * offset;
+}
+#endif
+
+#endif
@@ -0,0 +1,39 @@
+#version 450
+
+// Only used by Emitter::benchmarkSpawn: places count particles with one emitter shape, the same way the respawn in
+// compute.glsl does, and writes them to a scratch buffer
+layout (local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
+
+layout(std430, binding = 0) buffer SpawnedBuffer {
+    vec4 spawned[];
+};
+layout(std430, binding = 4) buffer SpawnTriangleBuffer {
+    vec4 spawnTriangles[];
+};
+
+uniform uint seed;
+uniform uint count;
+uniform uint emitterShape;
+uniform uint spawnTriangleCount;
+uniform float spawnMeshOffset;
+uniform float emitRadius;
+uniform float emitHeight;
+
+#include "random.glsl"
+#include "spawn.glsl"
+
+void main() {
+    uint id = gl_GlobalInvocationID.x;
+    if (id >= count) {
+        return;
+    }
+    vec4 r = random4(seed, id, 0u, RNG_STREAM_SPAWN);
+    vec3 position;
+    if(emitterShape == SPAWN_MESH) {
+        position = spawnOnMesh(r.xyz, spawnTriangleCount, spawnMeshOffset);
+    }
+    else {
+        position = spawnPosition(emitterShape, r.xyz, emitRadius, emitHeight);
+    }
+    spawned[id] = vec4(position, 1.0);
+}
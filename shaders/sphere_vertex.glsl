@@ -2,20 +2,27 @@
 
 layout(location = 0) in vec3 aPos;
 layout(location = 1) in vec3 aNormal;
-layout(std430, binding = 0) buffer TransformBuffer {
-    mat4 transforms[];
+// index into the particle buffers from the draw list of the compute shader, an instanced attribute so every emitter
+// can be drawn from its own range (baseInstance)
+layout(location = 3) in uint particleIndex;
+layout(std430, binding = 0) buffer PositionBuffer {
+    vec4 positions[];
+};
+layout(std430, binding = 1) buffer PreviousPositionBuffer {
+    vec4 previousPositions[];
 };
 
 out vec3 normal;
 
 uniform mat4 view;
 uniform mat4 projection;
+uniform float scale;
+uniform float interpolation;
 
 void main()
 {
-
-    mat4 modelMatrix = transforms[gl_InstanceID];
-    normal = normalize(mat3(modelMatrix) * aNormal);
-    //normal = normalize(aNormal);
-    gl_Position = projection * view * modelMatrix * vec4(aPos, 1.0);
-}
\ No newline at end of file
+    //spheres look the same in every orientation, so only the position and scale are needed
+    normal = aNormal;
+    vec3 worldPos = aPos * (scale * 0.5 * positions[particleIndex].w) + mix(previousPositions[particleIndex].xyz, positions[particleIndex].xyz, interpolation);
+    gl_Position = projection * view * vec4(worldPos, 1.0);
+}
@@ -0,0 +1,94 @@
+#include "AsyncReadback.h"
+
+void AsyncReadback::reserve(size_t bytes)
+{
+    if(bytes <= capacity) return;
+    if(stagingBuffer != 0) {
+        glUnmapNamedBuffer(stagingBuffer);
+        glDeleteBuffers(1, &stagingBuffer);
+    }
+    //immutable storage that stays mapped for its whole lifetime, client storage hints the driver to keep it in system memory
+    glCreateBuffers(1, &stagingBuffer);
+    GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glNamedBufferStorage(stagingBuffer, bytes, nullptr, flags | GL_CLIENT_STORAGE_BIT);
+    mapped = glMapNamedBufferRange(stagingBuffer, 0, bytes, flags);
+    capacity = bytes;
+    if(mapped == nullptr) {
+        std::cerr << "AsyncReadback: could not map a staging buffer of " << bytes << " bytes" << std::endl;
+        capacity = 0;
+    }
+}
+
+void AsyncReadback::begin(const std::vector<Range> &ranges)
+{
+    if(fence != nullptr) {
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+    complete = false;
+
+    size_t total = 0;
+    for (const Range& range : ranges) total += range.size;
+    reserve(total);
+    if(capacity < total) {
+        byteCount = 0;
+        return;
+    }
+
+    //the copies have to see the results of earlier compute dispatches
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    size_t offset = 0;
+    for (const Range& range : ranges) {
+        glCopyNamedBufferSubData(range.buffer, stagingBuffer, 0, offset, range.size);
+        offset += range.size;
+    }
+    byteCount = total;
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    //make sure the fence is submitted, otherwise polling it with a zero timeout may never see it signaled
+    glFlush();
+}
+
+bool AsyncReadback::ready()
+{
+    if(complete) return true;
+    if(fence == nullptr) return false;
+    GLenum result = glClientWaitSync(fence, 0, 0);
+    if(result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED) {
+        glDeleteSync(fence);
+        fence = nullptr;
+        complete = true;
+    }
+    return complete;
+}
+
+bool AsyncReadback::wait()
+{
+    if(complete) return true;
+    if(fence == nullptr) return false;
+    //1 second per try, a lost context would otherwise hang here forever
+    for (int i = 0; i < 10 && !complete; i++) {
+        GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        if(result == GL_WAIT_FAILED) break;
+        ready();
+    }
+    return complete;
+}
+
+const void *AsyncReadback::data() const
+{
+    return complete ? mapped : nullptr;
+}
+
+size_t AsyncReadback::size() const
+{
+    return byteCount;
+}
+
+AsyncReadback::~AsyncReadback()
+{
+    if(fence != nullptr) glDeleteSync(fence);
+    if(stagingBuffer != 0) {
+        glUnmapNamedBuffer(stagingBuffer);
+        glDeleteBuffers(1, &stagingBuffer);
+    }
+}
@@ -0,0 +1,137 @@
+#include "BatchMode.h"
+#include "HeadlessContext.h"
+#include "Emitter.h"
+#include "Camera.h"
+#include "SdfCollider.h"
+#include "Snapshot.h"
+#include "TrajectoryRecorder.h"
+#include "FrameCapture.h"
+#include "GoldenState.h"
+#include "glm/gtc/matrix_transform.hpp"
+#include <chrono>
+
+static EmitterParams batchParams(const CommandLineOptions& options) {
+    EmitterParams params {
+        options.windForce,
+        std::vector<glm::vec3>(),
+        options.blackHoleMass,
+        options.blackHoleSpeed,
+        options.blackHoleRadius,
+        0.0f,                    //black hole angle
+        options.size,
+        options.gravity,
+        options.spiralingMotion,
+        options.tumbling,
+        options.leafCount,
+        options.emitRadius,
+        options.emitHeight,
+        options.emitterShape,
+        options.particleShape
+    };
+    params.sceneColliders = options.sceneColliders;
+    params.seed = options.seed;
+    params.spawnRate = options.spawnRate;
+    params.lifetime = options.lifetime;
+    params.rateCurve = options.rateCurve;
+    params.burstCount = options.burstCount;
+    params.burstInterval = options.burstInterval;
+    orbitBlackHoles(params, 0.0f);
+    return params;
+}
+
+int runBatchMode(const CommandLineOptions &options)
+{
+    HeadlessContext context;
+    if(!context.create()) return 1;
+
+    //golden runs need no window either, so the regression checks run on machines without a display
+    if(!options.goldenRecordPath.empty() || !options.goldenCheckPath.empty()) {
+        SdfCollider sceneColliders;
+        sceneColliders.addDefaultScene();
+        return runGoldenMode(options, &sceneColliders);
+    }
+
+    //scoped so all GL objects are gone before the context
+    {
+        EmitterParams params = batchParams(options);
+        Emitter emitter(params);
+        //a snapshot brings its own emitter parameters and replaces the ones of the command line
+        if(!options.snapshotPath.empty() && !loadSnapshot(options.snapshotPath, emitter, params)) return 1;
+
+        //the distance field takes a moment to build, so only when it's actually used
+        SdfCollider sceneColliders;
+        if(params.sceneColliders || params.shape == EmitterShape::meshShape) sceneColliders.addDefaultScene();
+        //the tree crown, the meshes of the command line come after it
+        int crownMesh = sceneColliders.getMeshCount() - 1;
+        if(params.sceneColliders) {
+            for (const std::string& path : options.colliderPaths) {
+                if(!sceneColliders.addObjFile(path, glm::mat4(1.0f))) return 1;
+            }
+            sceneColliders.build(0.2f);
+        }
+        emitter.setColliders(&sceneColliders);
+        if(params.shape == EmitterShape::meshShape) {
+            emitter.setSpawnMesh(sceneColliders.getMeshTriangles(crownMesh));
+        }
+
+        TrajectoryRecorder recorder;
+        if(!options.recordPath.empty()) {
+            if(!recorder.start(options.recordPath, emitter)) return 1;
+            recorder.setLossless(true);
+            emitter.setRecorder(&recorder);
+        }
+
+        bool rendering = !options.outputPath.empty();
+        FrameCapture capture;
+        if(rendering) {
+            bool video = std::filesystem::path(options.outputPath).extension() == ".y4m";
+            if(!capture.start(options.outputPath, video ? CaptureFormat::y4mVideo : CaptureFormat::pngSequence,
+                              options.width, options.height, options.fps)) return 1;
+            glEnable(GL_DEPTH_TEST);
+        }
+        //reports shader errors and fills the program cache for all programs, not only the ones this run uses.
+        //The textures have to be there from the first frame on, otherwise the output would depend on the decoding speed
+        Shader::finishPending();
+        Texture::finishPending();
+        Camera cam;
+        cam.update();
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), static_cast<float>(options.width) / options.height, 0.1f, 250.0f);
+
+        //without rendering every update is exactly one fixed step, otherwise the simulation advances by one frame time per frame
+        float frameTime = rendering ? capture.getFrameTime() : emitter.getFixedDT();
+        unsigned int targetStep = emitter.getStepIndex() + options.steps;
+        int frames = 0;
+        auto start = std::chrono::steady_clock::now();
+        while (emitter.getStepIndex() < targetStep) {
+            //the orbit follows the simulated time, so a run resumed from a snapshot continues exactly where it was saved
+            orbitBlackHoles(params, emitter.getStepIndex() * emitter.getFixedDT() * params.blackHoleSpeed);
+            emitter.update(frameTime, params);
+            if(rendering) {
+                capture.beginFrame();
+                glClearColor(1, 1, 1, 1.0f);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                if(params.sceneColliders) sceneColliders.draw(cam.getViewMatrix(), projection);
+                emitter.draw(cam.getViewMatrix(), projection, params);
+                capture.endFrame();
+                capture.poll();
+            }
+            recorder.poll();
+            frames++;
+        }
+        capture.stop();
+        recorder.stop();
+
+        if(!options.saveSnapshotPath.empty()) {
+            SnapshotWriter snapshotWriter;
+            if(!snapshotWriter.save(emitter, params, options.saveSnapshotPath)) return 1;
+            glFinish();
+            snapshotWriter.poll();
+        }
+
+        glFinish();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Batch run: " << options.steps << " steps of " << emitter.getParticleCount() << " particles in " << frames
+                  << " frames, " << seconds << " s" << std::endl;
+    }
+    return 0;
+}
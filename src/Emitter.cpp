@@ -1,4 +1,9 @@
 #include "Emitter.h"
+#include "TrajectoryRecorder.h"
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+#include <chrono>
 
 
 void Emitter::update(float dT, const EmitterParams& params)
@@ -7,68 +12,267 @@ void Emitter::update(float dT, const EmitterParams& params)
     // --- Fixed timestep physics ---
     physicsAccumulator += dT;
     
-    glUseProgram(computeShader.ID);
-    computeShader.setFloat("emitHeight", params.emitHeight);
-    computeShader.setFloat("scale", params.size);
-    computeShader.setFloat("gravity", params.gravity);
-    computeShader.setVec3f("windForce", params.windForce);
-    computeShader.setFloat("blackHoleMass", params.blackHoleMass);
-    computeShader.setFloat("emitRadius", params.emitRadius);
-    computeShader.setFloat("time", dT * 1000.0f);
-    glUniform3fv(glGetUniformLocation(computeShader.ID, "blackHolePositions"), 2, glm::value_ptr(params.blackHolePositions[0]));
+    setComputeUniforms(params, dT);
 
     while (physicsAccumulator >= fixedDT)
     {
         fixedUpdatePhysics(fixedDT);
         physicsAccumulator -= fixedDT;
+        if(recorder != nullptr) recorder->onStep(*this);
     }
 }
 
+void Emitter::setComputeUniforms(const EmitterParams &params, float dT)
+{
+    fixedDT = 1.0f / std::max(params.physicsRate, 1.0f);
+    activeFraction = glm::clamp(params.activeFraction, 0.0f, 1.0f);
+    glUseProgram(computeShader.ID);
+    computeShader.setFloat("fixedDT", fixedDT);
+    computeShader.setFloat("gravity", params.gravity);
+    computeShader.setVec3f("windForce", params.windForce);
+    computeShader.setFloat("blackHoleMass", params.blackHoleMass);
+    //turning the spawn rate of an emitter on or off changes which particles are dead
+    if(uploadEmitterBlocks(allEmitters(params))) rebuildParticleLists();
+    computeShader.setUInt("spawnTriangleCount", spawnTriangleCount);
+    computeShader.setFloat("spawnMeshOffset", params.size * 0.15f * 1.5f);
+    computeShader.setUInt("seed", params.seed);
+    computeShader.setBool("tumbling", params.tumbling);
+    computeShader.setBool("spiralingMotion", params.spiralingMotion);
+    computeShader.setUInt("leafVariants", leafTexture.getLayerCount());
+
+    bool collidersEnabled = params.sceneColliders && colliders != nullptr && colliders->isBuilt();
+    computeShader.setBool("collidersEnabled", collidersEnabled);
+    if(collidersEnabled) {
+        computeShader.setInt("sdfTexture", sdfTextureUnit);
+        computeShader.setVec3f("sdfBoundsMin", colliders->getBoundsMin());
+        computeShader.setVec3f("sdfBoundsMax", colliders->getBoundsMax());
+        computeShader.setVec3f("sdfTexelSize", colliders->getTexelSize());
+        computeShader.setFloat("collisionRadius", params.size * 0.15f);
+    }
+    glUniform3fv(glGetUniformLocation(computeShader.ID, "blackHolePositions"), 2, glm::value_ptr(params.blackHolePositions[0]));
+}
+
+//same values as PASS_* in compute.glsl
+const unsigned int passStep = 0, passSpawn = 1, passRebuild = 2, passCountDead = 3, passScanDead = 4;
+
 void Emitter::fixedUpdatePhysics(float fixedDT)
 {
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, transformationsSSBO);
-    // glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, positionsSSBO);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, rotationsSSBO);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, velocitySSBO);
+    bindComputeBuffers();
+    if(colliders != nullptr && colliders->isBuilt()) {
+        glActiveTexture(GL_TEXTURE0 + sdfTextureUnit);
+        glBindTexture(GL_TEXTURE_3D, colliders->getTexture());
+    }
     // the work group size is 16 x 16, so we have to divide the number of workgroups by 256 to not dispatch too many instances
     int workGroupSize = 16 * 16;
-    //numInstances divided by workGroupSize, rounded up so we don't process too few particles, but has to be at least one
-    int numWorkGroups = std::max(numInstances + (workGroupSize - 1) / workGroupSize, 1); 
+    //up to the last active particle divided by workGroupSize, rounded up so we don't process too few particles, but has to be at least one.
+    //Inactive particles in between return right away
+    int dispatchEnd = 0;
+    for (size_t i = 0; i < emitterRanges.size(); i++) dispatchEnd = std::max(dispatchEnd, emitterRanges[i].first + getActiveCount(i));
+    int numWorkGroups = std::max((dispatchEnd + workGroupSize - 1) / workGroupSize, 1); 
+    unsigned int spawns = scheduleSpawns(fixedDT);
+    //every step writes the draw list from scratch
+    glClearNamedBufferData(aliveCountsSSBO, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    computeShader.setUInt("stepIndex", stepIndex++);
+    computeShader.setUInt("pass", passStep);
     glDispatchCompute(numWorkGroups, 1, 1);
-    // Wait for compute to finish
-    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    if(spawns > 0) {
+        //the particles that died in this step can be handed out right away. They are ranked by index instead of
+        //taken from an atomic stack, so every spawn gets the same particle in every run
+        glClearNamedBufferData(deadCountsSSBO, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        computeShader.setUInt("pass", passCountDead);
+        glDispatchCompute(numWorkGroups, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        computeShader.setUInt("pass", passScanDead);
+        computeShader.setUInt("blockCount", static_cast<unsigned int>(numWorkGroups));
+        glDispatchCompute(1, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        computeShader.setUInt("pass", passSpawn);
+        glDispatchCompute(numWorkGroups, 1, 1);
+    }
+    // Wait for compute to finish, the draw calls read the draw list as vertex attribute and copy the alive counts
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+}
 
+void Emitter::bindComputeBuffers()
+{
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, positionsSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, previousPositionsSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, orientationsSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, velocitySSBO);
+    if(spawnTriangleCount > 0) glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, spawnTrianglesSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, emitterBlocksSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, drawListSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, aliveCountsSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, deadBlocksSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, deadCountsSSBO);
+}
+
+bool Emitter::uploadEmitterBlocks(const std::vector<EmitterSource> &sources)
+{
+    //a range the sources don't have (anymore) spawns like the main emitter until the next resize
+    std::vector<EmitterBlock> blocks(emitterRanges.size());
+    spawnSources.resize(emitterRanges.size());
+    spawnCarry.resize(emitterRanges.size(), 0.0f);
+    for (size_t i = 0; i < emitterRanges.size(); i++) {
+        const EmitterSource& source = i < sources.size() ? sources[i] : sources[0];
+        //without a spawn mesh the mesh shape falls back to the box
+        EmitterShape shape = source.shape == EmitterShape::meshShape && spawnTriangleCount == 0 ? EmitterShape::boxShape : source.shape;
+        float lifetime = std::max(source.lifetime, 0.0f);
+        bool recycling = spawnsOverTime(source);
+        spawnSources[i] = source;
+        blocks[i].area = glm::vec4(source.origin, source.emitRadius);
+        blocks[i].spawn = glm::vec4(source.emitHeight, 0.0f, 0.0f, 0.0f);
+        //the particle shrinks away over the last 30% of its lifetime, at most one second
+        blocks[i].life = glm::vec4(lifetime, std::max(std::min(0.3f * lifetime, 1.0f), 1e-3f), 0.0f, 0.0f);
+        blocks[i].spawning = glm::uvec4(0, 0, recycling ? 1 : 0, 0);
+        blocks[i].range = glm::uvec4(emitterRanges[i].first, emitterRanges[i].count, 0, static_cast<unsigned int>(shape));
+    }
+    bool listsChanged = blocks.size() != emitterBlocks.size();
+    for (size_t i = 0; !listsChanged && i < blocks.size(); i++) {
+        listsChanged = blocks[i].range.x != emitterBlocks[i].range.x || blocks[i].range.y != emitterBlocks[i].range.y
+                       || blocks[i].spawning.z != emitterBlocks[i].spawning.z;
+    }
+    emitterBlocks = std::move(blocks);
+    for (size_t i = 0; i < emitterBlocks.size(); i++) emitterBlocks[i].range.z = getActiveCount(i);
+    //the buffer has room for maxEmitters blocks, nothing is reallocated while the simulation runs
+    glNamedBufferSubData(emitterBlocksSSBO, 0, emitterBlocks.size() * sizeof(EmitterBlock), emitterBlocks.data());
+    glUseProgram(computeShader.ID);
+    computeShader.setUInt("emitterCount", static_cast<unsigned int>(emitterBlocks.size()));
+    return listsChanged;
+}
+
+//multiples of the interval in [from, to), with a zero interval only the one at 0
+static int burstsBetween(float interval, float from, float to)
+{
+    if(interval <= 0.0f) return from <= 0.0f && to > 0.0f ? 1 : 0;
+    return static_cast<int>(std::ceil(to / interval) - std::ceil(from / interval));
+}
+
+unsigned int Emitter::scheduleSpawns(float dT)
+{
+    unsigned int total = 0;
+    bool recycling = false;
+    for (size_t i = 0; i < emitterBlocks.size(); i++) {
+        EmitterBlock& block = emitterBlocks[i];
+        unsigned int spawns = 0;
+        if(block.spawning.z != 0) {
+            //the fractions carry over to the next steps, so low rates and high physics rates still spawn. The frame
+            //governor thins out the spawns of these emitters instead of freezing particles
+            const EmitterSource& source = spawnSources[i];
+            float bursts = static_cast<float>(burstsBetween(source.burstInterval, spawnClock, spawnClock + dT) * std::max(source.burstCount, 0));
+            spawnCarry[i] += (spawnRateAt(source, spawnClock + 0.5f * dT) * dT + bursts) * activeFraction;
+            float whole = std::floor(spawnCarry[i]);
+            spawnCarry[i] -= whole;
+            spawns = static_cast<unsigned int>(std::min(whole, static_cast<float>(block.range.y)));
+            recycling = true;
+        }
+        block.spawning.x = spawns;
+        block.spawning.y = total;
+        total += spawns;
+    }
+    spawnClock += dT;
+    if(recycling) glNamedBufferSubData(emitterBlocksSSBO, 0, emitterBlocks.size() * sizeof(EmitterBlock), emitterBlocks.data());
+    return total;
+}
+
+void Emitter::rebuildParticleLists()
+{
+    glClearNamedBufferData(aliveCountsSSBO, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glUseProgram(computeShader.ID);
+    bindComputeBuffers();
+    int dispatchEnd = 0;
+    for (size_t i = 0; i < emitterRanges.size(); i++) dispatchEnd = std::max(dispatchEnd, emitterRanges[i].first + getActiveCount(i));
+    computeShader.setUInt("pass", passRebuild);
+    glDispatchCompute(std::max((dispatchEnd + 255) / 256, 1), 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
 }
 
 void Emitter::draw(const glm::mat4 &view, const glm::mat4 &projection, const EmitterParams& params)
 {
+    draw(view, projection, params, getParticleBuffers(), emitterRanges, physicsAccumulator / fixedDT, fixedDT);
+}
+
+//glMultiDraw*Indirect command layouts
+struct DrawElementsCommand {
+    unsigned int count, instanceCount, firstIndex;
+    int baseVertex;
+    unsigned int baseInstance;
+};
+struct DrawArraysCommand {
+    unsigned int count, instanceCount, first, baseInstance;
+};
+
+void Emitter::draw(const glm::mat4 &view, const glm::mat4 &projection, const EmitterParams &params, const ParticleBuffers& buffers,
+                   const std::vector<ParticleRange>& ranges, float interpolation, float fixedDT)
+{
+    interpolation = glm::clamp(interpolation, 0.0f, 1.0f);
     getErrorCode();
+    unsigned int positions = buffers.positions, previousPositions = buffers.previousPositions, orientations = buffers.orientations;
+    //one draw command per emitter, all of them go to the GPU with a single call
+    bool points = params.particleShape == ParticleShape::pointShape;
+    unsigned int vertexCount = 1;
+    if(params.particleShape == ParticleShape::leafShape) vertexCount = sizeof(leafIndices) / sizeof(leafIndices[0]);
+    else if(params.particleShape == ParticleShape::sphereShape) vertexCount = static_cast<unsigned int>(sphereIndices->size());
+    std::vector<DrawElementsCommand> elementCommands;
+    std::vector<DrawArraysCommand> arrayCommands;
+    std::vector<unsigned int> commandEmitters;
+    for (size_t i = 0; i < ranges.size(); i++) {
+        if(ranges[i].count <= 0) continue;
+        //the instance count is the alive count of the last step, it never leaves the GPU
+        unsigned int first = static_cast<unsigned int>(ranges[i].first);
+        if(points) arrayCommands.push_back({vertexCount, 0, 0, first});
+        else elementCommands.push_back({vertexCount, 0, 0, 0, first});
+        commandEmitters.push_back(static_cast<unsigned int>(i));
+    }
+    int commandCount = static_cast<int>(commandEmitters.size());
+    if(commandCount == 0) return;
+    size_t commandSize = points ? sizeof(DrawArraysCommand) : sizeof(DrawElementsCommand);
+    if(points) glNamedBufferSubData(drawCommandsBuffer, 0, commandCount * commandSize, arrayCommands.data());
+    else glNamedBufferSubData(drawCommandsBuffer, 0, commandCount * commandSize, elementCommands.data());
+    for (int c = 0; c < commandCount; c++) {
+        glCopyNamedBufferSubData(buffers.aliveCounts, drawCommandsBuffer, commandEmitters[c] * sizeof(unsigned int),
+                                 c * commandSize + sizeof(unsigned int), sizeof(unsigned int));
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, drawCommandsBuffer);
+    //the particle index of every instance comes from the draw list
+    unsigned int vao = points ? pointVAO : params.particleShape == ParticleShape::sphereShape ? sphereVAO : leafVAO;
+    glVertexArrayVertexBuffer(vao, 3, buffers.drawList, 0, sizeof(unsigned int));
+
     if(params.particleShape == ParticleShape::leafShape){
 
         glUseProgram(leafShader.ID);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, transformationsSSBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, positions);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, previousPositions);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, orientations);
 
         leafShader.useTexture(leafTexture, "leafTexture");
 
         getErrorCode();
         leafShader.setMatrix4("view", view);
         leafShader.setMatrix4("projection", projection);
+        leafShader.setFloat("scale", params.size);
+        leafShader.setFloat("interpolation", interpolation);
+        leafShader.setFloat("fixedDT", fixedDT);
 
         glBindVertexArray(leafVAO);
 
-        int indexCount = sizeof(leafIndices) / sizeof(leafIndices[0]);
-        glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0, numInstances);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, commandCount, 0);
     }
     else if(params.particleShape == ParticleShape::sphereShape){
         glUseProgram(sphereShader.ID);
         getErrorCode();
         sphereShader.setMatrix4("view", view);
         sphereShader.setMatrix4("projection", projection);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, transformationsSSBO);
+        sphereShader.setFloat("scale", params.size);
+        sphereShader.setFloat("interpolation", interpolation);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, positions);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, previousPositions);
 
         glBindVertexArray(sphereVAO);
 
-        glDrawElementsInstanced(GL_TRIANGLES, sphereIndices->size(), GL_UNSIGNED_INT, 0, numInstances);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, commandCount, 0);
         getErrorCode();
     }
     else if(params.particleShape == ParticleShape::pointShape) {
@@ -78,14 +282,18 @@ void Emitter::draw(const glm::mat4 &view, const glm::mat4 &projection, const Emi
         pointShader.setMatrix4("view", view);
         pointShader.setMatrix4("projection", projection);
         pointShader.setFloat("size", params.size);
+        pointShader.setFloat("interpolation", interpolation);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, positions);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, previousPositions);
 
         glBindVertexArray(pointVAO);
 
-        glDrawArraysInstanced(GL_POINTS, 0, 1, numInstances);
+        glMultiDrawArraysIndirect(GL_POINTS, nullptr, commandCount, 0);
         getErrorCode();
         glDisable(GL_PROGRAM_POINT_SIZE);
 
     }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
     
     getErrorCode();
 
@@ -94,107 +302,537 @@ void Emitter::draw(const glm::mat4 &view, const glm::mat4 &projection, const Emi
 
 void Emitter::resizeParticleCount(const EmitterParams &params)
 {
-    if(numInstances == params.leafCount) return; //Nothing to do
-    //the incoming particle count is less than the current, so we just need to resize the buffers and not create any new leaves
-    else if(numInstances > params.leafCount) {
-        numInstances = params.leafCount;
-        leaves.resize(numInstances);
-        //TODO: Do we even need to resize the SSBOs?
-        uploadInitialTransforms();
+    std::vector<ParticleRange> layout = layoutOf(params);
+    int particleCount = layout.back().first + layout.back().count;
+    bool sameLayout = layout.size() == emitterRanges.size() && std::equal(layout.begin(), layout.end(), emitterRanges.begin(),
+        [](const ParticleRange& a, const ParticleRange& b) { return a.first == b.first && a.count == b.count; });
+    emitterRanges = layout;
+    bool listsChanged = uploadEmitterBlocks(allEmitters(params));
+    if(numInstances == particleCount) {
+        //Nothing to do, a particle that now belongs to another emitter respawns there when it lands. Only the lists
+        //have to follow the new ranges
+        if(listsChanged) rebuildParticleLists();
+        if(!sameLayout) std::cout << "Emitter ranges changed, " << emitterRanges.size() << " emitters" << std::endl;
+        return;
     }
-    //The incoming particle count is bigger than the current, so we need to create new leaves
-    else if(numInstances < params.leafCount){
-        std::cout << "numInstances: " << numInstances << " " << " leafCount: " << params.leafCount << std::endl;
-
-        std::random_device rd;
-        std::mt19937 gen(rd());
-
-        std::uniform_real_distribution<float> rotDist(0.0f, 360.0f);
-
-        leaves.reserve(params.leafCount);
+    //The particles that stay keep flying, only the buffers change size when they run out of room (or have far too much)
+    int oldCount = numInstances;
+    reserveParticles(particleCount);
+    //the incoming particle count is less than the current, so we just drop the last particles
+    if(numInstances > particleCount) {
+        numInstances = particleCount;
+        if(static_cast<int>(leaves.size()) > numInstances) leaves.resize(numInstances);
+        //the stored initial state is indexed by particle, so the first ones stay valid
+        if(initialCount > numInstances) initialCount = numInstances;
+    }
+    //The incoming particle count is bigger than the current, so we need to create new particles
+    else if(numInstances < particleCount){
+        numInstances = particleCount;
+        //a stored initial state from another particle count is rebuilt as a whole. The new leaves get the same seed as
+        //the particles already there, another seed needs a restart anyway
+        int first = initialCount == oldCount ? oldCount : 0;
         Profiler::Start();
-        for (int i = numInstances; i < params.leafCount; i++)
-        {
-            leaves.emplace_back(createLeaf(params, gen, rotDist));
-        }
+        uploadInitialOrientations(first, numInstances - first);
         Profiler::Stop(1);
-        numInstances = params.leafCount;
-        uploadInitialTransforms();
+        initialCount = numInstances;
+        initializeParticles(oldCount, numInstances - oldCount);
     }
+    rebuildParticleLists();
     
-    std::cout << "Emitter buffers resized to size " << numInstances << std::endl;
+    std::cout << "Emitter resized to " << numInstances << " particles, buffers have room for " << particleCapacity << std::endl;
 }
 
 void Emitter::changeEmitArea(const EmitterParams &params)
 {
-    //TODO: Do we really need to recreate every single leaf?
-    std::random_device rd;
-    std::mt19937 gen(rd());
+    //a restart always uses the emitters of the params
+    emitterRanges = layoutOf(params);
+    numInstances = emitterRanges.back().first + emitterRanges.back().count;
+    uploadEmitterBlocks(allEmitters(params));
+    //the leaves only have to be recreated for another seed or count, otherwise the GPU resets from the stored initial state
+    if(initialCount != numInstances || params.seed != initialSeed) {
+        if(params.seed != initialSeed) leaves.clear();
+        initialSeed = params.seed;
+        uploadInitialTransforms();
+    }
+    else {
+        resetParticles();
+    }
+    //restart the random number sequence, so the run from here on only depends on the seed and the parameters
+    stepIndex = 0;
 
-    std::uniform_real_distribution<float> rotDist(0.0f, 360.0f);
-    
-    for (int i = 0; i < numInstances; i++)
+    std::cout << "Emit Area changed!" << std::endl;
+}
+
+//Runs the fixed physics step with the different motion models on the live buffers and prints the average GPU time per step,
+//and how much the tumbling models cost over the constant spin compared to the target.
+//The particles are respawned afterwards, because the benchmark advances the simulation by a few hundred steps.
+void Emitter::benchmarkPhysics(const EmitterParams &params, int steps)
+{
+    struct BenchmarkMode {
+        const char* name;
+        bool tumbling;
+        bool spiralingMotion;
+    };
+    const BenchmarkMode modes[] = {
+        {"constant spin", false, false},
+        {"tumbling", true, false},
+        {"tumbling + spiraling", true, true}
+    };
+    const int warmupSteps = 20;
+    //what the richer motion models may cost on top of the constant spin, in percent
+    const double overheadTarget = 30.0;
+
+    unsigned int query;
+    glGenQueries(1, &query);
+
+    double baseline = 0.0;
+    for (const BenchmarkMode& mode : modes)
     {
-        leaves[i] = std::move(createLeaf(params, gen, rotDist));
+        EmitterParams benchParams = params;
+        benchParams.tumbling = mode.tumbling;
+        benchParams.spiralingMotion = mode.spiralingMotion;
+        setComputeUniforms(benchParams, fixedDT);
+
+        for (int i = 0; i < warmupSteps; i++) fixedUpdatePhysics(fixedDT);
+
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        for (int i = 0; i < steps; i++) fixedUpdatePhysics(fixedDT);
+        glEndQuery(GL_TIME_ELAPSED);
+
+        // blocks until the GPU is done with all the steps
+        GLuint64 elapsedNs = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsedNs);
+        double usPerStep = elapsedNs / 1000.0 / steps;
+        std::cout << "Physics benchmark (" << numInstances << " particles) | " << mode.name << ": " << usPerStep << "us per step";
+        if(&mode == &modes[0]) {
+            baseline = usPerStep;
+            std::cout << " | baseline" << std::endl;
+            continue;
+        }
+        if(baseline <= 0.0) {
+            std::cout << " | no baseline time to compare with" << std::endl;
+            continue;
+        }
+        double overhead = (usPerStep / baseline - 1.0) * 100.0;
+        std::cout << " | overhead: " << overhead << "%" << (overhead > overheadTarget ? ", OVER" : ", within")
+                  << " the " << overheadTarget << "% target" << std::endl;
     }
-    uploadInitialTransforms();
 
-    std::cout << "Emit Area changed!" << std::endl;
+    glDeleteQueries(1, &query);
+    changeEmitArea(params);
 }
 
-void Emitter::uploadInitialTransforms() {
-        std::vector<glm::mat4> initialTransforms(numInstances);
-        //Might be able to remove this later if the particles can respawn randomly in the compute shader
-        std::vector<glm::vec4> rotations(numInstances);
-        //velocity is 0 at the beginning for all particles
-        std::vector<glm::vec4> velocities(numInstances, glm::vec4(0));
-        for (int i = 0; i < numInstances; i++) {
-            initialTransforms[i] = leaves[i].getLeafModel();
-            //Need to make these vec4 because of memory alignment reasons in the compute shader - might be able to fix later?
-            rotations[i] = glm::vec4(leaves[i].getRotation(), 1.0f);
+void Emitter::benchmarkSpawn(const EmitterParams &params, int count)
+{
+    struct BenchmarkShape {
+        const char* name;
+        EmitterShape shape;
+    };
+    const BenchmarkShape shapes[] = {
+        {"box", EmitterShape::boxShape},
+        {"circle", EmitterShape::circleShape},
+        {"disc", EmitterShape::discShape},
+        {"sphere", EmitterShape::sphereShape},
+        {"mesh", EmitterShape::meshShape}
+    };
+    const int repetitions = 10;
+    float meshOffset = params.size * 0.15f * 1.5f;
+
+    if(spawnBenchmarkShader.ID == 0) spawnBenchmarkShader.createComputeProgram("./../shaders/spawn_benchmark.glsl");
+    unsigned int scratch, query;
+    glCreateBuffers(1, &scratch);
+    glNamedBufferData(scratch, static_cast<size_t>(count) * sizeof(glm::vec4), nullptr, GL_DYNAMIC_DRAW);
+    glGenQueries(1, &query);
+    std::vector<glm::vec3> cpuPositions(count);
+
+    glUseProgram(spawnBenchmarkShader.ID);
+    spawnBenchmarkShader.setUInt("seed", params.seed);
+    spawnBenchmarkShader.setUInt("count", count);
+    spawnBenchmarkShader.setUInt("spawnTriangleCount", spawnTriangleCount);
+    spawnBenchmarkShader.setFloat("spawnMeshOffset", meshOffset);
+    spawnBenchmarkShader.setFloat("emitRadius", params.emitRadius);
+    spawnBenchmarkShader.setFloat("emitHeight", params.emitHeight);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, scratch);
+    if(spawnTriangleCount > 0) glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, spawnTrianglesSSBO);
+    int numWorkGroups = std::max((count + 255) / 256, 1);
+
+    for (const BenchmarkShape& shape : shapes)
+    {
+        if(shape.shape == EmitterShape::meshShape && spawnTriangleCount == 0) {
+            std::cout << "Spawn benchmark | mesh: skipped, there is no spawn mesh" << std::endl;
+            continue;
         }
-        
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, transformationsSSBO);
-        glBufferData(GL_SHADER_STORAGE_BUFFER, numInstances * sizeof(glm::mat4), initialTransforms.data(), GL_DYNAMIC_DRAW);
-    
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, rotationsSSBO);
-        glBufferData(GL_SHADER_STORAGE_BUFFER, numInstances * sizeof(glm::vec4), rotations.data(), GL_DYNAMIC_DRAW);
+        spawnBenchmarkShader.setUInt("emitterShape", static_cast<unsigned int>(shape.shape));
+        glDispatchCompute(numWorkGroups, 1, 1); // warmup
+
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        for (int i = 0; i < repetitions; i++) glDispatchCompute(numWorkGroups, 1, 1);
+        glEndQuery(GL_TIME_ELAPSED);
+        GLuint64 elapsedNs = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsedNs);
+        double gpuRate = static_cast<double>(count) * repetitions / std::max(elapsedNs, GLuint64(1)) * 1000.0;
+
+        // the random numbers are part of the cost on the GPU as well
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < count; i++) {
+            glm::vec3 r = glm::vec3(Random::Float4(params.seed, i, 0, RandomShared::RNG_STREAM_SPAWN));
+            cpuPositions[i] = shape.shape == EmitterShape::meshShape ? Spawn::OnMesh(spawnTriangles, r, meshOffset)
+                                                                     : Spawn::Position(shape.shape, r, params.emitRadius, params.emitHeight);
+        }
+        double cpuSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double cpuRate = count / std::max(cpuSeconds, 1e-9) / 1e6;
+
+        std::cout << "Spawn benchmark (" << count << " particles) | " << shape.name << ": GPU " << gpuRate << " M/s"
+                  << " | CPU " << cpuRate << " M/s (one thread)" << std::endl;
+    }
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glDeleteQueries(1, &query);
+    glDeleteBuffers(1, &scratch);
+}
+
+void Emitter::runFixedSteps(const EmitterParams &params, int steps)
+{
+    changeEmitArea(params);
+    setComputeUniforms(params, fixedDT);
+    for (int i = 0; i < steps; i++) fixedUpdatePhysics(fixedDT);
+}
+
+void Emitter::readParticleState(std::vector<glm::vec4> &positions, std::vector<glm::uvec4> &orientations, std::vector<glm::vec4> &velocities) const
+{
+    positions.resize(numInstances);
+    orientations.resize(numInstances);
+    velocities.resize(numInstances);
+    // make sure the last compute dispatch is visible to the readback
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glGetNamedBufferSubData(positionsSSBO, 0, numInstances * sizeof(glm::vec4), positions.data());
+    glGetNamedBufferSubData(orientationsSSBO, 0, numInstances * sizeof(glm::uvec4), orientations.data());
+    glGetNamedBufferSubData(velocitySSBO, 0, numInstances * sizeof(glm::vec4), velocities.data());
+}
 
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, velocitySSBO);
-        glBufferData(GL_SHADER_STORAGE_BUFFER, numInstances * sizeof(glm::vec4), velocities.data(), GL_DYNAMIC_DRAW);
+void Emitter::readParticleStateAsync(AsyncReadback &readback, bool includeVelocities) const
+{
+    std::vector<AsyncReadback::Range> ranges = {
+        {positionsSSBO, numInstances * sizeof(glm::vec4)},
+        {orientationsSSBO, numInstances * sizeof(glm::uvec4)}
+    };
+    if(includeVelocities) ranges.push_back({velocitySSBO, numInstances * sizeof(glm::vec4)});
+    readback.begin(ranges);
+}
 
+void Emitter::restoreParticleState(const EmitterParams &params, const void *positions, const void *orientations, const void *velocities,
+                                   unsigned int stepIndex, float accumulatedTime, float spawnClock, const std::vector<float>& spawnCarry)
+{
+    emitterRanges = layoutOf(params);
+    numInstances = emitterRanges.back().first + emitterRanges.back().count;
+    reserveParticles(numInstances);
+    //all state comes from the file, the leaves are only built once a restart or a resize needs their initial orientations.
+    //A snapshot with another seed makes the stored initial state useless, it is rebuilt when it is needed
+    if(params.seed != initialSeed) {
+        leaves.clear();
+        initialSeed = params.seed;
+        initialCount = 0;
     }
+    if(static_cast<int>(leaves.size()) > numInstances) leaves.resize(numInstances);
+    if(initialCount > numInstances) initialCount = numInstances;
+
+    uploadBuffer(positionsSSBO, positions, numInstances * sizeof(glm::vec4));
+    uploadBuffer(previousPositionsSSBO, positions, numInstances * sizeof(glm::vec4));
+    uploadBuffer(orientationsSSBO, orientations, numInstances * sizeof(glm::uvec4));
+    uploadBuffer(velocitySSBO, velocities, numInstances * sizeof(glm::vec4));
+    //the active counts of the blocks follow the restored fraction, the next update sets both again
+    fixedDT = 1.0f / std::max(params.physicsRate, 1.0f);
+    activeFraction = glm::clamp(params.activeFraction, 0.0f, 1.0f);
+    uploadEmitterBlocks(allEmitters(params));
+    rebuildParticleLists();
+
+    this->stepIndex = stepIndex;
+    physicsAccumulator = accumulatedTime;
+    //the rate curves go on where they left off, the step count can't tell once the physics rate changed along the way
+    this->spawnClock = spawnClock;
+    this->spawnCarry = spawnCarry;
+    this->spawnCarry.resize(emitterRanges.size(), 0.0f);
+}
+
+void Emitter::uploadParticleFrame(int count, const glm::vec4 *positions, const glm::uvec4 *orientations)
+{
+    if(count != numInstances) {
+        reserveParticles(count);
+        numInstances = count;
+        if(static_cast<int>(leaves.size()) > numInstances) leaves.resize(numInstances);
+        if(initialCount > numInstances) initialCount = numInstances;
+        //the velocities are not drawn, they only need to be defined for when the simulation takes over again
+        glClearNamedBufferSubData(velocitySSBO, GL_RGBA32F, 0, numInstances * sizeof(glm::vec4), GL_RGBA, GL_FLOAT, nullptr);
+    }
+    //recorded frames are shown as they are, without a previous state there is nothing to blend. The recording doesn't
+    //know the emitters, it is drawn as one range
+    activeFraction = 1.0f;
+    emitterRanges = {ParticleRange{0, numInstances}};
+    uploadBuffer(positionsSSBO, positions, numInstances * sizeof(glm::vec4));
+    uploadBuffer(previousPositionsSSBO, positions, numInstances * sizeof(glm::vec4));
+    uploadBuffer(orientationsSSBO, orientations, numInstances * sizeof(glm::uvec4));
+    //drawn like an emitter without a spawn rate, the recorded fade in w scales every particle like in the simulation
+    uploadEmitterBlocks({EmitterSource{}});
+    rebuildParticleLists();
+}
+
+//copies straight into the mapped start of the buffer, no intermediate copy on the CPU. The buffer keeps its size
+void Emitter::uploadBuffer(unsigned int buffer, const void *data, size_t size)
+{
+    if(size == 0) return;
+    void* mapped = glMapNamedBufferRange(buffer, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    if(mapped != nullptr) {
+        std::memcpy(mapped, data, size);
+        glUnmapNamedBuffer(buffer);
+    }
+    else {
+        glNamedBufferSubData(buffer, 0, size, data);
+    }
+}
+
+int Emitter::getParticleCount() const
+{
+    return numInstances;
+}
+
+int Emitter::getActiveParticleCount() const
+{
+    int count = 0;
+    for (size_t i = 0; i < emitterRanges.size(); i++) count += getActiveCount(i);
+    return count;
+}
+
+int Emitter::getActiveCount(size_t emitter) const
+{
+    const ParticleRange& range = emitterRanges[emitter];
+    bool recycling = emitter < emitterBlocks.size() && emitterBlocks[emitter].spawning.z != 0;
+    if(activeFraction >= 1.0f || recycling) return range.count;
+    return std::clamp(static_cast<int>(std::ceil(range.count * activeFraction)), std::min(range.count, 1), range.count);
+}
+
+std::vector<ParticleRange> Emitter::getActiveRanges() const
+{
+    std::vector<ParticleRange> active;
+    for (size_t i = 0; i < emitterRanges.size(); i++) active.push_back({emitterRanges[i].first, getActiveCount(i)});
+    return active;
+}
+
+const std::vector<ParticleRange> &Emitter::getEmitterRanges() const
+{
+    return emitterRanges;
+}
+
+std::vector<ParticleRange> Emitter::layoutOf(const EmitterParams &params)
+{
+    std::vector<ParticleRange> layout;
+    int first = 0;
+    for (const EmitterSource& source : allEmitters(params)) {
+        int count = std::max(source.leafCount, 0);
+        layout.push_back({first, count});
+        first += count;
+    }
+    return layout;
+}
+
+//particleIndex (location = 3) of the bound VAO, it advances once per instance. Drawing from other buffers swaps the
+//draw list of binding 3
+void Emitter::bindParticleIndices()
+{
+    glBindBuffer(GL_ARRAY_BUFFER, drawListSSBO);
+    glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(unsigned int), (void*)0);
+    glVertexAttribDivisor(3, 1);
+    glEnableVertexAttribArray(3);
+}
+
+ParticleBuffers Emitter::getParticleBuffers() const
+{
+    return ParticleBuffers{positionsSSBO, previousPositionsSSBO, orientationsSSBO, drawListSSBO, aliveCountsSSBO};
+}
+
+unsigned int Emitter::getStepIndex() const
+{
+    return stepIndex;
+}
+
+float Emitter::getFixedDT() const
+{
+    return fixedDT;
+}
+
+float Emitter::getAccumulatedTime() const
+{
+    return physicsAccumulator;
+}
+
+float Emitter::getSpawnClock() const
+{
+    return spawnClock;
+}
+
+const std::vector<float> &Emitter::getSpawnCarry() const
+{
+    return spawnCarry;
+}
+
+void Emitter::setSpawnMesh(const std::vector<glm::vec3> &triangles)
+{
+    spawnTriangles = Spawn::MeshTable(triangles);
+    spawnTriangleCount = static_cast<unsigned int>(spawnTriangles.size() / 3);
+    if(spawnTrianglesSSBO == 0) glCreateBuffers(1, &spawnTrianglesSSBO);
+    if(spawnTriangleCount > 0) {
+        glNamedBufferData(spawnTrianglesSSBO, spawnTriangles.size() * sizeof(glm::vec4), spawnTriangles.data(), GL_STATIC_DRAW);
+    }
+}
+
+void Emitter::setColliders(const SdfCollider *colliders)
+{
+    this->colliders = colliders;
+}
+
+void Emitter::setRecorder(TrajectoryRecorder *recorder)
+{
+    this->recorder = recorder;
+}
+
+void Emitter::uploadInitialTransforms() {
+        reserveParticles(numInstances);
+        uploadInitialOrientations(0, numInstances);
+        initialCount = numInstances;
+        resetParticles();
+    }
+
+void Emitter::uploadInitialOrientations(int first, int count)
+{
+    if(count <= 0) return;
+    buildLeaves(first + count);
+    //Packed like in the compute shader: xy = orientation quaternion as 4 x snorm16, zw = angular velocity as half floats (0 at the beginning)
+    std::vector<glm::uvec4> orientations(count);
+    for (int i = 0; i < count; i++) {
+        glm::quat orientation = leaves[first + i].getOrientation();
+        orientations[i] = glm::uvec4(glm::packSnorm2x16(glm::vec2(orientation.x, orientation.y)),
+                                     glm::packSnorm2x16(glm::vec2(orientation.z, orientation.w)),
+                                     glm::packHalf2x16(glm::vec2(0.0f)),
+                                     glm::packHalf2x16(glm::vec2(0.0f)));
+    }
+    glNamedBufferSubData(initialOrientationsSSBO, first * sizeof(glm::uvec4), count * sizeof(glm::uvec4), orientations.data());
+}
+
+//Puts every particle back to its initial state without touching the CPU side, the buffers already have the right size
+void Emitter::resetParticles()
+{
+    initializeParticles(0, numInstances);
+    spawnCarry.assign(emitterRanges.size(), 0.0f);
+    spawnClock = 0.0f;
+    rebuildParticleLists();
+}
+
+void Emitter::initializeParticles(int first, int count)
+{
+    if(count <= 0) return;
+    GLintptr vec4Offset = first * sizeof(glm::vec4), uvec4Offset = first * sizeof(glm::uvec4);
+    GLsizeiptr vec4Size = count * sizeof(glm::vec4), uvec4Size = count * sizeof(glm::uvec4);
+    //Every leaf starts below the ground, so the compute shader respawns it in the emit area on the first step
+    const glm::vec4 belowGround(0.0f, -1.0f, 0.0f, 1.0f);
+    glClearNamedBufferSubData(positionsSSBO, GL_RGBA32F, vec4Offset, vec4Size, GL_RGBA, GL_FLOAT, glm::value_ptr(belowGround));
+    glClearNamedBufferSubData(previousPositionsSSBO, GL_RGBA32F, vec4Offset, vec4Size, GL_RGBA, GL_FLOAT, glm::value_ptr(belowGround));
+    //velocity is 0 at the beginning for all particles
+    glClearNamedBufferSubData(velocitySSBO, GL_RGBA32F, vec4Offset, vec4Size, GL_RGBA, GL_FLOAT, nullptr);
+    glCopyNamedBufferSubData(initialOrientationsSSBO, orientationsSSBO, uvec4Offset, uvec4Offset, uvec4Size);
+    //the particles of spawn rate emitters start dead, the spawns bring them in one after the other
+    const glm::vec4 dead(0.0f, -1.0f, 0.0f, 0.0f);
+    for (size_t i = 0; i < emitterBlocks.size(); i++) {
+        int start = std::max(emitterRanges[i].first, first);
+        int end = std::min(emitterRanges[i].first + emitterRanges[i].count, first + count);
+        if(emitterBlocks[i].spawning.z == 0 || end <= start) continue;
+        glClearNamedBufferSubData(positionsSSBO, GL_RGBA32F, start * sizeof(glm::vec4), (end - start) * sizeof(glm::vec4),
+                                  GL_RGBA, GL_FLOAT, glm::value_ptr(dead));
+    }
+}
+
+//Doubles the buffers when they are too small and halves them only once they are less than a quarter full, so stepping
+//the count up and down neither reallocates every time nor holds on to a peak forever. The particles that fit are copied
+//over on the GPU
+void Emitter::reserveParticles(int count)
+{
+    const int minCapacity = 1024;
+    int capacity = particleCapacity;
+    if(count > capacity) capacity = std::max({count, capacity * 2, minCapacity});
+    else if(count < capacity / 4 && capacity > minCapacity) capacity = std::max(count * 2, minCapacity);
+    if(capacity == particleCapacity) return;
+
+    size_t kept = static_cast<size_t>(std::min(count, particleCapacity));
+    //the compute shader wrote the particles, the copies read them as buffer data
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    reallocateBuffer(positionsSSBO, capacity * sizeof(glm::vec4), kept * sizeof(glm::vec4));
+    reallocateBuffer(previousPositionsSSBO, capacity * sizeof(glm::vec4), kept * sizeof(glm::vec4));
+    reallocateBuffer(velocitySSBO, capacity * sizeof(glm::vec4), kept * sizeof(glm::vec4));
+    reallocateBuffer(orientationsSSBO, capacity * sizeof(glm::uvec4), kept * sizeof(glm::uvec4));
+    reallocateBuffer(initialOrientationsSSBO, capacity * sizeof(glm::uvec4), kept * sizeof(glm::uvec4));
+    //the lists are rebuilt after every resize. The draw list keeps its name, the VAOs refer to it
+    reallocateBuffer(drawListSSBO, capacity * sizeof(unsigned int), 0);
+    reallocateBuffer(deadBlocksSSBO, (capacity + 255) / 256 * sizeof(unsigned int), 0);
+    std::cout << "Particle buffers reallocated: room for " << capacity << " particles (was " << particleCapacity << ")" << std::endl;
+    particleCapacity = capacity;
+}
+
+//New storage of the given size with the first keptBytes of the old one. With something to keep the buffer gets a new
+//name, the copy needs both at once
+void Emitter::reallocateBuffer(unsigned int &buffer, size_t size, size_t keptBytes)
+{
+    if(keptBytes == 0) {
+        glNamedBufferData(buffer, size, nullptr, GL_DYNAMIC_DRAW);
+        return;
+    }
+    unsigned int resized;
+    glCreateBuffers(1, &resized);
+    glNamedBufferData(resized, size, nullptr, GL_DYNAMIC_DRAW);
+    glCopyNamedBufferSubData(buffer, resized, 0, 0, keptBytes);
+    glDeleteBuffers(1, &buffer);
+    buffer = resized;
+}
 
 Emitter::Emitter(const EmitterParams& params)
 {
-    numInstances = params.leafCount;
+    emitterRanges = layoutOf(params);
+    numInstances = emitterRanges.back().first + emitterRanges.back().count;
 
     leafShader.createProgram("./../shaders/leaf_vertex.glsl","./../shaders/leaf_fragment.glsl");
     sphereShader.createProgram("./../shaders/sphere_vertex.glsl","./../shaders/sphere_fragment.glsl");
     pointShader.createProgram("./../shaders/point_vertex.glsl","./../shaders/point_fragment.glsl");
     computeShader.createComputeProgram("./../shaders/compute.glsl");
-    leafTexture.initialize("./../textures/leaf-texture1.png", 0);
+    //leaf-texture1.png, leaf-texture2.png, ... are the leaf variants, one layer of the texture array each
+    std::vector<std::string> leafVariants = {"./../textures/leaf-texture1.png"};
+    while (std::filesystem::exists("./../textures/leaf-texture" + std::to_string(leafVariants.size() + 1) + ".png")) {
+        leafVariants.push_back("./../textures/leaf-texture" + std::to_string(leafVariants.size() + 1) + ".png");
+    }
+    leafTexture.initializeArray(leafVariants, 0);
 
     leaves.reserve(numInstances);
-    leaves.resize(numInstances);
     int sectorCount = 12, stackCount = 8;
 
     sphereCoordinates = generateSpherePoints(sectorCount, stackCount, 0.25f);
     sphereIndices = generateSphereIndices(sectorCount, stackCount);
     sphereNormals = generateSphereNormals(sectorCount, stackCount);
 
-    //Set up the Shader Storage Buffer Object for the leaf model matrices
-    glGenBuffers(1, &transformationsSSBO);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, transformationsSSBO);
+    //Set up the Shader Storage Buffer Objects for the leaf positions and orientations
+    glGenBuffers(1, &positionsSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, positionsSSBO);
 
-    glBufferData(GL_SHADER_STORAGE_BUFFER, numInstances * sizeof(glm::mat4), nullptr, GL_DYNAMIC_DRAW); 
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, transformationsSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, numInstances * sizeof(glm::vec4), nullptr, GL_DYNAMIC_DRAW); 
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, positionsSSBO);
 
-    glGenBuffers(1, &rotationsSSBO);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, rotationsSSBO);
+    glGenBuffers(1, &previousPositionsSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, previousPositionsSSBO);
 
     glBufferData(GL_SHADER_STORAGE_BUFFER, numInstances * sizeof(glm::vec4), nullptr, GL_DYNAMIC_DRAW);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, rotationsSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, previousPositionsSSBO);
+
+    glCreateBuffers(1, &initialOrientationsSSBO);
+
+    glGenBuffers(1, &orientationsSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, orientationsSSBO);
+
+    glBufferData(GL_SHADER_STORAGE_BUFFER, numInstances * sizeof(glm::uvec4), nullptr, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, orientationsSSBO);
 
     glGenBuffers(1, &velocitySSBO);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, velocitySSBO);
@@ -202,6 +840,18 @@ Emitter::Emitter(const EmitterParams& params)
     glBufferData(GL_SHADER_STORAGE_BUFFER, numInstances * sizeof(glm::vec4), nullptr, GL_DYNAMIC_DRAW);
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, velocitySSBO);
 
+    //the per emitter buffers are sized for maxEmitters once, changing the emitters only overwrites them
+    glCreateBuffers(1, &emitterBlocksSSBO);
+    glNamedBufferData(emitterBlocksSSBO, maxEmitters * sizeof(EmitterBlock), nullptr, GL_DYNAMIC_DRAW);
+    glCreateBuffers(1, &drawCommandsBuffer);
+    glNamedBufferData(drawCommandsBuffer, maxEmitters * std::max(sizeof(DrawElementsCommand), sizeof(DrawArraysCommand)), nullptr, GL_DYNAMIC_DRAW);
+    glCreateBuffers(1, &drawListSSBO);
+    glCreateBuffers(1, &deadBlocksSSBO);
+    glCreateBuffers(1, &aliveCountsSSBO);
+    glNamedBufferData(aliveCountsSSBO, maxEmitters * sizeof(unsigned int), nullptr, GL_DYNAMIC_DRAW);
+    glCreateBuffers(1, &deadCountsSSBO);
+    glNamedBufferData(deadCountsSSBO, maxEmitters * sizeof(unsigned int), nullptr, GL_DYNAMIC_DRAW);
+
 
     //Generate buffers for the leaf object that will be used for instancing
     glGenVertexArrays(1, &leafVAO);
@@ -221,6 +871,8 @@ Emitter::Emitter(const EmitterParams& params)
     // UV  (location = 1)
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
     glEnableVertexAttribArray(1);
+    // particle index (location = 3), one per instance
+    bindParticleIndices();
 
     //Buffers for the sphere shape
 
@@ -244,6 +896,7 @@ Emitter::Emitter(const EmitterParams& params)
 
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(1);
+    bindParticleIndices();
 
     //Buffers for the point shape
 
@@ -256,27 +909,33 @@ Emitter::Emitter(const EmitterParams& params)
     
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
+    bindParticleIndices();
 
     //This creates all the leaves and assigns random positions to them as well as fill the ssbo with matrices
     changeEmitArea(params);
 
 }
 
-Leaf Emitter::createLeaf(const EmitterParams &params, std::mt19937 &gen, std::uniform_real_distribution<float> &rotDist)
+Leaf Emitter::createLeaf(const EmitterParams &params, int leafIndex)
 {
-    // else if(params.shape == EmitterShape::circleShape) {
-    //     position = glm::vec3{1, 0, 0};
-    //     glm::quat rotation = glm::angleAxis(glm::radians(rotDist(gen)), glm::vec3{0, 1, 0});
-
-    //     // Correct uniform distribution over the circle
-    //     float r = sqrt(oneDist(gen)) * params.emitRadius;
-    //     position = rotation * position * r + glm::vec3{0, spawnHeight, 0};
-    // }
-    Leaf l{glm::vec3{rotDist(gen), 0, rotDist(gen)}};
+    //same generator as the compute shader, keyed by the leaf index so every leaf gets the same rotation for the same seed
+    glm::vec4 r = Random::Float4(params.seed, leafIndex, 0, RandomShared::RNG_STREAM_INIT);
+    Leaf l{glm::vec3{r.x * 360.0f, 0, r.y * 360.0f}};
 
     return l;
 }
 
+void Emitter::buildLeaves(int count)
+{
+    EmitterParams leafParams;
+    leafParams.seed = initialSeed;
+    leaves.reserve(count);
+    for (int i = static_cast<int>(leaves.size()); i < count; i++)
+    {
+        leaves.emplace_back(createLeaf(leafParams, i));
+    }
+}
+
 Emitter::~Emitter()
 {
 }
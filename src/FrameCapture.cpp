@@ -0,0 +1,267 @@
+#include "FrameCapture.h"
+#include "ImageWriter.h"
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+
+//Blocks until the readback behind the fence is done. A single wait may time out on a slow renderer (llvmpipe with a big
+//frame), so it waits again until the fence is signaled. Returns false if the wait itself failed
+static bool waitForFence(GLsync fence)
+{
+    while (true) {
+        GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        if(result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED) return true;
+        if(result == GL_WAIT_FAILED) return false;
+    }
+}
+
+void FrameCapture::createTargets(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+
+    glCreateTextures(GL_TEXTURE_2D, 1, &colorTexture);
+    glTextureStorage2D(colorTexture, 1, GL_RGBA8, width, height);
+    glCreateRenderbuffers(1, &depthBuffer);
+    glNamedRenderbufferStorage(depthBuffer, GL_DEPTH_COMPONENT24, width, height);
+    glCreateFramebuffers(1, &framebuffer);
+    glNamedFramebufferTexture(framebuffer, GL_COLOR_ATTACHMENT0, colorTexture, 0);
+    glNamedFramebufferRenderbuffer(framebuffer, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    if(glCheckNamedFramebufferStatus(framebuffer, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "FrameCapture: the capture framebuffer is incomplete" << std::endl;
+    }
+
+    //persistently mapped, the encoders read the pixels right out of these buffers
+    size_t frameBytes = static_cast<size_t>(width) * height * 4;
+    GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    for (Slot& slot : slots) {
+        glCreateBuffers(1, &slot.buffer);
+        glNamedBufferStorage(slot.buffer, frameBytes, nullptr, flags | GL_CLIENT_STORAGE_BIT);
+        slot.mapped = static_cast<uint8_t*>(glMapNamedBufferRange(slot.buffer, 0, frameBytes, flags));
+        slot.frameIndex = -1;
+    }
+}
+
+void FrameCapture::destroyTargets()
+{
+    for (Slot& slot : slots) {
+        if(slot.fence != nullptr) glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+        if(slot.buffer != 0) {
+            glUnmapNamedBuffer(slot.buffer);
+            glDeleteBuffers(1, &slot.buffer);
+        }
+        slot.buffer = 0;
+        slot.mapped = nullptr;
+        slot.frameIndex = -1;
+    }
+    if(framebuffer != 0) glDeleteFramebuffers(1, &framebuffer);
+    if(colorTexture != 0) glDeleteTextures(1, &colorTexture);
+    if(depthBuffer != 0) glDeleteRenderbuffers(1, &depthBuffer);
+    framebuffer = colorTexture = depthBuffer = 0;
+    width = height = 0;
+}
+
+bool FrameCapture::start(const std::filesystem::path &path, CaptureFormat format, int width, int height, float fps)
+{
+    if(capturing) stop();
+    width &= ~1;
+    height &= ~1;
+    if(width <= 0 || height <= 0 || fps <= 0.0f) {
+        std::cerr << "FrameCapture: invalid capture size " << width << "x" << height << " at " << fps << " fps" << std::endl;
+        return false;
+    }
+
+    std::error_code error;
+    if(format == CaptureFormat::pngSequence) {
+        std::filesystem::create_directories(path, error);
+        if(error) {
+            std::cerr << "FrameCapture: could not create " << path << ": " << error.message() << std::endl;
+            return false;
+        }
+    }
+    else {
+        if(path.has_parent_path()) std::filesystem::create_directories(path.parent_path(), error);
+        video.open(path, std::ios::binary | std::ios::trunc);
+        if(!video) {
+            std::cerr << "FrameCapture: could not open " << path << std::endl;
+            return false;
+        }
+        //frame rate as a fraction in thousandths, so 29.97 survives
+        video << "YUV4MPEG2 W" << width << " H" << height << " F" << static_cast<int>(fps * 1000.0f + 0.5f) << ":1000 Ip A1:1 C420jpeg\n";
+    }
+
+    if(width != this->width || height != this->height) {
+        destroyTargets();
+        createTargets(width, height);
+    }
+    if(!encoders) encoders = std::make_unique<ThreadPool>();
+
+    this->format = format;
+    this->fps = fps;
+    outputPath = path;
+    nextFrame = nextFrameToEncode = nextFrameToWrite = 0;
+    stallSeconds = 0.0;
+    writeFailed = false;
+    capturing = true;
+    std::cout << "Capturing " << width << "x" << height << " at " << fps << " fps to " << path << std::endl;
+    return true;
+}
+
+void FrameCapture::beginFrame()
+{
+    if(!capturing) return;
+    glGetIntegerv(GL_VIEWPORT, savedViewport);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, width, height);
+    frameOpen = true;
+}
+
+void FrameCapture::endFrame(int windowWidth, int windowHeight)
+{
+    if(!capturing || !frameOpen) return;
+    frameOpen = false;
+
+    //the ring is full, block on the oldest frame instead of dropping one
+    Slot& slot = slots[nextFrame % slotCount];
+    if(slot.frameIndex >= 0) waitForSlot(slot);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.frameIndex = nextFrame++;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+    if(windowWidth > 0 && windowHeight > 0) {
+        glBlitNamedFramebuffer(framebuffer, 0, 0, 0, width, height, 0, 0, windowWidth, windowHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    }
+    glFlush();
+}
+
+void FrameCapture::poll()
+{
+    //fences signal in order, so stop at the first frame that is not there yet
+    while (nextFrameToEncode < nextFrame) {
+        Slot& slot = slots[nextFrameToEncode % slotCount];
+        if(slot.fence == nullptr) break;
+        GLenum result = glClientWaitSync(slot.fence, 0, 0);
+        if(result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) break;
+        encodeSlot(slot);
+    }
+}
+
+void FrameCapture::encodeSlot(Slot &slot)
+{
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+    slot.encoding = true;
+    nextFrameToEncode++;
+    encoders->enqueue([this, &slot] { encodeFrame(slot); });
+}
+
+void FrameCapture::waitForSlot(Slot &slot)
+{
+    auto begin = std::chrono::steady_clock::now();
+    if(slot.fence != nullptr) {
+        //earlier frames may still be waiting for their fence as well, they are handed out in order
+        while (slot.fence != nullptr) {
+            Slot& oldest = slots[nextFrameToEncode % slotCount];
+            if(!waitForFence(oldest.fence)) {
+                std::cerr << "FrameCapture: waiting for a frame failed" << std::endl;
+                std::lock_guard<std::mutex> lock(writeMutex);
+                writeFailed = true;
+                break;
+            }
+            encodeSlot(oldest);
+        }
+    }
+    {
+        std::unique_lock<std::mutex> lock(writeMutex);
+        slotReleased.wait(lock, [&slot] { return !slot.encoding; });
+    }
+    slot.frameIndex = -1;
+    stallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+void FrameCapture::encodeFrame(Slot &slot)
+{
+    int frameIndex = slot.frameIndex;
+    if(format == CaptureFormat::pngSequence) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "frame_%06d.png", frameIndex);
+        bool written = writePng(outputPath / name, width, height, slot.mapped);
+        std::lock_guard<std::mutex> lock(writeMutex);
+        if(!written) writeFailed = true;
+        slot.encoding = false;
+        slotReleased.notify_all();
+        return;
+    }
+
+    std::vector<uint8_t> yuv;
+    rgbaToI420(width, height, slot.mapped, yuv);
+    std::unique_lock<std::mutex> lock(writeMutex);
+    //the pixels are converted already, the slot can take the next frame while this one waits for its turn
+    slot.encoding = false;
+    slotReleased.notify_all();
+    //the pool runs jobs in submission order, so the frame before this one is always being worked on and this can't deadlock
+    frameWritten.wait(lock, [this, frameIndex] { return nextFrameToWrite == frameIndex; });
+    video << "FRAME\n";
+    video.write(reinterpret_cast<const char*>(yuv.data()), yuv.size());
+    if(!video) writeFailed = true;
+    nextFrameToWrite++;
+    frameWritten.notify_all();
+}
+
+void FrameCapture::stop()
+{
+    if(!capturing) return;
+    if(frameOpen) {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+        frameOpen = false;
+    }
+    for (int i = nextFrameToEncode; i < nextFrame; i++) {
+        Slot& slot = slots[i % slotCount];
+        if(slot.fence != nullptr && !waitForFence(slot.fence)) {
+            //the frame is still written, so a video keeps its frame count, but the capture is reported as failed
+            std::cerr << "FrameCapture: waiting for a frame failed" << std::endl;
+            std::lock_guard<std::mutex> lock(writeMutex);
+            writeFailed = true;
+        }
+        encodeSlot(slot);
+    }
+    encoders->waitIdle();
+    for (Slot& slot : slots) slot.frameIndex = -1;
+    if(video.is_open()) video.close();
+    capturing = false;
+
+    if(writeFailed) std::cerr << "FrameCapture: not all frames could be written to " << outputPath << std::endl;
+    std::cout << "Captured " << nextFrame << " frames to " << outputPath << ", the render loop waited "
+              << stallSeconds * 1000.0 << " ms for readbacks" << std::endl;
+}
+
+bool FrameCapture::isCapturing() const
+{
+    return capturing;
+}
+
+float FrameCapture::getFrameTime() const
+{
+    return 1.0f / fps;
+}
+
+int FrameCapture::getCapturedFrames() const
+{
+    return nextFrame;
+}
+
+FrameCapture::~FrameCapture()
+{
+    stop();
+    encoders.reset();
+    destroyTargets();
+}
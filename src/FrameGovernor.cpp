@@ -0,0 +1,156 @@
+#include "FrameGovernor.h"
+#include <iostream>
+#include <algorithm>
+#include <limits>
+
+//from full quality to the cheapest setting, the physics rate goes first since the interpolation hides most of it
+static const FrameGovernor::Level levels[] = {
+    {std::numeric_limits<float>::max(), 1.0f},
+    {45.0f, 1.0f},
+    {30.0f, 1.0f},
+    {30.0f, 0.75f},
+    {30.0f, 0.5f},
+    {20.0f, 0.35f},
+    {20.0f, 0.25f},
+    {20.0f, 0.125f}
+};
+static const int levelCount = sizeof(levels) / sizeof(levels[0]);
+
+void FrameGovernor::changeLevel(int newLevel)
+{
+    newLevel = std::clamp(newLevel, 0, levelCount - 1);
+    if(newLevel == level) return;
+    //a level that was just raised and didn't hold has to wait longer before the next try
+    if(newLevel > level && sinceRaise < failedRaiseWindow) raiseDelay = std::min(raiseDelay * 2.0f, 60.0f);
+    if(newLevel < level) sinceRaise = 0.0f;
+    if(newLevel == 0) raiseDelay = raiseAfter;
+
+    std::cout << "Frame governor: level " << level << " -> " << newLevel << " at " << std::max(cpuTime, getGpuTime()) * 1000.0f
+              << "ms (target " << targetFrameTime * 1000.0f << "ms), ";
+    if(newLevel > 0) std::cout << "physics rate <= " << levels[newLevel].maxPhysicsRate << " Hz, ";
+    std::cout << levels[newLevel].particleShare * 100.0f << "% of the particles" << std::endl;
+    level = newLevel;
+    //measure the new level on its own, timer results of older frames are dropped
+    generation++;
+    samples = gpuSamples = 0;
+    headroomTime = 0.0f;
+    cooldown = settleTime;
+}
+
+void FrameGovernor::setEnabled(bool enabled)
+{
+    if(enabled == this->enabled) return;
+    this->enabled = enabled;
+    if(!enabled) {
+        level = 0;
+        raiseDelay = raiseAfter;
+    }
+    generation++;
+    samples = gpuSamples = 0;
+    headroomTime = 0.0f;
+}
+
+bool FrameGovernor::isEnabled() const
+{
+    return enabled;
+}
+
+void FrameGovernor::setTargetFps(float fps)
+{
+    targetFrameTime = 1.0f / std::max(fps, 1.0f);
+}
+
+void FrameGovernor::beginGpuFrame()
+{
+    if(queries[0] == 0) glGenQueries(queryCount, queries);
+    //all queries still in flight, this frame goes unmeasured
+    if(pendingQueries == queryCount) return;
+    glBeginQuery(GL_TIME_ELAPSED, queries[nextQuery]);
+    queryRunning = true;
+}
+
+void FrameGovernor::endGpuFrame()
+{
+    if(!queryRunning) return;
+    glEndQuery(GL_TIME_ELAPSED);
+    queryGeneration[nextQuery] = generation;
+    nextQuery = (nextQuery + 1) % queryCount;
+    pendingQueries++;
+    queryRunning = false;
+}
+
+void FrameGovernor::update(float cpuSeconds, float frameSeconds, bool simulating, float simulationGpuSeconds)
+{
+    //collect the finished timer queries in order without waiting for the GPU
+    while (pendingQueries > 0) {
+        int oldest = (nextQuery - pendingQueries + queryCount) % queryCount;
+        GLint available = 0;
+        glGetQueryObjectiv(queries[oldest], GL_QUERY_RESULT_AVAILABLE, &available);
+        if(!available) break;
+        GLuint64 elapsedNs = 0;
+        glGetQueryObjectui64v(queries[oldest], GL_QUERY_RESULT, &elapsedNs);
+        pendingQueries--;
+        if(queryGeneration[oldest] != generation) continue;
+        float seconds = elapsedNs * 1e-9f;
+        if(gpuSamples++ > 0) gpuTime = gpuSamples == 2 ? seconds : gpuTime + (seconds - gpuTime) * smoothing;
+    }
+    //the first frame after a change carries one-off costs like buffer allocations, the averages start with the second one
+    if(samples++ > 0) cpuTime = samples == 2 ? cpuSeconds : cpuTime + (cpuSeconds - cpuTime) * smoothing;
+    //the simulation context runs next to the render context on the same GPU, its results arrive in bursts and the
+    //smoothing spreads them over the frames
+    if(samples > 1) simulationGpuTime = samples == 2 ? simulationGpuSeconds : simulationGpuTime + (simulationGpuSeconds - simulationGpuTime) * smoothing;
+
+    if(!enabled || !simulating) {
+        headroomTime = 0.0f;
+        return;
+    }
+    cooldown -= frameSeconds;
+    sinceRaise += frameSeconds;
+    if(samples < minSamples || gpuSamples < minSamples / 2 || cooldown > 0.0f) return;
+
+    float load = std::max(cpuTime, getGpuTime());
+    if(load > targetFrameTime * overload) {
+        //a heavy change, like ten times the particles, skips a level
+        changeLevel(level + (load > 2.0f * targetFrameTime ? 2 : 1));
+    }
+    else if(load < targetFrameTime * underload && level > 0) {
+        headroomTime += frameSeconds;
+        if(headroomTime >= raiseDelay) changeLevel(level - 1);
+    }
+    else headroomTime = 0.0f;
+}
+
+EmitterParams FrameGovernor::apply(const EmitterParams &params) const
+{
+    EmitterParams governed = params;
+    if(!enabled) return governed;
+    governed.physicsRate = std::min(params.physicsRate, levels[level].maxPhysicsRate);
+    governed.activeFraction = params.activeFraction * levels[level].particleShare;
+    return governed;
+}
+
+const FrameGovernor::Level &FrameGovernor::getLevel() const
+{
+    return levels[level];
+}
+
+int FrameGovernor::getLevelIndex() const
+{
+    return level;
+}
+
+float FrameGovernor::getCpuTime() const
+{
+    return cpuTime;
+}
+
+float FrameGovernor::getGpuTime() const
+{
+    return gpuTime + simulationGpuTime;
+}
+
+FrameGovernor::~FrameGovernor()
+{
+    if(queryRunning) glEndQuery(GL_TIME_ELAPSED);
+    if(queries[0] != 0) glDeleteQueries(queryCount, queries);
+}
@@ -0,0 +1,250 @@
+#include "GoldenState.h"
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+
+static const char* goldenHeader = "falling-leaves-golden";
+static const int goldenVersion = 1;
+
+static glm::vec4 unpackOrientation(const glm::uvec4& packed) {
+    glm::vec2 xy = glm::unpackSnorm2x16(packed.x);
+    glm::vec2 zw = glm::unpackSnorm2x16(packed.y);
+    return glm::normalize(glm::vec4(xy.x, xy.y, zw.x, zw.y));
+}
+
+static glm::vec3 unpackAngularVelocity(const glm::uvec4& packed) {
+    glm::vec2 xy = glm::unpackHalf2x16(packed.z);
+    return glm::vec3(xy.x, xy.y, glm::unpackHalf2x16(packed.w).x);
+}
+
+void GoldenState::capture(Emitter &emitter)
+{
+    emitter.runFixedSteps(params, steps);
+    emitter.readParticleState(positions, orientations, velocities);
+}
+
+uint64_t GoldenState::checksum() const
+{
+    uint64_t hash = 14695981039346656037ull;
+    auto hashBytes = [&hash](const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+    };
+    hashBytes(positions.data(), positions.size() * sizeof(glm::vec4));
+    hashBytes(orientations.data(), orientations.size() * sizeof(glm::uvec4));
+    hashBytes(velocities.data(), velocities.size() * sizeof(glm::vec4));
+    return hash;
+}
+
+bool GoldenState::save(const std::filesystem::path &path) const
+{
+    std::ofstream file(path);
+    if(!file) {
+        std::cerr << "Could not open golden file " << path << " for writing" << std::endl;
+        return false;
+    }
+    // 9 significant digits are enough to read back the exact float
+    file << std::setprecision(9);
+    file << goldenHeader << " " << goldenVersion << "\n";
+    file << "seed " << params.seed << "\n";
+    file << "steps " << steps << "\n";
+    file << "physicsRate " << params.physicsRate << "\n";
+    file << "leafCount " << params.leafCount << "\n";
+    file << "tumbling " << params.tumbling << "\n";
+    file << "spiralingMotion " << params.spiralingMotion << "\n";
+    file << "sceneColliders " << params.sceneColliders << "\n";
+    file << "emitterShape " << static_cast<int>(params.shape) << "\n";
+    file << "size " << params.size << "\n";
+    file << "gravity " << params.gravity << "\n";
+    file << "emitRadius " << params.emitRadius << "\n";
+    file << "emitHeight " << params.emitHeight << "\n";
+    file << "windForce " << params.windForce.x << " " << params.windForce.y << " " << params.windForce.z << "\n";
+    file << "blackHoleMass " << params.blackHoleMass << "\n";
+    for (const glm::vec3& p : params.blackHolePositions)
+        file << "blackHolePosition " << p.x << " " << p.y << " " << p.z << "\n";
+    file << "positionTolerance " << positionTolerance << "\n";
+    file << "velocityTolerance " << velocityTolerance << "\n";
+    file << "orientationTolerance " << orientationTolerance << "\n";
+    file << "checksum " << std::hex << checksum() << std::dec << "\n";
+    // one line per particle: position xyz, packed orientation (4 x hex), velocity xyz
+    file << "particles " << positions.size() << "\n";
+    for (size_t i = 0; i < positions.size(); i++) {
+        const glm::vec4& p = positions[i];
+        const glm::uvec4& o = orientations[i];
+        const glm::vec4& v = velocities[i];
+        file << p.x << " " << p.y << " " << p.z << " "
+             << std::hex << o.x << " " << o.y << " " << o.z << " " << o.w << std::dec << " "
+             << v.x << " " << v.y << " " << v.z << "\n";
+    }
+    return static_cast<bool>(file);
+}
+
+bool GoldenState::load(const std::filesystem::path &path)
+{
+    std::ifstream file(path);
+    if(!file) {
+        std::cerr << "Could not open golden file " << path << std::endl;
+        return false;
+    }
+    std::string key;
+    int version = 0;
+    file >> key >> version;
+    if(key != goldenHeader || version != goldenVersion) {
+        std::cerr << path << " is not a golden file of version " << goldenVersion << std::endl;
+        return false;
+    }
+
+    params = EmitterParams{};
+    params.windForce = glm::vec3(0.0f);
+    params.shape = EmitterShape::boxShape; //older files were recorded when every shape spawned in the box
+    params.particleShape = ParticleShape::pointShape;
+    size_t particleCount = 0;
+    while (file >> key) {
+        if(key == "seed") file >> params.seed;
+        else if(key == "steps") file >> steps;
+        else if(key == "physicsRate") file >> params.physicsRate; //older files were all recorded at the default rate
+        else if(key == "leafCount") file >> params.leafCount;
+        else if(key == "tumbling") file >> params.tumbling;
+        else if(key == "spiralingMotion") file >> params.spiralingMotion;
+        else if(key == "sceneColliders") file >> params.sceneColliders;
+        else if(key == "emitterShape") {
+            int shape;
+            file >> shape;
+            params.shape = static_cast<EmitterShape>(shape);
+        }
+        else if(key == "size") file >> params.size;
+        else if(key == "gravity") file >> params.gravity;
+        else if(key == "emitRadius") file >> params.emitRadius;
+        else if(key == "emitHeight") file >> params.emitHeight;
+        else if(key == "windForce") file >> params.windForce.x >> params.windForce.y >> params.windForce.z;
+        else if(key == "blackHoleMass") file >> params.blackHoleMass;
+        else if(key == "blackHolePosition") {
+            glm::vec3 p;
+            file >> p.x >> p.y >> p.z;
+            params.blackHolePositions.push_back(p);
+        }
+        else if(key == "positionTolerance") file >> positionTolerance;
+        else if(key == "velocityTolerance") file >> velocityTolerance;
+        else if(key == "orientationTolerance") file >> orientationTolerance;
+        else if(key == "checksum") file >> key; // recomputed from the particle data
+        else if(key == "particles") {
+            file >> particleCount;
+            break;
+        }
+        else {
+            std::cerr << "Unknown key " << key << " in golden file " << path << std::endl;
+            return false;
+        }
+    }
+
+    positions.assign(particleCount, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    orientations.assign(particleCount, glm::uvec4(0u));
+    velocities.assign(particleCount, glm::vec4(0.0f));
+    for (size_t i = 0; i < particleCount; i++) {
+        glm::vec4& p = positions[i];
+        glm::uvec4& o = orientations[i];
+        glm::vec4& v = velocities[i];
+        file >> p.x >> p.y >> p.z >> std::hex >> o.x >> o.y >> o.z >> o.w >> std::dec >> v.x >> v.y >> v.z;
+    }
+
+    if(!file || params.blackHolePositions.size() != 2 || static_cast<int>(particleCount) != params.leafCount || steps <= 0) {
+        std::cerr << "Golden file " << path << " is incomplete" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool GoldenState::compare(const GoldenState &reference) const
+{
+    if(positions.size() != reference.positions.size()) {
+        std::cout << "Golden check FAILED: " << positions.size() << " particles, expected " << reference.positions.size() << std::endl;
+        return false;
+    }
+
+    float maxPositionError = 0.0f, maxVelocityError = 0.0f, maxOrientationError = 0.0f;
+    int mismatches = 0, firstMismatch = -1;
+    for (size_t i = 0; i < positions.size(); i++) {
+        float positionError = glm::length(glm::vec3(positions[i]) - glm::vec3(reference.positions[i]));
+        float velocityError = std::max(glm::length(glm::vec3(velocities[i]) - glm::vec3(reference.velocities[i])),
+                                       glm::length(unpackAngularVelocity(orientations[i]) - unpackAngularVelocity(reference.orientations[i])));
+        // angle between the orientations, q and -q are the same orientation.
+        // atan2 instead of acos(dot) stays accurate for tiny angles
+        glm::vec4 a = unpackOrientation(orientations[i]);
+        glm::vec4 b = unpackOrientation(reference.orientations[i]);
+        if(glm::dot(a, b) < 0.0f) b = -b;
+        float orientationError = 2.0f * std::atan2(glm::length(a - b), glm::length(a + b));
+
+        maxPositionError = std::max(maxPositionError, positionError);
+        maxVelocityError = std::max(maxVelocityError, velocityError);
+        maxOrientationError = std::max(maxOrientationError, orientationError);
+
+        bool match = positionError <= reference.positionTolerance && velocityError <= reference.velocityTolerance
+                     && orientationError <= reference.orientationTolerance;
+        // NaNs never compare less or equal, so they end up as mismatches as well
+        if(!match) {
+            if(firstMismatch < 0) firstMismatch = static_cast<int>(i);
+            mismatches++;
+        }
+    }
+
+    bool identical = checksum() == reference.checksum();
+    std::cout << "Golden check: " << positions.size() << " particles after " << reference.steps << " steps | "
+              << (identical ? "bit identical" : "not bit identical") << " | max error position " << maxPositionError
+              << ", velocity " << maxVelocityError << ", orientation " << maxOrientationError << " rad" << std::endl;
+    if(mismatches > 0) {
+        std::cout << "Golden check FAILED: " << mismatches << " particles out of tolerance, first one is particle " << firstMismatch << std::endl;
+        return false;
+    }
+    std::cout << "Golden check passed" << std::endl;
+    return true;
+}
+
+int runGoldenMode(const CommandLineOptions &options, SdfCollider* colliders)
+{
+    GoldenState reference;
+    GoldenState result;
+    if(!options.goldenCheckPath.empty()) {
+        if(!reference.load(options.goldenCheckPath)) return 1;
+        result.params = reference.params;
+        result.steps = reference.steps;
+    }
+    else {
+        // same defaults as the interactive simulation, with the black holes frozen at their start positions
+        EmitterParams& params = result.params;
+        params.windForce = glm::vec3(0.0f);
+        params.blackHolePositions = {glm::vec3(6.0f, 6.35f, 0.0f), glm::vec3(-6.0f, 6.35f, 0.0f)};
+        params.blackHoleMass = 10.0f;
+        params.size = 1.0f;
+        params.gravity = 9.81f;
+        params.spiralingMotion = options.spiralingMotion;
+        params.tumbling = options.tumbling;
+        params.leafCount = options.leafCount;
+        params.emitRadius = 10.0f;
+        params.emitHeight = 15.0f;
+        params.shape = EmitterShape::circleShape;
+        params.particleShape = ParticleShape::pointShape;
+        params.sceneColliders = options.sceneColliders;
+        params.seed = options.seed;
+        result.steps = options.steps;
+    }
+
+    //the distance field is only built for scenarios that collide with it
+    if(result.params.sceneColliders && !colliders->isBuilt()) colliders->build(0.2f);
+    Emitter emitter(result.params);
+    emitter.setColliders(colliders);
+    Profiler::Start();
+    result.capture(emitter);
+    Profiler::Stop(1, "Seeded run of " + std::to_string(result.steps) + " steps");
+
+    if(options.goldenCheckPath.empty()) {
+        if(!result.save(options.goldenRecordPath)) return 1;
+        std::cout << "Golden state of " << result.params.leafCount << " particles after " << result.steps << " steps written to "
+                  << options.goldenRecordPath << " (checksum " << std::hex << result.checksum() << std::dec << ")" << std::endl;
+        return 0;
+    }
+    return result.compare(reference) ? 0 : 1;
+}
@@ -0,0 +1,106 @@
+#include "HeadlessContext.h"
+#include <iostream>
+#include <cstring>
+#include "GL/glew.h"
+
+#ifdef FLEAVES_HAS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+static bool hasExtension(const char* extensions, const char* name) {
+    if(extensions == nullptr) return false;
+    size_t length = std::strlen(name);
+    for (const char* p = std::strstr(extensions, name); p != nullptr; p = std::strstr(p + length, name)) {
+        if((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0')) return true;
+    }
+    return false;
+}
+
+bool HeadlessContext::create()
+{
+    destroy();
+    EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+    const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    if(getPlatformDisplay != nullptr && hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+        eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+    if(eglDisplay == EGL_NO_DISPLAY) eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    EGLint major, minor;
+    if(eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor)) {
+        std::cerr << "Headless: no EGL display available (error 0x" << std::hex << eglGetError() << std::dec << ")" << std::endl;
+        return false;
+    }
+    display = eglDisplay;
+    if(!hasExtension(eglQueryString(eglDisplay, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context")) {
+        std::cerr << "Headless: the EGL display does not support surfaceless contexts" << std::endl;
+        destroy();
+        return false;
+    }
+    if(!eglBindAPI(EGL_OPENGL_API)) {
+        std::cerr << "Headless: EGL does not support desktop OpenGL" << std::endl;
+        destroy();
+        return false;
+    }
+
+    //no config needed without a surface (EGL_KHR_no_config_context), otherwise take any config that can do desktop GL
+    EGLConfig config = EGL_NO_CONFIG_KHR;
+    if(!hasExtension(eglQueryString(eglDisplay, EGL_EXTENSIONS), "EGL_KHR_no_config_context")) {
+        const EGLint configAttributes[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+        EGLint configCount = 0;
+        eglChooseConfig(eglDisplay, configAttributes, &config, 1, &configCount);
+    }
+    const EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 5,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttributes);
+    if(eglContext == EGL_NO_CONTEXT || !eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext)) {
+        std::cerr << "Headless: could not create an OpenGL 4.5 core context (error 0x" << std::hex << eglGetError() << std::dec << ")" << std::endl;
+        if(eglContext != EGL_NO_CONTEXT) eglDestroyContext(eglDisplay, eglContext);
+        destroy();
+        return false;
+    }
+    context = eglContext;
+
+    //same as in the windowed path, GLEW may complain about the missing GLX display but the GL functions are loaded anyway
+    glewExperimental = GL_TRUE;
+    glewInit();
+    glGetError();
+
+    std::cout << "Headless EGL " << major << "." << minor << " | OpenGL " << glGetString(GL_VERSION) << " | " << glGetString(GL_RENDERER) << std::endl;
+    return true;
+}
+
+void HeadlessContext::destroy()
+{
+    if(display == nullptr) return;
+    EGLDisplay eglDisplay = static_cast<EGLDisplay>(display);
+    eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if(context != nullptr) eglDestroyContext(eglDisplay, static_cast<EGLContext>(context));
+    eglTerminate(eglDisplay);
+    display = nullptr;
+    context = nullptr;
+}
+
+#else
+
+bool HeadlessContext::create()
+{
+    std::cerr << "Headless mode is not available, this build has no EGL support (configure with -DWITH_EGL=ON)" << std::endl;
+    return false;
+}
+
+void HeadlessContext::destroy()
+{
+}
+
+#endif
+
+HeadlessContext::~HeadlessContext()
+{
+    destroy();
+}
@@ -0,0 +1,70 @@
+#include "ImageWriter.h"
+#include "stb_image_write.h"
+#include <fstream>
+#include <iostream>
+
+bool writePng(const std::filesystem::path &path, int width, int height, const uint8_t *rgba)
+{
+    //PNG rows go from top to bottom, the alpha channel is left out
+    size_t rowBytes = static_cast<size_t>(width) * 3;
+    std::vector<uint8_t> rgb(rowBytes * height);
+    for (int y = 0; y < height; y++) {
+        uint8_t* row = rgb.data() + y * rowBytes;
+        const uint8_t* source = rgba + static_cast<size_t>(height - 1 - y) * width * 4;
+        for (int x = 0; x < width; x++) {
+            row[x * 3] = source[x * 4];
+            row[x * 3 + 1] = source[x * 4 + 1];
+            row[x * 3 + 2] = source[x * 4 + 2];
+        }
+    }
+
+    //written through the callback, so the path doesn't have to survive a conversion to a narrow string
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if(!file) {
+        std::cerr << "Could not write " << path << std::endl;
+        return false;
+    }
+    auto write = [](void* context, void* data, int size) {
+        static_cast<std::ofstream*>(context)->write(static_cast<const char*>(data), size);
+    };
+    if(stbi_write_png_to_func(write, &file, width, height, 3, rgb.data(), static_cast<int>(rowBytes)) == 0) {
+        std::cerr << "Could not encode " << path << std::endl;
+        return false;
+    }
+    return static_cast<bool>(file);
+}
+
+void rgbaToI420(int width, int height, const uint8_t *rgba, std::vector<uint8_t> &yuv)
+{
+    size_t lumaSize = static_cast<size_t>(width) * height;
+    size_t chromaWidth = width / 2, chromaHeight = height / 2;
+    yuv.resize(lumaSize + 2 * chromaWidth * chromaHeight);
+    uint8_t* yPlane = yuv.data();
+    uint8_t* uPlane = yPlane + lumaSize;
+    uint8_t* vPlane = uPlane + chromaWidth * chromaHeight;
+
+    auto pixel = [&](int x, int y) { return rgba + (static_cast<size_t>(height - 1 - y) * width + x) * 4; };
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            const uint8_t* p = pixel(x, y);
+            yPlane[static_cast<size_t>(y) * width + x] = static_cast<uint8_t>(((66 * p[0] + 129 * p[1] + 25 * p[2] + 128) >> 8) + 16);
+        }
+    }
+    //chroma from the average of each 2x2 block
+    for (size_t cy = 0; cy < chromaHeight; cy++) {
+        for (size_t cx = 0; cx < chromaWidth; cx++) {
+            int r = 0, g = 0, b = 0;
+            for (int k = 0; k < 4; k++) {
+                const uint8_t* p = pixel(static_cast<int>(cx * 2 + (k & 1)), static_cast<int>(cy * 2 + (k >> 1)));
+                r += p[0];
+                g += p[1];
+                b += p[2];
+            }
+            r = (r + 2) / 4;
+            g = (g + 2) / 4;
+            b = (b + 2) / 4;
+            uPlane[cy * chromaWidth + cx] = static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            vPlane[cy * chromaWidth + cx] = static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+    }
+}
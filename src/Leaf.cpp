@@ -5,19 +5,15 @@ Leaf::Leaf(const glm::vec3 &rot)
     rotation = rot;
 }
 
-glm::mat4 &Leaf::getLeafModel()
+const glm::vec3& Leaf::getRotation() const
 {
-    model = glm::mat4(1.0);
-    model = glm::translate(model, glm::vec3{0, -1, 0});
-    model = glm::rotate(model, glm::radians(rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
-    model = glm::rotate(model, glm::radians(rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
-    model = glm::rotate(model, glm::radians(rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
-    return model;
+    return rotation;
 }
 
-const glm::vec3& Leaf::getRotation() const
+//rotation is stored as euler angles in degrees, the compute shader works with quaternions
+glm::quat Leaf::getOrientation() const
 {
-    return rotation;
+    return glm::quat(glm::radians(rotation));
 }
 
 Leaf::~Leaf()
@@ -0,0 +1,95 @@
+#include "MappedFile.h"
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+bool MappedFile::open(const std::filesystem::path &path)
+{
+    close();
+#ifdef _WIN32
+    HANDLE file = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if(file == INVALID_HANDLE_VALUE) {
+        std::cerr << "Could not open " << path << std::endl;
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+    fileHandle = file;
+    if(fileSize.QuadPart == 0) {
+        close();
+        return false;
+    }
+    mappingHandle = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(mappingHandle == nullptr) {
+        std::cerr << "Could not map " << path << std::endl;
+        close();
+        return false;
+    }
+    mappedData = static_cast<const unsigned char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    mappedSize = static_cast<size_t>(fileSize.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        std::cerr << "Could not open " << path << std::endl;
+        return false;
+    }
+    struct stat fileStat;
+    if(fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void* data = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    //the mapping keeps its own reference to the file
+    ::close(fd);
+    if(data == MAP_FAILED) {
+        std::cerr << "Could not map " << path << std::endl;
+        return false;
+    }
+    //the data is copied front to back, so let the kernel read ahead
+    madvise(data, fileStat.st_size, MADV_SEQUENTIAL);
+    mappedData = static_cast<const unsigned char*>(data);
+    mappedSize = static_cast<size_t>(fileStat.st_size);
+#endif
+    if(mappedData == nullptr) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+    if(mappedData != nullptr) UnmapViewOfFile(mappedData);
+    if(mappingHandle != nullptr) CloseHandle(mappingHandle);
+    if(fileHandle != nullptr) CloseHandle(fileHandle);
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+#else
+    if(mappedData != nullptr) munmap(const_cast<unsigned char*>(mappedData), mappedSize);
+#endif
+    mappedData = nullptr;
+    mappedSize = 0;
+}
+
+const unsigned char *MappedFile::data() const
+{
+    return mappedData;
+}
+
+size_t MappedFile::size() const
+{
+    return mappedSize;
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
@@ -3,7 +3,7 @@
 void Profiler::Start()
 {
     #if PROFILING_ACTIVE
-    m_startPoint = std::chrono::high_resolution_clock::now();
+    m_startPoints.push_back(std::chrono::high_resolution_clock::now());
     #endif
 }
 
@@ -15,7 +15,9 @@ void Profiler::Stop(int granularity)
     static long sum = 0;
 
     auto endPoint = std::chrono::high_resolution_clock::now();
-    auto start = std::chrono::time_point_cast<std::chrono::microseconds>(m_startPoint).time_since_epoch().count();
+    if(m_startPoints.empty()) return;
+    auto start = std::chrono::time_point_cast<std::chrono::microseconds>(m_startPoints.back()).time_since_epoch().count();
+    m_startPoints.pop_back();
     auto end = std::chrono::time_point_cast<std::chrono::microseconds>(endPoint).time_since_epoch().count();
     auto duration = end - start;
 
@@ -38,15 +40,19 @@ void Profiler::Stop(int granularity, const std::string msg)
     static long sum = 0;
 
     auto endPoint = std::chrono::high_resolution_clock::now();
-    auto start = std::chrono::time_point_cast<std::chrono::microseconds>(m_startPoint).time_since_epoch().count();
+    if(m_startPoints.empty()) return;
+    auto start = std::chrono::time_point_cast<std::chrono::microseconds>(m_startPoints.back()).time_since_epoch().count();
+    m_startPoints.pop_back();
     auto end = std::chrono::time_point_cast<std::chrono::microseconds>(endPoint).time_since_epoch().count();
     auto duration = end - start;
 
+    sum += duration;
+
     if(++callCount == granularity){
         long result = sum / granularity;
         std::cout << msg <<  " time elapsed (avg after " << granularity << " calls):" << result << "us" << " | " << result / 1000 << "ms" << std::endl;
         sum = 0;
-        result = 0;
+        callCount = 0;
     }
     #endif
 }
\ No newline at end of file
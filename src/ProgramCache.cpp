@@ -0,0 +1,149 @@
+#include "ProgramCache.h"
+#include "GL/glew.h"
+#include "MappedFile.h"
+#include <fstream>
+#include <iostream>
+#include <cstring>
+
+namespace {
+
+const char programCacheMagic[8] = {'F', 'L', 'P', 'R', 'O', 'G', 0, 0};
+const uint32_t programCacheVersion = 1;
+
+struct ProgramCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t binaryFormat; //driver specific, passed back to glProgramBinary
+    uint64_t key;
+    uint64_t binarySize;
+};
+static_assert(sizeof(ProgramCacheHeader) == 32, "the program cache header is written as is");
+
+uint64_t fnv1a(const void* data, size_t size, uint64_t hash) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+}
+
+bool ProgramCache::isSupported()
+{
+    if(supported < 0) {
+        GLint formatCount = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+        supported = formatCount > 0 ? 1 : 0;
+        if(!supported) std::cout << "The driver does not support program binaries, shaders are compiled at every start" << std::endl;
+    }
+    return supported == 1;
+}
+
+std::filesystem::path ProgramCache::filePath(const std::string &name)
+{
+    return directory / (name + ".bin");
+}
+
+void ProgramCache::setDirectory(const std::filesystem::path &directory)
+{
+    ProgramCache::directory = directory;
+}
+
+void ProgramCache::setEnabled(bool enabled)
+{
+    ProgramCache::enabled = enabled;
+}
+
+uint64_t ProgramCache::computeKey(const std::vector<std::string> &sources)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash = fnv1a(&programCacheVersion, sizeof(programCacheVersion), hash);
+    //binaries are only valid for the exact driver that produced them
+    for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+        const char* value = reinterpret_cast<const char*>(glGetString(name));
+        if(value != nullptr) hash = fnv1a(value, std::strlen(value) + 1, hash);
+    }
+    for (const std::string& source : sources) {
+        //the size separates the sources, so moving code from one stage to the other changes the key
+        uint64_t size = source.size();
+        hash = fnv1a(&size, sizeof(size), hash);
+        hash = fnv1a(source.data(), source.size(), hash);
+    }
+    return hash;
+}
+
+bool ProgramCache::load(const std::string &name, uint64_t key, unsigned int program)
+{
+    if(!enabled || !isSupported()) return false;
+    std::filesystem::path path = filePath(name);
+    std::error_code error;
+    if(!std::filesystem::exists(path, error)) return false;
+
+    MappedFile file;
+    if(!file.open(path)) return false;
+    ProgramCacheHeader header;
+    if(file.size() < sizeof(header)) return false;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if(std::memcmp(header.magic, programCacheMagic, sizeof(programCacheMagic)) != 0 || header.version != programCacheVersion
+       || header.key != key || header.binarySize != file.size() - sizeof(header)) {
+        return false; //outdated, gets replaced once the program is compiled
+    }
+
+    glProgramBinary(program, header.binaryFormat, file.data() + sizeof(header), static_cast<GLsizei>(header.binarySize));
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if(!linked) {
+        //the driver may reject binaries for reasons it doesn't put in the version string
+        std::cout << "Cached program " << name << " was rejected by the driver, compiling it again" << std::endl;
+        file.close();
+        std::filesystem::remove(path, error);
+        return false;
+    }
+    return true;
+}
+
+void ProgramCache::prepare(unsigned int program)
+{
+    if(enabled && isSupported()) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+void ProgramCache::store(const std::string &name, uint64_t key, unsigned int program)
+{
+    if(!enabled || !isSupported()) return;
+    GLint binarySize = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binarySize);
+    if(binarySize <= 0) return;
+
+    std::vector<char> binary(binarySize);
+    GLenum binaryFormat = 0;
+    GLsizei length = 0;
+    glGetProgramBinary(program, binarySize, &length, &binaryFormat, binary.data());
+    if(length <= 0) return;
+
+    ProgramCacheHeader header{};
+    std::memcpy(header.magic, programCacheMagic, sizeof(programCacheMagic));
+    header.version = programCacheVersion;
+    header.binaryFormat = binaryFormat;
+    header.key = key;
+    header.binarySize = static_cast<uint64_t>(length);
+
+    //written next to the final file and renamed, so a crash never leaves a half written binary behind
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    std::filesystem::path path = filePath(name);
+    std::filesystem::path temporaryPath = path;
+    temporaryPath += ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(binary.data(), length);
+        if(!file) {
+            std::cerr << "Could not write the program cache " << temporaryPath << std::endl;
+            return;
+        }
+    }
+    std::filesystem::rename(temporaryPath, path, error);
+    if(error) std::cerr << "Could not write the program cache " << path << ": " << error.message() << std::endl;
+}
@@ -0,0 +1,384 @@
+#include "SdfCollider.h"
+#include <charconv>
+
+//Closest point on triangle abc to p (Ericson, Real-Time Collision Detection 5.1.5)
+static glm::vec3 closestPointOnTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+    glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+    float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) return a;
+
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) return b;
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return a + ab * (d1 / (d1 - d3));
+
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) return c;
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return a + ac * (d2 / (d2 - d6));
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+    float denom = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+SdfCollider::SdfCollider()
+{
+    boundsMin = boundsMax = glm::vec3(0.0f);
+    dimensions = glm::ivec3(0);
+    cellSize = 1.0f;
+}
+
+void SdfCollider::addMesh(const std::vector<glm::vec3> &vertices, const std::vector<unsigned int> &indices, const glm::mat4 &transform)
+{
+    for (unsigned int index : indices)
+    {
+        triangles.push_back(glm::vec3(transform * glm::vec4(vertices[index], 1.0f)));
+    }
+    triangleMesh.insert(triangleMesh.end(), indices.size() / 3, meshCount);
+    meshCount++;
+}
+
+//Minimal Wavefront OBJ reader: only "v" and "f" lines are used, polygons are triangulated as fans
+bool SdfCollider::addObjFile(const std::filesystem::path &objPath, const glm::mat4 &transform)
+{
+    std::ifstream objFile(objPath);
+    if(!objFile.is_open()) {
+        std::cerr << "Failed to open collider mesh: " << objPath << std::endl;
+        return false;
+    }
+
+    std::vector<glm::vec3> vertices;
+    std::vector<unsigned int> indices;
+    std::string line;
+    while (std::getline(objFile, line))
+    {
+        std::istringstream lineStream(line);
+        std::string type;
+        lineStream >> type;
+        if(type == "v") {
+            glm::vec3 v;
+            lineStream >> v.x >> v.y >> v.z;
+            vertices.push_back(v);
+        }
+        else if(type == "f") {
+            std::vector<unsigned int> face;
+            std::string corner;
+            while (lineStream >> corner)
+            {
+                //"v", "v/vt", "v//vn" or "v/vt/vn", negative indices are relative to the vertices read so far
+                long long index = 0;
+                const char* end = corner.data() + std::min(corner.find('/'), corner.size());
+                std::from_chars_result parsed = std::from_chars(corner.data(), end, index);
+                if(parsed.ec == std::errc() && parsed.ptr == end && index < 0) index += static_cast<long long>(vertices.size()) + 1;
+                //positive indices may point at vertices further down, they are checked once the whole file is read
+                if(parsed.ec != std::errc() || parsed.ptr != end || index < 1 || index > std::numeric_limits<unsigned int>::max()) {
+                    std::cerr << "Invalid face corner \"" << corner << "\" in collider mesh " << objPath << std::endl;
+                    return false;
+                }
+                face.push_back(static_cast<unsigned int>(index - 1));
+            }
+            for (size_t i = 1; i + 1 < face.size(); i++)
+            {
+                indices.insert(indices.end(), {face[0], face[i], face[i + 1]});
+            }
+        }
+    }
+
+    for (unsigned int index : indices)
+    {
+        if(index >= vertices.size()) {
+            std::cerr << "Face references vertex " << index + 1 << " of " << vertices.size() << " in collider mesh " << objPath << std::endl;
+            return false;
+        }
+    }
+
+    addMesh(vertices, indices, transform);
+    std::cout << "Loaded collider mesh " << objPath.filename() << " | triangles: " << indices.size() / 3 << std::endl;
+    return true;
+}
+
+//A small house with a gable roof, a garden wall and a tree next to the emit area
+void SdfCollider::addDefaultScene()
+{
+    std::vector<glm::vec3>* points;
+    std::vector<unsigned int>* indices;
+
+    //house
+    points = generateBoxPoints(glm::vec3{2.5f, 1.5f, 2.0f});
+    indices = generateBoxIndices();
+    addMesh(*points, *indices, glm::translate(glm::mat4(1.0f), glm::vec3{4.0f, 1.5f, -3.0f}));
+    delete points; delete indices;
+
+    //roof, slightly larger than the house so leaves can land on the eaves
+    points = generateRoofPoints(6.0f, 4.6f, 2.0f);
+    indices = generateRoofIndices();
+    addMesh(*points, *indices, glm::translate(glm::mat4(1.0f), glm::vec3{4.0f, 3.0f, -3.0f}));
+    delete points; delete indices;
+
+    //garden wall
+    points = generateBoxPoints(glm::vec3{0.2f, 1.0f, 4.0f});
+    indices = generateBoxIndices();
+    addMesh(*points, *indices, glm::translate(glm::mat4(1.0f), glm::vec3{-5.0f, 1.0f, 2.0f}));
+    delete points; delete indices;
+
+    //tree: trunk and crown
+    points = generateCylinderPoints(12, 0.35f, 3.2f);
+    indices = generateCylinderIndices(12);
+    addMesh(*points, *indices, glm::translate(glm::mat4(1.0f), glm::vec3{-3.0f, 0.0f, -5.0f}));
+    delete points; delete indices;
+
+    points = generateSpherePoints(16, 10, 2.0f);
+    indices = generateSphereIndices(16, 10);
+    addMesh(*points, *indices, glm::translate(glm::mat4(1.0f), glm::vec3{-3.0f, 5.0f, -5.0f}));
+    delete points; delete indices;
+}
+
+int SdfCollider::voxelIndex(int x, int y, int z) const
+{
+    return (z * dimensions.y + y) * dimensions.x + x;
+}
+
+glm::vec3 SdfCollider::voxelCenter(int x, int y, int z) const
+{
+    return boundsMin + (glm::vec3(x, y, z) + 0.5f) * cellSize;
+}
+
+//Exact distances for all voxels within band cells of a triangle
+void SdfCollider::computeNarrowBand(std::vector<glm::vec3> &closestPoints, int band)
+{
+    for (size_t t = 0; t < triangles.size(); t += 3)
+    {
+        const glm::vec3 &a = triangles[t], &b = triangles[t + 1], &c = triangles[t + 2];
+        glm::vec3 triMin = glm::min(glm::min(a, b), c);
+        glm::vec3 triMax = glm::max(glm::max(a, b), c);
+        glm::ivec3 from = glm::ivec3(glm::floor((triMin - boundsMin) / cellSize)) - band;
+        glm::ivec3 to = glm::ivec3(glm::floor((triMax - boundsMin) / cellSize)) + band;
+        from = glm::max(from, glm::ivec3(0));
+        to = glm::min(to, dimensions - 1);
+
+        for (int z = from.z; z <= to.z; z++)
+            for (int y = from.y; y <= to.y; y++)
+                for (int x = from.x; x <= to.x; x++)
+                {
+                    glm::vec3 p = voxelCenter(x, y, z);
+                    glm::vec3 closest = closestPointOnTriangle(p, a, b, c);
+                    float d = glm::distance(p, closest);
+                    int i = voxelIndex(x, y, z);
+                    if(d < distances[i]) {
+                        distances[i] = d;
+                        closestPoints[i] = closest;
+                    }
+                }
+    }
+}
+
+//Fast sweeping over the grid: every voxel checks if the closest surface point of a neighbour is closer than its own.
+//Sweeping in all 8 diagonal directions carries the closest points through the whole volume
+void SdfCollider::propagateDistances(std::vector<glm::vec3> &closestPoints)
+{
+    for (int sweep = 0; sweep < 8; sweep++)
+    {
+        int dx = (sweep & 1) ? -1 : 1, dy = (sweep & 2) ? -1 : 1, dz = (sweep & 4) ? -1 : 1;
+        for (int iz = 0; iz < dimensions.z; iz++)
+            for (int iy = 0; iy < dimensions.y; iy++)
+                for (int ix = 0; ix < dimensions.x; ix++)
+                {
+                    int x = dx > 0 ? ix : dimensions.x - 1 - ix;
+                    int y = dy > 0 ? iy : dimensions.y - 1 - iy;
+                    int z = dz > 0 ? iz : dimensions.z - 1 - iz;
+                    int i = voxelIndex(x, y, z);
+                    glm::vec3 p = voxelCenter(x, y, z);
+
+                    //the three neighbours we already visited in this sweep direction
+                    const int neighbours[3][3] = {{x - dx, y, z}, {x, y - dy, z}, {x, y, z - dz}};
+                    for (const auto& n : neighbours)
+                    {
+                        if(n[0] < 0 || n[1] < 0 || n[2] < 0 || n[0] >= dimensions.x || n[1] >= dimensions.y || n[2] >= dimensions.z) continue;
+                        int j = voxelIndex(n[0], n[1], n[2]);
+                        if(distances[j] == std::numeric_limits<float>::max()) continue;
+                        float d = glm::distance(p, closestPoints[j]);
+                        if(d < distances[i]) {
+                            distances[i] = d;
+                            closestPoints[i] = closestPoints[j];
+                        }
+                    }
+                }
+    }
+}
+
+//Casts one ray per grid row along +x and counts the crossings of every mesh, voxels after an odd number of crossings
+//of any mesh are inside. The rays are offset by a tiny amount so they never run exactly through the edges of the generated meshes
+void SdfCollider::computeSigns()
+{
+    const glm::vec2 jitter = glm::vec2(0.000137f, 0.000291f) * cellSize;
+    std::vector<std::pair<float, int>> hits; //x coordinate of the crossing and the mesh that was crossed
+    std::vector<bool> insideMesh(meshCount);
+    for (int z = 0; z < dimensions.z; z++)
+        for (int y = 0; y < dimensions.y; y++)
+        {
+            glm::vec3 origin = voxelCenter(0, y, z);
+            float oy = origin.y + jitter.x, oz = origin.z + jitter.y;
+
+            hits.clear();
+            for (size_t t = 0; t < triangles.size(); t += 3)
+            {
+                //2D point in triangle test in the yz plane, then intersect with the triangle's plane
+                const glm::vec3 &a = triangles[t], &b = triangles[t + 1], &c = triangles[t + 2];
+                float e0 = (b.y - a.y) * (oz - a.z) - (b.z - a.z) * (oy - a.y);
+                float e1 = (c.y - b.y) * (oz - b.z) - (c.z - b.z) * (oy - b.y);
+                float e2 = (a.y - c.y) * (oz - c.z) - (a.z - c.z) * (oy - c.y);
+                bool inside = (e0 >= 0 && e1 >= 0 && e2 >= 0) || (e0 <= 0 && e1 <= 0 && e2 <= 0);
+                if(!inside) continue;
+
+                glm::vec3 normal = glm::cross(b - a, c - a);
+                if(std::abs(normal.x) < 1e-12f) continue; //parallel to the ray
+                float hitX = a.x - (normal.y * (oy - a.y) + normal.z * (oz - a.z)) / normal.x;
+                hits.push_back({hitX, triangleMesh[t / 3]});
+            }
+            std::sort(hits.begin(), hits.end());
+
+            std::fill(insideMesh.begin(), insideMesh.end(), false);
+            int insideCount = 0;
+            size_t crossings = 0;
+            for (int x = 0; x < dimensions.x; x++)
+            {
+                float px = voxelCenter(x, y, z).x;
+                for (; crossings < hits.size() && hits[crossings].first < px; crossings++)
+                {
+                    int mesh = hits[crossings].second;
+                    insideMesh[mesh] = !insideMesh[mesh];
+                    insideCount += insideMesh[mesh] ? 1 : -1;
+                }
+                if(insideCount > 0) distances[voxelIndex(x, y, z)] *= -1.0f;
+            }
+        }
+}
+
+void SdfCollider::build(float cellSize)
+{
+    if(triangles.empty()) {
+        std::cerr << "SdfCollider::build called without any meshes" << std::endl;
+        return;
+    }
+    Profiler::Start();
+
+    this->cellSize = cellSize;
+    boundsMin = glm::vec3(std::numeric_limits<float>::max());
+    boundsMax = glm::vec3(std::numeric_limits<float>::lowest());
+    for (const glm::vec3& v : triangles)
+    {
+        boundsMin = glm::min(boundsMin, v);
+        boundsMax = glm::max(boundsMax, v);
+    }
+    //a few cells of padding so the gradient is still defined around the outside of the meshes
+    boundsMin -= glm::vec3(3.0f * cellSize);
+    boundsMax += glm::vec3(3.0f * cellSize);
+    dimensions = glm::ivec3(glm::ceil((boundsMax - boundsMin) / cellSize));
+    boundsMax = boundsMin + glm::vec3(dimensions) * cellSize;
+
+    std::vector<glm::vec3> closestPoints(dimensions.x * dimensions.y * dimensions.z);
+    distances.assign(closestPoints.size(), std::numeric_limits<float>::max());
+
+    computeNarrowBand(closestPoints, 2);
+    propagateDistances(closestPoints);
+    computeSigns();
+
+    //Upload the distance field, linear filtering gives us the trilinear interpolation for free
+    if(sdfTexture == 0) glGenTextures(1, &sdfTexture);
+    glBindTexture(GL_TEXTURE_3D, sdfTexture);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_R32F, dimensions.x, dimensions.y, dimensions.z, 0, GL_RED, GL_FLOAT, distances.data());
+    glBindTexture(GL_TEXTURE_3D, 0);
+    getErrorCode();
+
+    //Mesh for drawing the colliders
+    if(meshVAO == 0) {
+        glGenVertexArrays(1, &meshVAO);
+        glGenBuffers(1, &meshVBO);
+        meshShader.createProgram("./../shaders/collider_vertex.glsl", "./../shaders/collider_fragment.glsl");
+    }
+    glBindVertexArray(meshVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, meshVBO);
+    glBufferData(GL_ARRAY_BUFFER, triangles.size() * sizeof(glm::vec3), triangles.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+    glEnableVertexAttribArray(0);
+    glBindVertexArray(0);
+
+    built = true;
+    std::cout << "Built collider SDF | triangles: " << triangles.size() / 3 << " voxels: " << dimensions.x << "x" << dimensions.y << "x" << dimensions.z << std::endl;
+    Profiler::Stop(1, "SDF build");
+}
+
+void SdfCollider::draw(const glm::mat4 &view, const glm::mat4 &projection)
+{
+    if(!built) return;
+    glUseProgram(meshShader.ID);
+    meshShader.setMatrix4("view", view);
+    meshShader.setMatrix4("projection", projection);
+    glBindVertexArray(meshVAO);
+    glDrawArrays(GL_TRIANGLES, 0, triangles.size());
+}
+
+bool SdfCollider::isBuilt() const
+{
+    return built;
+}
+
+int SdfCollider::getMeshCount() const
+{
+    return meshCount;
+}
+
+std::vector<glm::vec3> SdfCollider::getMeshTriangles(int mesh) const
+{
+    std::vector<glm::vec3> meshTriangles;
+    for (size_t t = 0; t < triangleMesh.size(); t++) {
+        if(triangleMesh[t] != mesh) continue;
+        meshTriangles.insert(meshTriangles.end(), triangles.begin() + t * 3, triangles.begin() + t * 3 + 3);
+    }
+    //the distance field doesn't care about the winding, the users of the triangles do: a closed mesh wound inwards has a
+    //negative signed volume, flip it so every normal points out
+    float volume = 0.0f;
+    for (size_t t = 0; t + 2 < meshTriangles.size(); t += 3)
+        volume += glm::dot(meshTriangles[t], glm::cross(meshTriangles[t + 1], meshTriangles[t + 2]));
+    if(volume < 0.0f) {
+        for (size_t t = 0; t + 2 < meshTriangles.size(); t += 3) std::swap(meshTriangles[t + 1], meshTriangles[t + 2]);
+    }
+    return meshTriangles;
+}
+
+unsigned int SdfCollider::getTexture() const
+{
+    return sdfTexture;
+}
+
+const glm::vec3 &SdfCollider::getBoundsMin() const
+{
+    return boundsMin;
+}
+
+const glm::vec3 &SdfCollider::getBoundsMax() const
+{
+    return boundsMax;
+}
+
+glm::vec3 SdfCollider::getTexelSize() const
+{
+    return 1.0f / glm::vec3(dimensions);
+}
+
+SdfCollider::~SdfCollider()
+{
+}
@@ -1,14 +1,61 @@
 #include "Shader.h"
+#include "ProgramCache.h"
+#include <thread>
+#include <chrono>
+
+//Reads a shader file and replaces every line of the form #include "file" with the contents of that file (relative to the including shader).
+//This lets shaders share code with each other and with the CPU, e.g. random.glsl
+static bool readShaderSource(const std::filesystem::path& shaderPath, std::string& source, int depth = 0)
+{
+    if(depth > 8) {
+        std::cerr << "Shader includes nested too deeply: " << shaderPath << std::endl;
+        return false;
+    }
+    std::ifstream shaderFile(shaderPath);
+    if (!shaderFile.is_open()) {
+        std::cerr << "Failed to open shader file: " << shaderPath << std::endl;
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(shaderFile, line))
+    {
+        size_t start = line.find_first_not_of(" \t");
+        if(start != std::string::npos && line.compare(start, 8, "#include") == 0) {
+            size_t open = line.find('"', start), close = line.rfind('"');
+            if(open == std::string::npos || close <= open) {
+                std::cerr << "Malformed include in " << shaderPath << ": " << line << std::endl;
+                return false;
+            }
+            std::filesystem::path includePath = shaderPath.parent_path() / line.substr(open + 1, close - open - 1);
+            if(!readShaderSource(includePath, source, depth + 1)) return false;
+        }
+        else {
+            source += line;
+            source += '\n';
+        }
+    }
+    return true;
+}
 
 Shader::Shader()
 {
 
 }
 
+bool Shader::enableParallelCompile()
+{
+    if(parallelCompile < 0) {
+        parallelCompile = GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile ? 1 : 0;
+        //as many compiler threads as the driver wants to use
+        if(GLEW_KHR_parallel_shader_compile) glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        else if(GLEW_ARB_parallel_shader_compile) glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+    }
+    return parallelCompile == 1;
+}
+
 void Shader::createProgram(std::filesystem::path vShaderPath, std::filesystem::path fShaderPath)
 {
-    std::fstream vShaderFile, fShaderFile;
-    std::stringstream vShaderStream, fShaderStream;
     std::string vShaderString, fShaderString;
 
     if (!std::filesystem::exists(vShaderPath)) {
@@ -20,121 +67,154 @@ void Shader::createProgram(std::filesystem::path vShaderPath, std::filesystem::p
         return; // or throw an exception
     }
 
-    vShaderFile.open(vShaderPath);
-    fShaderFile.open(fShaderPath);
-
-    // Check if files opened successfully
-    if (!vShaderFile.is_open()) {
-        std::cerr << "Failed to open vertex shader file: " << vShaderPath << std::endl;
-        return;
-    }
-    if (!fShaderFile.is_open()) {
-        std::cerr << "Failed to open fragment shader file: " << fShaderPath << std::endl;
-        vShaderFile.close(); // Clean up the other file
+    if (!readShaderSource(vShaderPath, vShaderString) || !readShaderSource(fShaderPath, fShaderString)) {
         return;
     }
-    
-    vShaderStream << vShaderFile.rdbuf();
-    fShaderStream << fShaderFile.rdbuf();
 
     //Can't do the following line! the string returned by getShaderText is temporary and gets destroyed after this line
     //const char* shaderText = getShaderText(vertexShaderPath).c_str();
 
-    vShaderString = vShaderStream.str();
-    fShaderString = fShaderStream.str();
+    //a cached binary of the exact same sources skips compiling and linking
+    cacheName = vShaderPath.stem().string() + "+" + fShaderPath.stem().string();
+    cacheKey = ProgramCache::computeKey({vShaderString, fShaderString});
+    ID = glCreateProgram();
+    if(ProgramCache::load(cacheName, cacheKey, ID)) {
+        linked = true;
+        return;
+    }
+    enableParallelCompile();
 
     const char* vShader = vShaderString.c_str();
     const char* fShader = fShaderString.c_str();
 
-    
+    //no status queries here, they would wait for the compiler
     vS = glCreateShader(GL_VERTEX_SHADER);
     glShaderSource(vS, 1, &vShader, NULL);
     glCompileShader(vS);
 
-    int success;
-    char infoLog[512];
-    glGetShaderiv(vS, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(vS, 512, NULL, infoLog);
-        std::cerr << "ERROR::VERTEX_SHADER_COMPILATION_FAILED\n" << infoLog << std::endl;
-    }
-
     fS = glCreateShader(GL_FRAGMENT_SHADER);
     glShaderSource(fS, 1, &fShader, NULL);
     glCompileShader(fS);
 
-    glGetShaderiv(fS, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(fS, 512, NULL, infoLog);
-        std::cerr << "ERROR::FRAGMENT_SHADER_COMPILATION_FAILED\n" << infoLog << std::endl;
-    }
-
-
-    ID = glCreateProgram();
-
     glAttachShader(ID, vS);
     glAttachShader(ID, fS);
-
-    glLinkProgram(ID);
-    
-
-    glDeleteShader(vS);
-    glDeleteShader(fS);
-    vS = fS = 0;
-
+    submit();
 }
 
 void Shader::createComputeProgram(std::filesystem::path computeShaderPath)
 {
-    std::fstream computeShaderFile;
-    std::stringstream computeShaderStream;
         if (!std::filesystem::exists(computeShaderPath)) {
         std::cerr << "compute shader file not found: " << computeShaderPath << std::endl;
         return; // or throw an exception
     }
 
-    computeShaderFile.open(computeShaderPath);
-    if(!computeShaderFile.is_open()){
-        std::cerr << "Failed to open compute shader file: " << computeShaderPath << std::endl;
+    std::string computeShader;
+    if(!readShaderSource(computeShaderPath, computeShader)){
         return;
     }
-    
-    computeShaderStream << computeShaderFile.rdbuf();
-    std::string computeShader = computeShaderStream.str();
+    cacheName = computeShaderPath.stem().string();
+    cacheKey = ProgramCache::computeKey({computeShader});
+    ID = glCreateProgram();
+    if(ProgramCache::load(cacheName, cacheKey, ID)) {
+        linked = true;
+        return;
+    }
+    enableParallelCompile();
+
     const char* computeShaderText = computeShader.c_str();
 
-    unsigned int compute = glCreateShader(GL_COMPUTE_SHADER);
-    glShaderSource(compute, 1, &computeShaderText, NULL);
-    glCompileShader(compute);
+    cS = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(cS, 1, &computeShaderText, NULL);
+    glCompileShader(cS);
+
+    glAttachShader(ID, cS);
+    submit();
+}
+
+void Shader::submit()
+{
+    ProgramCache::prepare(ID);
+    //linking right away lets the driver compile and link in one go on its own threads
+    glLinkProgram(ID);
+    pending = true;
+    pendingShaders.push_back(this);
+}
+
+bool Shader::isReady() const
+{
+    if(!pending || parallelCompile != 1) return true;
+    GLint complete = GL_FALSE;
+    glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &complete);
+    return complete == GL_TRUE;
+}
+
+bool Shader::finish()
+{
+    if(!pending) return linked;
+    pending = false;
+    std::erase(pendingShaders, this);
 
     int success;
     char infoLog[512];
-    glGetShaderiv(compute, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(compute, 512, NULL, infoLog);
-        std::cerr << "ERROR::COMPUTE_SHADER_COMPILATION_FAILED\n" << infoLog << std::endl;
+    const std::pair<unsigned int, const char*> stages[] = {
+        {vS, "ERROR::VERTEX_SHADER_COMPILATION_FAILED"},
+        {fS, "ERROR::FRAGMENT_SHADER_COMPILATION_FAILED"},
+        {cS, "ERROR::COMPUTE_SHADER_COMPILATION_FAILED"}
+    };
+    for (const auto& [stage, message] : stages) {
+        if(stage == 0) continue;
+        glGetShaderiv(stage, GL_COMPILE_STATUS, &success);
+        if (!success) {
+            glGetShaderInfoLog(stage, 512, NULL, infoLog);
+            std::cerr << message << " (" << cacheName << ")\n" << infoLog << std::endl;
+        }
+        glDetachShader(ID, stage);
+        glDeleteShader(stage);
     }
+    vS = fS = cS = 0;
 
-    ID = glCreateProgram();
-    glAttachShader(ID, compute);
-    glLinkProgram(ID);
-
+    glGetProgramiv(ID, GL_LINK_STATUS, &success);
+    linked = success;
+    if (!success) {
+        glGetProgramInfoLog(ID, 512, NULL, infoLog);
+        std::cerr << "ERROR::PROGRAM_LINKING_FAILED (" << cacheName << ")\n" << infoLog << std::endl;
+        return false;
+    }
+    ProgramCache::store(cacheName, cacheKey, ID);
+    return true;
+}
 
+void Shader::finishPending()
+{
+    while (!pendingShaders.empty()) {
+        //whatever the driver finished first, so the error checks and cache writes overlap with the remaining compiles
+        Shader* ready = nullptr;
+        for (Shader* shader : pendingShaders) {
+            if(shader->isReady()) {
+                ready = shader;
+                break;
+            }
+        }
+        if(ready != nullptr) ready->finish();
+        else std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
 }
 
 Shader::~Shader()
 {
+    std::erase(pendingShaders, this);
 }
 
 void Shader::useTexture(const Texture &texture, std::string samplerName)
 {
     glActiveTexture(GL_TEXTURE0 + texture.getTextureUnit());
-    glBindTexture(GL_TEXTURE_2D, texture.getHandle());
+    glBindTexture(texture.getTarget(), texture.getHandle());
     setInt(samplerName, texture.getTextureUnit());
 }
 
 const void Shader::setBool(const std::string &name, bool value)
 {
+    if(pending) finish();
     glUseProgram(ID);
 
     int uniformLocation = glGetUniformLocation(ID, name.c_str());
@@ -148,6 +228,7 @@ const void Shader::setBool(const std::string &name, bool value)
 
 const void Shader::setInt(const std::string &name, int value)
 {
+    if(pending) finish();
     glUseProgram(ID);
 
     int uniformLocation = glGetUniformLocation(ID, name.c_str());
@@ -159,8 +240,23 @@ const void Shader::setInt(const std::string &name, int value)
     glUniform1i(uniformLocation, value); //setting the uniform
 }
 
+const void Shader::setUInt(const std::string &name, unsigned int value)
+{
+    if(pending) finish();
+    glUseProgram(ID);
+
+    int uniformLocation = glGetUniformLocation(ID, name.c_str());
+        if (uniformLocation == -1) {
+        std::cerr << "ERROR::SHADER::UNIFORM_NOT_FOUND: " << name << std::endl;
+        return; 
+    }
+
+    glUniform1ui(uniformLocation, value); //setting the uniform
+}
+
 const void Shader::setFloat(const std::string &name, float value)
 {
+    if(pending) finish();
     glUseProgram(ID);
 
     int uniformLocation = glGetUniformLocation(ID, name.c_str());
@@ -175,6 +271,7 @@ const void Shader::setFloat(const std::string &name, float value)
 
 const void Shader::setVec3f(const std::string &name, glm::vec3 value)
 {
+    if(pending) finish();
     glUseProgram(ID);
 
      int uniformLocation = glGetUniformLocation(ID, name.c_str());
@@ -187,6 +284,7 @@ const void Shader::setVec3f(const std::string &name, glm::vec3 value)
 }
 
 const void Shader::setMatrix4(const std::string& name, glm::mat4 matrix) {
+    if(pending) finish();
     glUseProgram(ID);
 
      int uniformLocation = glGetUniformLocation(ID, name.c_str());
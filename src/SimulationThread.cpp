@@ -0,0 +1,304 @@
+#include "SimulationThread.h"
+#include <iostream>
+#include <algorithm>
+
+SimulationThread::SimulationThread(Emitter &emitter) : emitter(emitter)
+{
+}
+
+bool SimulationThread::start(std::function<bool()> makeCurrent, std::function<void()> doneCurrent)
+{
+    if(threaded) return true;
+    //everything the main context created so far has to be complete before the other context uses it
+    glFinish();
+    quit = false;
+    needsPublish = true;
+    published = inUse = -1;
+
+    std::mutex startMutex;
+    std::condition_variable started;
+    int result = -1;
+    thread = std::thread([this, makeCurrent, doneCurrent, &startMutex, &started, &result] {
+        bool current = makeCurrent();
+        {
+            //notified under the lock, start() returns and destroys both as soon as it sees the result
+            std::lock_guard<std::mutex> lock(startMutex);
+            result = current ? 1 : 0;
+            started.notify_one();
+        }
+        if(current) loop(makeCurrent, doneCurrent);
+    });
+    std::unique_lock<std::mutex> lock(startMutex);
+    started.wait(lock, [&result] { return result >= 0; });
+    if(result == 0) {
+        lock.unlock();
+        thread.join();
+        std::cerr << "The simulation thread could not make its context current, the simulation runs on the render thread" << std::endl;
+        return false;
+    }
+    threaded = true;
+    std::cout << "Simulation runs on its own thread" << std::endl;
+    return true;
+}
+
+void SimulationThread::loop(std::function<bool()> makeCurrent, std::function<void()> doneCurrent)
+{
+    for (Slot& slot : slots) {
+        glCreateBuffers(1, &slot.buffers.positions);
+        glCreateBuffers(1, &slot.buffers.previousPositions);
+        glCreateBuffers(1, &slot.buffers.orientations);
+        glCreateBuffers(1, &slot.buffers.drawList);
+        glCreateBuffers(1, &slot.buffers.aliveCounts);
+        glNamedBufferData(slot.buffers.aliveCounts, maxEmitters * sizeof(unsigned int), nullptr, GL_DYNAMIC_COPY);
+    }
+    //query objects aren't shared between contexts
+    glGenQueries(queryCount, queries);
+    nextQuery = pendingQueries = 0;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [this] {
+            return quit || !commands.empty() || framePending || updatesDone < updatesQueued || (needsPublish && freeSlot() >= 0);
+        });
+        if(quit) break;
+
+        std::vector<std::function<void(Emitter&)>> queued = std::move(commands);
+        commands.clear();
+        uint64_t updateTicket = updatesQueued;
+        float dT = std::min(pendingTime, maxCatchUp);
+        pendingTime = 0.0f;
+        unpublishedTime += dT;
+        float frameTime = pendingFrameTime;
+        pendingFrameTime = 0.0f;
+        framePending = false;
+        EmitterParams stepParams = params;
+        lock.unlock();
+
+        for (const auto& command : queued) command(emitter);
+        bool changed = !queued.empty();
+        if(poll) changed = poll(emitter, frameTime) || changed;
+        if(dT > 0.0f) {
+            unsigned int stepBefore = emitter.getStepIndex();
+            //with all queries in flight the update goes unmeasured
+            bool timed = pendingQueries < queryCount;
+            if(timed) glBeginQuery(GL_TIME_ELAPSED, queries[nextQuery]);
+            emitter.update(dT, stepParams);
+            if(timed) {
+                glEndQuery(GL_TIME_ELAPSED);
+                nextQuery = (nextQuery + 1) % queryCount;
+                pendingQueries++;
+            }
+            changed = changed || emitter.getStepIndex() != stepBefore;
+        }
+        float measured = collectQueries();
+
+        lock.lock();
+        gpuTime += measured;
+        needsPublish = needsPublish || changed;
+        int target = needsPublish ? freeSlot() : -1;
+        if(target >= 0) {
+            lock.unlock();
+            publish(target);
+            lock.lock();
+            published = target;
+            needsPublish = false;
+            unpublishedTime = 0.0f;
+        }
+        commandsDone += queued.size();
+        updatesDone = std::max(updatesDone, updateTicket);
+        done.notify_all();
+    }
+    lock.unlock();
+
+    glFinish();
+    glDeleteQueries(queryCount, queries);
+    for (Slot& slot : slots) {
+        if(slot.written != nullptr) glDeleteSync(slot.written);
+        if(slot.read != nullptr) glDeleteSync(slot.read);
+        glDeleteBuffers(1, &slot.buffers.positions);
+        glDeleteBuffers(1, &slot.buffers.previousPositions);
+        glDeleteBuffers(1, &slot.buffers.orientations);
+        glDeleteBuffers(1, &slot.buffers.drawList);
+        glDeleteBuffers(1, &slot.buffers.aliveCounts);
+        slot = Slot();
+    }
+    doneCurrent();
+}
+
+//the newest state is never overwritten and the slot being drawn is left alone, with two slots that may leave none
+int SimulationThread::freeSlot() const
+{
+    for (int i = 0; i < 2; i++) {
+        if(i != published && i != inUse) return i;
+    }
+    return -1;
+}
+
+void SimulationThread::publish(int target)
+{
+    Slot& slot = slots[target];
+    //the render loop may still be drawing the last frame from this slot on the GPU
+    if(slot.read != nullptr) {
+        glWaitSync(slot.read, 0, GL_TIMEOUT_IGNORED);
+        glDeleteSync(slot.read);
+        slot.read = nullptr;
+    }
+    //only the active particles are copied, the frozen ones between them are never drawn. The draw list of an emitter
+    //is never longer than its active particles
+    std::vector<ParticleRange> ranges = emitter.getActiveRanges();
+    ParticleBuffers source = emitter.getParticleBuffers();
+    int end = 0;
+    for (const ParticleRange& range : ranges) end = std::max(end, range.first + range.count);
+    if(end > slot.capacity) {
+        glNamedBufferData(slot.buffers.positions, end * sizeof(glm::vec4), nullptr, GL_DYNAMIC_COPY);
+        glNamedBufferData(slot.buffers.previousPositions, end * sizeof(glm::vec4), nullptr, GL_DYNAMIC_COPY);
+        glNamedBufferData(slot.buffers.orientations, end * sizeof(glm::uvec4), nullptr, GL_DYNAMIC_COPY);
+        glNamedBufferData(slot.buffers.drawList, end * sizeof(unsigned int), nullptr, GL_DYNAMIC_COPY);
+        slot.capacity = end;
+    }
+    //the compute shader wrote the particles, the copies read them as buffer data
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    for (const ParticleRange& range : ranges) {
+        if(range.count <= 0) continue;
+        GLintptr vec4Offset = range.first * sizeof(glm::vec4), uvec4Offset = range.first * sizeof(glm::uvec4);
+        GLintptr indexOffset = range.first * sizeof(unsigned int);
+        glCopyNamedBufferSubData(source.positions, slot.buffers.positions, vec4Offset, vec4Offset, range.count * sizeof(glm::vec4));
+        glCopyNamedBufferSubData(source.previousPositions, slot.buffers.previousPositions, vec4Offset, vec4Offset, range.count * sizeof(glm::vec4));
+        glCopyNamedBufferSubData(source.orientations, slot.buffers.orientations, uvec4Offset, uvec4Offset, range.count * sizeof(glm::uvec4));
+        glCopyNamedBufferSubData(source.drawList, slot.buffers.drawList, indexOffset, indexOffset, range.count * sizeof(unsigned int));
+    }
+    glCopyNamedBufferSubData(source.aliveCounts, slot.buffers.aliveCounts, 0, 0, maxEmitters * sizeof(unsigned int));
+    if(slot.written != nullptr) glDeleteSync(slot.written);
+    slot.written = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.ranges = ranges;
+    slot.accumulated = emitter.getAccumulatedTime();
+    slot.fixedDT = emitter.getFixedDT();
+    //the fence only ever signals for the other context once it is flushed
+    glFlush();
+}
+
+//the finished timer queries in order, without waiting for the GPU
+float SimulationThread::collectQueries()
+{
+    float seconds = 0.0f;
+    while (pendingQueries > 0) {
+        int oldest = (nextQuery - pendingQueries + queryCount) % queryCount;
+        GLint available = 0;
+        glGetQueryObjectiv(queries[oldest], GL_QUERY_RESULT_AVAILABLE, &available);
+        if(!available) break;
+        GLuint64 elapsedNs = 0;
+        glGetQueryObjectui64v(queries[oldest], GL_QUERY_RESULT, &elapsedNs);
+        pendingQueries--;
+        seconds += elapsedNs * 1e-9f;
+    }
+    return seconds;
+}
+
+float SimulationThread::takeGpuTime()
+{
+    if(!threaded) return 0.0f;
+    std::lock_guard<std::mutex> lock(mutex);
+    float seconds = gpuTime;
+    gpuTime = 0.0f;
+    return seconds;
+}
+
+void SimulationThread::run(const std::function<void(Emitter&)> &command)
+{
+    if(!threaded) {
+        command(emitter);
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    commands.push_back(command);
+    uint64_t ticket = ++commandsQueued;
+    wake.notify_one();
+    done.wait(lock, [this, ticket] { return commandsDone >= ticket; });
+}
+
+void SimulationThread::setPoll(std::function<bool(Emitter&, float)> poll)
+{
+    this->poll = std::move(poll);
+}
+
+void SimulationThread::frame(float dT)
+{
+    if(!threaded) {
+        if(poll) poll(emitter, dT);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    pendingFrameTime += dT;
+    framePending = true;
+    wake.notify_one();
+}
+
+void SimulationThread::update(float dT, const EmitterParams &params)
+{
+    if(!threaded) {
+        emitter.update(dT, params);
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    this->params = params;
+    pendingTime += dT;
+    uint64_t ticket = ++updatesQueued;
+    wake.notify_one();
+    if(lockstep) {
+        //the frame has to show exactly this state, so wait until it is published as well
+        done.wait(lock, [this, ticket] { return updatesDone >= ticket && !needsPublish; });
+    }
+}
+
+void SimulationThread::setLockstep(bool lockstep)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    this->lockstep = lockstep;
+}
+
+void SimulationThread::draw(const glm::mat4 &view, const glm::mat4 &projection, const EmitterParams &params)
+{
+    if(!threaded) {
+        emitter.draw(view, projection, params);
+        return;
+    }
+    Slot slot;
+    float interpolation;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(published < 0) return;
+        inUse = published;
+        slot = slots[inUse];
+        //the time the render loop has handed over since the slot was written, a slot can't be blended past its last step
+        interpolation = std::min((slot.accumulated + unpublishedTime + pendingTime) / slot.fixedDT, 1.0f);
+    }
+    //waits on the GPU for the copy, the CPU goes on recording the frame
+    glWaitSync(slot.written, 0, GL_TIMEOUT_IGNORED);
+    emitter.draw(view, projection, params, slot.buffers, slot.ranges, interpolation, slot.fixedDT);
+    GLsync read = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(slots[inUse].read != nullptr) glDeleteSync(slots[inUse].read);
+        slots[inUse].read = read;
+        inUse = -1;
+    }
+    wake.notify_one();
+}
+
+void SimulationThread::stop()
+{
+    if(!threaded) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wake.notify_one();
+    thread.join();
+    threaded = false;
+}
+
+SimulationThread::~SimulationThread()
+{
+    stop();
+}
@@ -0,0 +1,254 @@
+#include "Snapshot.h"
+#include <fstream>
+#include <cstring>
+#include <chrono>
+#include <type_traits>
+
+static const char snapshotMagic[8] = "FLSNAP";
+static const uint32_t snapshotVersion = 4;
+
+static_assert(std::is_trivially_copyable_v<SnapshotHeader>, "the header is written and read as raw bytes");
+static_assert(std::is_trivially_copyable_v<SnapshotEmitter>, "the emitters are written and read as raw bytes");
+static_assert(sizeof(SnapshotHeader) % 16 == 0 && sizeof(SnapshotEmitter) % 16 == 0, "keeps the sections 16 byte aligned");
+
+bool SnapshotWriter::save(const Emitter &emitter, const EmitterParams &params, const std::filesystem::path &path)
+{
+    if(isBusy()) {
+        std::cout << "Still saving the last snapshot, try again in a moment" << std::endl;
+        return false;
+    }
+    if(writerThread.joinable()) writerThread.join();
+
+    uint64_t count = static_cast<uint64_t>(emitter.getParticleCount());
+    header = SnapshotHeader{};
+    std::memcpy(header.magic, snapshotMagic, sizeof(snapshotMagic));
+    header.version = snapshotVersion;
+    header.headerSize = sizeof(SnapshotHeader);
+    header.particleCount = count;
+    header.stepIndex = emitter.getStepIndex();
+    header.physicsAccumulator = emitter.getAccumulatedTime();
+    header.physicsRate = params.physicsRate;
+    header.activeFraction = params.activeFraction;
+    header.spawnClock = emitter.getSpawnClock();
+    header.seed = params.seed;
+    header.windForce[0] = params.windForce.x;
+    header.windForce[1] = params.windForce.y;
+    header.windForce[2] = params.windForce.z;
+    header.blackHoleMass = params.blackHoleMass;
+    header.blackHoleSpeed = params.blackHoleSpeed;
+    header.blackHoleRadius = params.blackHoleRadius;
+    header.blackHoleAngle = params.blackHoleAngle;
+    header.size = params.size;
+    header.gravity = params.gravity;
+    header.spiralingMotion = params.spiralingMotion;
+    header.tumbling = params.tumbling;
+    header.sceneColliders = params.sceneColliders;
+    header.particleShape = static_cast<uint8_t>(params.particleShape);
+
+    //the ranges the particles are in right now, a range the sources don't have (anymore) spawns like the main emitter
+    const std::vector<ParticleRange>& ranges = emitter.getEmitterRanges();
+    std::vector<EmitterSource> sources = allEmitters(params);
+    std::vector<SnapshotEmitter> emitters(ranges.size());
+    const std::vector<float>& spawnCarry = emitter.getSpawnCarry();
+    std::vector<glm::vec2> rateKeys;
+    for (size_t i = 0; i < ranges.size(); i++) {
+        const EmitterSource& source = i < sources.size() ? sources[i] : sources[0];
+        SnapshotEmitter& stored = emitters[i];
+        stored.origin[0] = source.origin.x;
+        stored.origin[1] = source.origin.y;
+        stored.origin[2] = source.origin.z;
+        stored.shape = static_cast<uint32_t>(source.shape);
+        stored.emitRadius = source.emitRadius;
+        stored.emitHeight = source.emitHeight;
+        stored.first = static_cast<uint32_t>(ranges[i].first);
+        stored.count = static_cast<uint32_t>(ranges[i].count);
+        stored.spawnRate = source.spawnRate;
+        stored.lifetime = source.lifetime;
+        stored.burstCount = source.burstCount;
+        stored.burstInterval = source.burstInterval;
+        stored.rateCurveKeys = static_cast<uint32_t>(source.rateCurve.size());
+        stored.spawnCarry = i < spawnCarry.size() ? spawnCarry[i] : 0.0f;
+        rateKeys.insert(rateKeys.end(), source.rateCurve.begin(), source.rateCurve.end());
+    }
+    size_t emittersSize = emitters.size() * sizeof(SnapshotEmitter);
+    size_t keysSize = rateKeys.size() * sizeof(glm::vec2);
+    sceneData.assign((emittersSize + keysSize + 15) / 16 * 16, 0);
+    std::memcpy(sceneData.data(), emitters.data(), emittersSize);
+    if(keysSize > 0) std::memcpy(sceneData.data() + emittersSize, rateKeys.data(), keysSize);
+    header.emitterCount = static_cast<uint32_t>(emitters.size());
+    header.emittersOffset = sizeof(SnapshotHeader);
+    header.rateCurveOffset = header.emittersOffset + emittersSize;
+
+    //the readback copies the buffers back to back in this order
+    header.positionsOffset = sizeof(SnapshotHeader) + sceneData.size();
+    header.orientationsOffset = header.positionsOffset + count * sizeof(glm::vec4);
+    header.velocitiesOffset = header.orientationsOffset + count * sizeof(glm::uvec4);
+
+    this->path = path;
+    emitter.readParticleStateAsync(readback);
+    waitingForGPU = true;
+    return true;
+}
+
+void SnapshotWriter::poll()
+{
+    if(!waitingForGPU || !readback.ready()) return;
+    waitingForGPU = false;
+    if(readback.data() == nullptr) {
+        std::cerr << "Snapshot readback failed, nothing was saved" << std::endl;
+        return;
+    }
+    //the staging buffer stays mapped and is not touched again before the next save, so the thread can write straight from it
+    writing = true;
+    writerThread = std::thread(&SnapshotWriter::writeFile, this);
+}
+
+void SnapshotWriter::writeFile()
+{
+    auto start = std::chrono::steady_clock::now();
+    //write to a temporary file first, so a crash while saving never leaves a truncated snapshot behind
+    std::filesystem::path tempPath = path;
+    tempPath += ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(sceneData.data()), sceneData.size());
+        file.write(static_cast<const char*>(readback.data()), readback.size());
+        if(!file) {
+            std::cerr << "Could not write snapshot " << tempPath << std::endl;
+            writing = false;
+            return;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(tempPath, path, error);
+    if(error) {
+        std::cerr << "Could not write snapshot " << path << ": " << error.message() << std::endl;
+    }
+    else {
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Snapshot of " << header.particleCount << " particles saved to " << path << " in " << ms << "ms" << std::endl;
+    }
+    writing = false;
+}
+
+bool SnapshotWriter::isBusy() const
+{
+    return waitingForGPU || writing;
+}
+
+SnapshotWriter::~SnapshotWriter()
+{
+    if(writerThread.joinable()) writerThread.join();
+}
+
+bool loadSnapshot(const std::filesystem::path &path, Emitter &emitter, EmitterParams &params)
+{
+    auto start = std::chrono::steady_clock::now();
+    MappedFile file;
+    if(!file.open(path)) return false;
+
+    SnapshotHeader header;
+    if(file.size() < sizeof(SnapshotHeader)) {
+        std::cerr << path << " is not a snapshot" << std::endl;
+        return false;
+    }
+    std::memcpy(&header, file.data(), sizeof(SnapshotHeader));
+    if(std::memcmp(header.magic, snapshotMagic, sizeof(snapshotMagic)) != 0) {
+        std::cerr << path << " is not a snapshot" << std::endl;
+        return false;
+    }
+    if(header.version != snapshotVersion || header.headerSize != sizeof(SnapshotHeader)) {
+        std::cerr << "Snapshot " << path << " has version " << header.version << ", only version " << snapshotVersion << " is supported" << std::endl;
+        return false;
+    }
+    uint64_t count = header.particleCount;
+    //every section has to lie in the file, compared without sums that could wrap around. The count is capped first,
+    //so the section sizes can't wrap either
+    auto inFile = [&](uint64_t offset, uint64_t size) { return offset <= file.size() && size <= file.size() - offset; };
+    if(count == 0 || count > static_cast<uint64_t>(std::numeric_limits<int>::max())
+       || !inFile(header.positionsOffset, count * sizeof(glm::vec4))
+       || !inFile(header.orientationsOffset, count * sizeof(glm::uvec4))
+       || !inFile(header.velocitiesOffset, count * sizeof(glm::vec4))) {
+        std::cerr << "Snapshot " << path << " is truncated" << std::endl;
+        return false;
+    }
+    if(header.emitterCount == 0 || header.emitterCount > static_cast<uint32_t>(maxEmitters)
+       || !inFile(header.emittersOffset, header.emitterCount * sizeof(SnapshotEmitter))) {
+        std::cerr << "Snapshot " << path << " has no valid emitter list" << std::endl;
+        return false;
+    }
+
+    //the emitters have to cover the particles exactly and in order, like the layout the emitter builds from them
+    std::vector<EmitterSource> sources(header.emitterCount);
+    std::vector<float> spawnCarry(header.emitterCount);
+    uint64_t rangeEnd = 0, keyCount = 0;
+    for (uint32_t i = 0; i < header.emitterCount; i++) {
+        SnapshotEmitter stored;
+        std::memcpy(&stored, file.data() + header.emittersOffset + i * sizeof(SnapshotEmitter), sizeof(SnapshotEmitter));
+        if(stored.first != rangeEnd || stored.count > count - rangeEnd || stored.shape > static_cast<uint32_t>(EmitterShape::meshShape)
+           || stored.rateCurveKeys > file.size() / sizeof(glm::vec2)) {
+            std::cerr << "Snapshot " << path << " has an invalid emitter " << i << std::endl;
+            return false;
+        }
+        rangeEnd += stored.count;
+        keyCount += stored.rateCurveKeys;
+        EmitterSource& source = sources[i];
+        source.origin = glm::vec3(stored.origin[0], stored.origin[1], stored.origin[2]);
+        source.shape = static_cast<EmitterShape>(stored.shape);
+        source.emitRadius = stored.emitRadius;
+        source.emitHeight = stored.emitHeight;
+        source.leafCount = static_cast<int>(stored.count);
+        source.spawnRate = stored.spawnRate;
+        source.lifetime = stored.lifetime;
+        source.burstCount = stored.burstCount;
+        source.burstInterval = stored.burstInterval;
+        source.rateCurve.resize(stored.rateCurveKeys);
+        spawnCarry[i] = stored.spawnCarry;
+    }
+    if(rangeEnd != count || !inFile(header.rateCurveOffset, keyCount * sizeof(glm::vec2))) {
+        std::cerr << "Snapshot " << path << " has an invalid emitter list" << std::endl;
+        return false;
+    }
+    const uint8_t* keys = file.data() + header.rateCurveOffset;
+    for (EmitterSource& source : sources) {
+        if(source.rateCurve.empty()) continue;
+        std::memcpy(source.rateCurve.data(), keys, source.rateCurve.size() * sizeof(glm::vec2));
+        keys += source.rateCurve.size() * sizeof(glm::vec2);
+    }
+
+    //the first one is the main emitter, which lives in the params themselves
+    const EmitterSource& main = sources[0];
+    params.shape = main.shape;
+    params.emitRadius = main.emitRadius;
+    params.emitHeight = main.emitHeight;
+    params.leafCount = main.leafCount;
+    params.spawnRate = main.spawnRate;
+    params.lifetime = main.lifetime;
+    params.rateCurve = main.rateCurve;
+    params.burstCount = main.burstCount;
+    params.burstInterval = main.burstInterval;
+    params.emitters.assign(sources.begin() + 1, sources.end());
+    params.seed = header.seed;
+    params.windForce = glm::vec3(header.windForce[0], header.windForce[1], header.windForce[2]);
+    params.blackHoleMass = header.blackHoleMass;
+    params.blackHoleSpeed = header.blackHoleSpeed;
+    params.blackHoleRadius = header.blackHoleRadius;
+    params.blackHoleAngle = header.blackHoleAngle;
+    params.size = header.size;
+    params.gravity = header.gravity;
+    params.physicsRate = header.physicsRate;
+    params.activeFraction = header.activeFraction;
+    params.spiralingMotion = header.spiralingMotion != 0;
+    params.tumbling = header.tumbling != 0;
+    params.sceneColliders = header.sceneColliders != 0;
+    params.particleShape = static_cast<ParticleShape>(header.particleShape);
+
+    emitter.restoreParticleState(params, file.data() + header.positionsOffset, file.data() + header.orientationsOffset,
+                                 file.data() + header.velocitiesOffset, header.stepIndex, header.physicsAccumulator,
+                                 header.spawnClock, spawnCarry);
+
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Snapshot of " << count << " particles loaded from " << path << " in " << ms << "ms" << std::endl;
+    return true;
+}
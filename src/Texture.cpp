@@ -1,65 +1,269 @@
 #include "Texture.h"
+#include "ThreadPool.h"
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <functional>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+//decoding is mostly waiting on memory, two threads are plenty next to the render thread
+static ThreadPool& decodingPool() {
+    static ThreadPool pool(2);
+    return pool;
+}
+
+//one file per source image, the hash of the full path keeps equally named images from different folders apart
+static std::filesystem::path compressedCachePath(const std::filesystem::path& imagePath) {
+    std::error_code error;
+    std::filesystem::path absolutePath = std::filesystem::absolute(imagePath, error);
+    char hash[17];
+    std::snprintf(hash, sizeof(hash), "%016zx", std::hash<std::string>{}(absolutePath.generic_string()));
+    return std::filesystem::path("texture_cache") / (imagePath.stem().string() + "-" + hash + ".fltex");
+}
+
+Texture::DecodedImage::~DecodedImage()
+{
+    if(pixels != nullptr) stbi_image_free(pixels);
+}
 
 Texture::Texture()
 {
     textureHandle = 0;
     textureUnitIndex = 0;
+    target = GL_TEXTURE_2D;
+    width = height = nrChannels = 0;
+    layerCount = 1;
 }
 
 int Texture::initialize(const std::string& imagePath, unsigned int texUnit)
+{
+    return initializeLayers({imagePath}, texUnit, GL_TEXTURE_2D);
+}
+
+int Texture::initializeArray(const std::vector<std::string> &imagePaths, unsigned int texUnit)
+{
+    return initializeLayers(imagePaths, texUnit, GL_TEXTURE_2D_ARRAY);
+}
+
+int Texture::initializeLayers(const std::vector<std::string> &imagePaths, unsigned int texUnit, unsigned int target)
 {
     getErrorCode();
     textureUnitIndex = texUnit;
+    this->target = target;
+    this->imagePaths = imagePaths;
+    layerCount = static_cast<int>(imagePaths.size());
     // glDeleteTextures(1, &textureHandle);
 
-    if(!std::filesystem::exists(imagePath)) {
-        std::cerr << "The image path specified could not be found: " << imagePath << std::endl;
-        return 0;
+    for (const std::string& imagePath : imagePaths) {
+        if(!std::filesystem::exists(imagePath)) {
+            std::cerr << "The image path specified could not be found: " << imagePath << std::endl;
+            return 0;
+        }
     }
+    if(imagePaths.empty()) return 0;
     glGenTextures(1, &textureHandle);
     glActiveTexture(GL_TEXTURE0 + textureUnitIndex);
 
     getErrorCode();
-    glBindTexture(GL_TEXTURE_2D, textureHandle);
+    glBindTexture(target, textureHandle);
+
+    getErrorCode();
 
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    //a single texel is a complete mipmap chain, so the texture can be sampled right away
+    std::vector<unsigned char> placeholder(static_cast<size_t>(layerCount) * 4, 128);
+    for (int layer = 0; layer < layerCount; layer++) placeholder[layer * 4 + 3] = 255;
+    if(target == GL_TEXTURE_2D_ARRAY) glTexImage3D(target, 0, GL_RGBA, 1, 1, layerCount, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder.data());
+    else glTexImage2D(target, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder.data());
     getErrorCode();
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    int desiredChannels = 3;
-    GLenum imageFormat, internalGlFormat;
-    std::filesystem::path path(imagePath);
-    if(path.extension() == ".png") {
-        desiredChannels = 4;
-        imageFormat = GL_RGBA;
-        internalGlFormat = GL_RGBA;
+    bool compress = GLEW_EXT_texture_compression_s3tc;
+    decoding.clear();
+    for (const std::string& imagePath : imagePaths) {
+        std::shared_ptr<DecodedImage> image = std::make_shared<DecodedImage>();
+        image->desiredChannels = std::filesystem::path(imagePath).extension() == ".png" ? 4 : 3;
+        decoding.push_back(image);
+        decodingPool().enqueue([image, imagePath, compress] {
+            std::filesystem::path path(imagePath);
+            if(path.extension() == ".ktx2") {
+                if(!loadKtx2(path, image->compressed, image->error)) image->compressed.format = 0;
+            }
+            else if(compress) {
+                std::filesystem::path cachePath = compressedCachePath(path);
+                if(!loadCompressedCache(cachePath, path, image->compressed)) {
+                    //compressing is a one time cost, the cache makes every following start as fast as reading a file
+                    image->pixels = stbi_load(imagePath.c_str(), &image->width, &image->height, &image->channels, 4);
+                    if(image->pixels != nullptr) {
+                        compressImage(image->pixels, image->width, image->height, image->compressed);
+                        saveCompressedCache(cachePath, path, image->compressed);
+                        stbi_image_free(image->pixels);
+                        image->pixels = nullptr;
+                    }
+                    else image->error = stbi_failure_reason();
+                }
+            }
+            else {
+                image->pixels = stbi_load(imagePath.c_str(), &image->width, &image->height, &image->channels, image->desiredChannels);
+                if(image->pixels == nullptr) image->error = stbi_failure_reason();
+            }
+            image->ready = true;
+        });
     }
-    else {
-        desiredChannels = 3;
-        imageFormat = GL_RGB;
-        internalGlFormat = GL_RGB;
+    if(std::find(pendingTextures.begin(), pendingTextures.end(), this) == pendingTextures.end()) pendingTextures.push_back(this);
+    return 1;
+}
+
+void Texture::upload()
+{
+    std::vector<std::shared_ptr<DecodedImage>> images = std::move(decoding);
+    decoding.clear();
+    std::erase(pendingTextures, this);
+
+    //the first image that loaded decides the size and format of all layers
+    const DecodedImage* reference = nullptr;
+    for (size_t layer = 0; layer < images.size(); layer++) {
+        const DecodedImage& image = *images[layer];
+        if(image.compressed.format == 0 && image.pixels == nullptr) {
+            std::filesystem::path path(imagePaths[layer]);
+            std::cerr << (path.extension() == ".ktx2" ? "KTX2 error: " : "STB_image error: ") << image.error << " (" << path.filename() << ")" << std::endl;
+        }
+        else if(reference == nullptr) reference = &image;
     }
+    if(reference == nullptr) return;
 
-    unsigned char* gridImageData = stbi_load(imagePath.c_str(), &width, &height, &nrChannels, desiredChannels);
+    std::vector<const DecodedImage*> layers;
+    for (size_t layer = 0; layer < images.size(); layer++) {
+        const DecodedImage* image = images[layer].get();
+        bool matches = reference->compressed.format != 0
+            ? image->compressed.format == reference->compressed.format && image->compressed.levels.size() == reference->compressed.levels.size()
+              && image->compressed.levels[0].width == reference->compressed.levels[0].width
+              && image->compressed.levels[0].height == reference->compressed.levels[0].height
+            : image->pixels != nullptr && image->width == reference->width && image->height == reference->height
+              && image->desiredChannels == reference->desiredChannels;
+        if(!matches) {
+            if(image->compressed.format != 0 || image->pixels != nullptr) {
+                std::cerr << "Texture layer " << std::filesystem::path(imagePaths[layer]).filename()
+                          << " does not match the size or format of the first layer, it is replaced by the first image" << std::endl;
+            }
+            image = reference;
+        }
+        layers.push_back(image);
+    }
 
-    std::cout << "Processed Texture " << path.filename() << " | width: " << width << " height: " << height << " nrChannels: " << nrChannels << std::endl;
+    if(reference->compressed.format != 0) uploadCompressed(layers);
+    else uploadPixels(layers);
+}
+
+void Texture::uploadPixels(const std::vector<const DecodedImage*>& layers)
+{
+    const DecodedImage& first = *layers[0];
+    std::filesystem::path path(imagePaths[0]);
+    width = first.width;
+    height = first.height;
+    nrChannels = first.channels;
+    std::cout << "Processed Texture " << path.filename() << " | width: " << width << " height: " << height << " nrChannels: " << nrChannels;
+    if(target == GL_TEXTURE_2D_ARRAY) std::cout << " | " << layerCount << " layers";
+    std::cout << std::endl;
 
-    if(gridImageData) {
-    glTexImage2D(GL_TEXTURE_2D, 0, internalGlFormat, width, height, 0, imageFormat, GL_UNSIGNED_BYTE, gridImageData);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    GLenum imageFormat = first.desiredChannels == 4 ? GL_RGBA : GL_RGB;
+    size_t layerSize = static_cast<size_t>(width) * height * first.desiredChannels;
+    size_t size = layerSize * layers.size();
 
-    getErrorCode();
+    //the copy into the unpack buffer is all the CPU does, the driver transfers it to the texture without blocking
+    unsigned int unpackBuffer;
+    glCreateBuffers(1, &unpackBuffer);
+    glNamedBufferData(unpackBuffer, size, nullptr, GL_STREAM_DRAW);
+    unsigned char* mapped = static_cast<unsigned char*>(glMapNamedBufferRange(unpackBuffer, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    if(mapped == nullptr) {
+        std::cerr << "Could not map the upload buffer for " << path.filename() << std::endl;
+        glDeleteBuffers(1, &unpackBuffer);
+        return;
+    }
+    for (size_t layer = 0; layer < layers.size(); layer++) std::memcpy(mapped + layer * layerSize, layers[layer]->pixels, layerSize);
+    glUnmapNamedBuffer(unpackBuffer);
+
+    int levels = 1 + static_cast<int>(std::floor(std::log2(std::max(width, height))));
+    GLenum internalFormat = imageFormat == GL_RGBA ? GL_RGBA8 : GL_RGB8;
+    glActiveTexture(GL_TEXTURE0 + textureUnitIndex);
+    glBindTexture(target, textureHandle);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpackBuffer);
+    //RGB rows are not 4 byte aligned for every width
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if(target == GL_TEXTURE_2D_ARRAY) {
+        glTexStorage3D(target, levels, internalFormat, width, height, layerCount);
+        glTexSubImage3D(target, 0, 0, 0, 0, width, height, layerCount, imageFormat, GL_UNSIGNED_BYTE, nullptr);
     }
     else {
-        std::cerr << "STB_image error: " << stbi_failure_reason() << std::endl;
-        return 0;
+        glTexStorage2D(target, levels, internalFormat, width, height);
+        glTexSubImage2D(target, 0, 0, 0, width, height, imageFormat, GL_UNSIGNED_BYTE, nullptr);
     }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glGenerateMipmap(target);
+    //deleting is fine right away, GL keeps the storage alive until the transfer is done
+    glDeleteBuffers(1, &unpackBuffer);
+    getErrorCode();
+}
 
-    stbi_image_free(gridImageData);
-    return 1;
+void Texture::uploadCompressed(const std::vector<const DecodedImage*>& layers)
+{
+    const CompressedImage& first = layers[0]->compressed;
+    std::filesystem::path path(imagePaths[0]);
+    width = first.levels[0].width;
+    height = first.levels[0].height;
+    nrChannels = first.format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || first.format == GL_COMPRESSED_SRGB_S3TC_DXT1_EXT ? 3 : 4;
+    std::cout << "Processed Texture " << path.filename() << " | width: " << width << " height: " << height << " nrChannels: " << nrChannels;
+    if(target == GL_TEXTURE_2D_ARRAY) std::cout << " | " << layerCount << " layers";
+    std::cout << " | " << first.levels.size() << " compressed mip levels, " << first.data.size() * layers.size() / 1024 << " KiB" << std::endl;
+
+    //all levels of all layers go through one unpack buffer, every upload reads its own range of it
+    size_t layerSize = first.data.size();
+    size_t size = layerSize * layers.size();
+    unsigned int unpackBuffer;
+    glCreateBuffers(1, &unpackBuffer);
+    glNamedBufferData(unpackBuffer, size, nullptr, GL_STREAM_DRAW);
+    unsigned char* mapped = static_cast<unsigned char*>(glMapNamedBufferRange(unpackBuffer, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    if(mapped == nullptr) {
+        std::cerr << "Could not map the upload buffer for " << path.filename() << std::endl;
+        glDeleteBuffers(1, &unpackBuffer);
+        return;
+    }
+    for (size_t layer = 0; layer < layers.size(); layer++) std::memcpy(mapped + layer * layerSize, layers[layer]->compressed.data.data(), layerSize);
+    glUnmapNamedBuffer(unpackBuffer);
+
+    //the chain is complete already, so no glGenerateMipmap. A KTX2 file may stop before 1x1, the storage only has its levels
+    int levels = static_cast<int>(first.levels.size());
+    glActiveTexture(GL_TEXTURE0 + textureUnitIndex);
+    glBindTexture(target, textureHandle);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpackBuffer);
+    if(target == GL_TEXTURE_2D_ARRAY) glTexStorage3D(target, levels, first.format, width, height, layerCount);
+    else glTexStorage2D(target, levels, first.format, width, height);
+    for (int level = 0; level < levels; level++) {
+        const CompressedImage::Level& mip = first.levels[level];
+        for (int layer = 0; layer < layerCount; layer++) {
+            const void* offset = reinterpret_cast<const void*>(layer * layerSize + mip.offset);
+            if(target == GL_TEXTURE_2D_ARRAY) {
+                glCompressedTexSubImage3D(target, level, 0, 0, layer, mip.width, mip.height, 1, first.format, static_cast<int>(mip.size), offset);
+            }
+            else {
+                glCompressedTexSubImage2D(target, level, 0, 0, mip.width, mip.height, first.format, static_cast<int>(mip.size), offset);
+            }
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &unpackBuffer);
+    getErrorCode();
+}
+
+bool Texture::isLoaded() const
+{
+    return textureHandle != 0 && decoding.empty();
 }
 
 unsigned int Texture::getTextureUnit() const
@@ -71,3 +275,37 @@ unsigned int Texture::getHandle() const
 {
     return textureHandle;
 }
+
+unsigned int Texture::getTarget() const
+{
+    return target;
+}
+
+int Texture::getLayerCount() const
+{
+    return layerCount;
+}
+
+void Texture::pollPending()
+{
+    //upload() removes the texture from the list
+    for (size_t i = 0; i < pendingTextures.size(); ) {
+        Texture* texture = pendingTextures[i];
+        bool ready = std::all_of(texture->decoding.begin(), texture->decoding.end(), [](const auto& image) { return image->ready.load(); });
+        if(ready) texture->upload();
+        else i++;
+    }
+}
+
+void Texture::finishPending()
+{
+    while (!pendingTextures.empty()) {
+        pollPending();
+        if(!pendingTextures.empty()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+Texture::~Texture()
+{
+    std::erase(pendingTextures, this);
+}
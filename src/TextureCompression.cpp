@@ -0,0 +1,426 @@
+#include "TextureCompression.h"
+#include "GL/glew.h"
+#include "MappedFile.h"
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+namespace {
+
+//565 endpoints expanded to 8 bits the way the hardware does it
+void unpack565(uint16_t color, float out[3]) {
+    int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+    out[0] = static_cast<float>((r << 3) | (r >> 2));
+    out[1] = static_cast<float>((g << 2) | (g >> 4));
+    out[2] = static_cast<float>((b << 3) | (b >> 2));
+}
+
+uint16_t pack565(const float color[3]) {
+    int r = std::clamp(static_cast<int>(color[0] * 31.0f / 255.0f + 0.5f), 0, 31);
+    int g = std::clamp(static_cast<int>(color[1] * 63.0f / 255.0f + 0.5f), 0, 63);
+    int b = std::clamp(static_cast<int>(color[2] * 31.0f / 255.0f + 0.5f), 0, 31);
+    return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+//Picks the nearest of the four palette colors for every pixel, returns the summed squared error
+float fitIndices(const float pixels[16][3], uint16_t c0, uint16_t c1, uint32_t& indices) {
+    float palette[4][3];
+    unpack565(c0, palette[0]);
+    unpack565(c1, palette[1]);
+    for (int k = 0; k < 3; k++) {
+        palette[2][k] = (2.0f * palette[0][k] + palette[1][k]) / 3.0f;
+        palette[3][k] = (palette[0][k] + 2.0f * palette[1][k]) / 3.0f;
+    }
+    float total = 0.0f;
+    indices = 0;
+    for (int i = 0; i < 16; i++) {
+        int best = 0;
+        float bestError = 1e30f;
+        for (int p = 0; p < 4; p++) {
+            float dr = pixels[i][0] - palette[p][0], dg = pixels[i][1] - palette[p][1], db = pixels[i][2] - palette[p][2];
+            float error = dr * dr + dg * dg + db * db;
+            if(error < bestError) {
+                bestError = error;
+                best = p;
+            }
+        }
+        total += bestError;
+        indices |= static_cast<uint32_t>(best) << (2 * i);
+    }
+    return total;
+}
+
+//BC1 color block: endpoints along the principal axis of the block colors, then one least squares refinement
+void compressColorBlock(const uint8_t block[64], uint8_t out[8]) {
+    float pixels[16][3];
+    float mean[3] = {0.0f, 0.0f, 0.0f};
+    for (int i = 0; i < 16; i++) {
+        for (int k = 0; k < 3; k++) {
+            pixels[i][k] = block[i * 4 + k];
+            mean[k] += pixels[i][k] / 16.0f;
+        }
+    }
+    float covariance[6] = {0, 0, 0, 0, 0, 0}; //rr rg rb gg gb bb
+    for (int i = 0; i < 16; i++) {
+        float r = pixels[i][0] - mean[0], g = pixels[i][1] - mean[1], b = pixels[i][2] - mean[2];
+        covariance[0] += r * r; covariance[1] += r * g; covariance[2] += r * b;
+        covariance[3] += g * g; covariance[4] += g * b; covariance[5] += b * b;
+    }
+    float axis[3] = {1.0f, 1.0f, 1.0f};
+    for (int iteration = 0; iteration < 8; iteration++) {
+        float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+        float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+        float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+        float length = std::max({std::fabs(x), std::fabs(y), std::fabs(z)});
+        if(length < 1e-6f) break; //flat block, any axis works
+        axis[0] = x / length; axis[1] = y / length; axis[2] = z / length;
+    }
+    float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    for (float& a : axis) a /= axisLength;
+
+    float minProjection = 1e30f, maxProjection = -1e30f;
+    for (int i = 0; i < 16; i++) {
+        float projection = (pixels[i][0] - mean[0]) * axis[0] + (pixels[i][1] - mean[1]) * axis[1] + (pixels[i][2] - mean[2]) * axis[2];
+        minProjection = std::min(minProjection, projection);
+        maxProjection = std::max(maxProjection, projection);
+    }
+    //pull the endpoints in a little, the extremes are rarely hit exactly and the inner palette entries profit
+    float inset = (maxProjection - minProjection) / 16.0f;
+    float end0[3], end1[3];
+    for (int k = 0; k < 3; k++) {
+        end0[k] = mean[k] + axis[k] * (maxProjection - inset);
+        end1[k] = mean[k] + axis[k] * (minProjection + inset);
+    }
+    uint16_t c0 = pack565(end0), c1 = pack565(end1);
+    uint32_t indices;
+    float error = fitIndices(pixels, c0, c1, indices);
+
+    //least squares endpoints for the chosen indices
+    const float weights[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+    float aa = 0, ab = 0, bb = 0, ax[3] = {0, 0, 0}, bx[3] = {0, 0, 0};
+    for (int i = 0; i < 16; i++) {
+        float a = weights[(indices >> (2 * i)) & 3], b = 1.0f - a;
+        aa += a * a; ab += a * b; bb += b * b;
+        for (int k = 0; k < 3; k++) {
+            ax[k] += a * pixels[i][k];
+            bx[k] += b * pixels[i][k];
+        }
+    }
+    float determinant = aa * bb - ab * ab;
+    if(std::fabs(determinant) > 1e-6f) {
+        float refined0[3], refined1[3];
+        for (int k = 0; k < 3; k++) {
+            refined0[k] = (ax[k] * bb - bx[k] * ab) / determinant;
+            refined1[k] = (bx[k] * aa - ax[k] * ab) / determinant;
+        }
+        uint16_t r0 = pack565(refined0), r1 = pack565(refined1);
+        uint32_t refinedIndices;
+        float refinedError = fitIndices(pixels, r0, r1, refinedIndices);
+        if(refinedError < error) {
+            c0 = r0;
+            c1 = r1;
+            indices = refinedIndices;
+        }
+    }
+
+    //four color mode needs c0 > c1, swapping the endpoints swaps index 0 with 1 and 2 with 3
+    if(c0 < c1) {
+        std::swap(c0, c1);
+        indices ^= 0x55555555;
+    }
+    else if(c0 == c1) {
+        if(c0 == 0) {
+            c0 = 1;
+            indices = 0x55555555; //everything is c1 = black
+        }
+        else {
+            c1 = c0 - 1;
+            fitIndices(pixels, c0, c1, indices);
+        }
+    }
+    out[0] = c0 & 0xff; out[1] = c0 >> 8;
+    out[2] = c1 & 0xff; out[3] = c1 >> 8;
+    for (int k = 0; k < 4; k++) out[4 + k] = static_cast<uint8_t>(indices >> (8 * k));
+}
+
+//BC3 alpha block: min and max as endpoints with the six interpolated values in between
+void compressAlphaBlock(const uint8_t block[64], uint8_t out[8]) {
+    int minAlpha = 255, maxAlpha = 0;
+    for (int i = 0; i < 16; i++) {
+        minAlpha = std::min<int>(minAlpha, block[i * 4 + 3]);
+        maxAlpha = std::max<int>(maxAlpha, block[i * 4 + 3]);
+    }
+    out[0] = static_cast<uint8_t>(maxAlpha);
+    out[1] = static_cast<uint8_t>(minAlpha);
+    uint64_t indices = 0;
+    if(maxAlpha > minAlpha) {
+        int palette[8] = {maxAlpha, minAlpha};
+        for (int k = 2; k < 8; k++) palette[k] = ((8 - k) * maxAlpha + (k - 1) * minAlpha) / 7;
+        for (int i = 0; i < 16; i++) {
+            int alpha = block[i * 4 + 3], best = 0;
+            for (int p = 1; p < 8; p++) {
+                if(std::abs(palette[p] - alpha) < std::abs(palette[best] - alpha)) best = p;
+            }
+            indices |= static_cast<uint64_t>(best) << (3 * i);
+        }
+    }
+    for (int k = 0; k < 6; k++) out[2 + k] = static_cast<uint8_t>(indices >> (8 * k));
+}
+
+std::vector<uint8_t> downsample(const std::vector<uint8_t>& rgba, int width, int height, int newWidth, int newHeight) {
+    std::vector<uint8_t> result(static_cast<size_t>(newWidth) * newHeight * 4);
+    for (int y = 0; y < newHeight; y++) {
+        int y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+        for (int x = 0; x < newWidth; x++) {
+            int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+            for (int k = 0; k < 4; k++) {
+                int sum = rgba[(static_cast<size_t>(y0) * width + x0) * 4 + k] + rgba[(static_cast<size_t>(y0) * width + x1) * 4 + k]
+                        + rgba[(static_cast<size_t>(y1) * width + x0) * 4 + k] + rgba[(static_cast<size_t>(y1) * width + x1) * 4 + k];
+                result[(static_cast<size_t>(y) * newWidth + x) * 4 + k] = static_cast<uint8_t>((sum + 2) / 4);
+            }
+        }
+    }
+    return result;
+}
+
+size_t blockBytes(unsigned int format) {
+    return format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+        || format == GL_COMPRESSED_SRGB_S3TC_DXT1_EXT || format == GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT ? 8 : 16;
+}
+
+size_t levelSize(unsigned int format, int width, int height) {
+    return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+//everything compressImage and loadKtx2 produce
+bool knownFormat(unsigned int format) {
+    switch (format) {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT: case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+        case GL_COMPRESSED_RGBA_BPTC_UNORM: case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+            return true;
+        default:
+            return false;
+    }
+}
+
+//no GL texture is larger, so the level sizes of a file that passed the checks can't overflow
+const uint32_t maxTextureSize = 1 << 15;
+
+//levels of the complete mip chain down to 1x1
+uint32_t fullLevelCount(uint32_t width, uint32_t height) {
+    uint32_t count = 1;
+    for (uint32_t size = std::max(width, height); size > 1; size >>= 1) count++;
+    return count;
+}
+
+const char cacheMagic[8] = {'F', 'L', 'T', 'E', 'X', 0, 0, 0};
+const uint32_t cacheVersion = 1;
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t format;
+    uint32_t levelCount;
+    uint32_t reserved;
+    uint64_t sourceSize;
+    int64_t sourceTime;
+};
+struct CacheLevel {
+    uint32_t width, height;
+    uint64_t size;
+};
+static_assert(sizeof(CacheHeader) == 40 && sizeof(CacheLevel) == 16, "the texture cache is written as is");
+
+bool sourceStamp(const std::filesystem::path& sourcePath, uint64_t& size, int64_t& time) {
+    std::error_code error;
+    size = std::filesystem::file_size(sourcePath, error);
+    if(error) return false;
+    time = std::filesystem::last_write_time(sourcePath, error).time_since_epoch().count();
+    return !error;
+}
+
+}
+
+void compressImage(const uint8_t *rgba, int width, int height, CompressedImage &image)
+{
+    bool alpha = false;
+    for (size_t i = 0; i < static_cast<size_t>(width) * height && !alpha; i++) alpha = rgba[i * 4 + 3] != 255;
+    image.format = alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    image.levels.clear();
+    image.data.clear();
+
+    std::vector<uint8_t> level(rgba, rgba + static_cast<size_t>(width) * height * 4);
+    int levelWidth = width, levelHeight = height;
+    while (true) {
+        size_t offset = image.data.size();
+        size_t size = levelSize(image.format, levelWidth, levelHeight);
+        image.levels.push_back({levelWidth, levelHeight, offset, size});
+        image.data.resize(offset + size);
+        uint8_t* out = image.data.data() + offset;
+
+        for (int by = 0; by < levelHeight; by += 4) {
+            for (int bx = 0; bx < levelWidth; bx += 4) {
+                //blocks over the border repeat the last row and column
+                uint8_t block[64];
+                for (int i = 0; i < 16; i++) {
+                    int x = std::min(bx + (i & 3), levelWidth - 1), y = std::min(by + (i >> 2), levelHeight - 1);
+                    std::memcpy(block + i * 4, level.data() + (static_cast<size_t>(y) * levelWidth + x) * 4, 4);
+                }
+                if(alpha) {
+                    compressAlphaBlock(block, out);
+                    out += 8;
+                }
+                compressColorBlock(block, out);
+                out += 8;
+            }
+        }
+
+        if(levelWidth == 1 && levelHeight == 1) break;
+        int nextWidth = std::max(levelWidth / 2, 1), nextHeight = std::max(levelHeight / 2, 1);
+        level = downsample(level, levelWidth, levelHeight, nextWidth, nextHeight);
+        levelWidth = nextWidth;
+        levelHeight = nextHeight;
+    }
+}
+
+bool loadKtx2(const std::filesystem::path &path, CompressedImage &image, std::string &error)
+{
+    MappedFile file;
+    if(!file.open(path)) {
+        error = "could not open the file";
+        return false;
+    }
+    const uint8_t identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+    const size_t headerSize = 80;
+    if(file.size() < headerSize || std::memcmp(file.data(), identifier, sizeof(identifier)) != 0) {
+        error = "not a KTX2 file";
+        return false;
+    }
+    uint32_t fields[9]; //vkFormat, typeSize, width, height, depth, layerCount, faceCount, levelCount, supercompressionScheme
+    std::memcpy(fields, file.data() + 12, sizeof(fields));
+    uint32_t vkFormat = fields[0], width = fields[2], height = fields[3], levelCount = std::max(fields[7], 1u);
+    if(fields[4] > 1 || fields[5] > 1 || fields[6] != 1 || fields[8] != 0) {
+        error = "only plain 2D textures without supercompression are supported";
+        return false;
+    }
+    switch (vkFormat) {
+        case 131: image.format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT; break;         //VK_FORMAT_BC1_RGB_UNORM_BLOCK
+        case 132: image.format = GL_COMPRESSED_SRGB_S3TC_DXT1_EXT; break;        //VK_FORMAT_BC1_RGB_SRGB_BLOCK
+        case 133: image.format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; break;        //VK_FORMAT_BC1_RGBA_UNORM_BLOCK
+        case 134: image.format = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT; break;  //VK_FORMAT_BC1_RGBA_SRGB_BLOCK
+        case 137: image.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; break;        //VK_FORMAT_BC3_UNORM_BLOCK
+        case 138: image.format = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT; break;  //VK_FORMAT_BC3_SRGB_BLOCK
+        case 145: image.format = GL_COMPRESSED_RGBA_BPTC_UNORM; break;           //VK_FORMAT_BC7_UNORM_BLOCK
+        case 146: image.format = GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM; break;     //VK_FORMAT_BC7_SRGB_BLOCK
+        default:
+            error = "unsupported vkFormat " + std::to_string(vkFormat) + ", only BC1, BC3 and BC7 can be loaded";
+            return false;
+    }
+    if(width == 0 || height == 0 || width > maxTextureSize || height > maxTextureSize || levelCount > fullLevelCount(width, height)) {
+        error = "unsupported size " + std::to_string(width) + "x" + std::to_string(height) + " with " + std::to_string(levelCount) + " levels";
+        return false;
+    }
+    if(file.size() < headerSize + static_cast<uint64_t>(levelCount) * 24) {
+        error = "truncated level index";
+        return false;
+    }
+
+    image.levels.clear();
+    image.data.clear();
+    for (uint32_t level = 0; level < levelCount; level++) {
+        uint64_t entry[3]; //byteOffset, byteLength, uncompressedByteLength
+        std::memcpy(entry, file.data() + headerSize + level * 24, sizeof(entry));
+        int levelWidth = std::max<int>(width >> level, 1), levelHeight = std::max<int>(height >> level, 1);
+        if(entry[1] > file.size() || entry[0] > file.size() - entry[1] || entry[1] != levelSize(image.format, levelWidth, levelHeight)) {
+            error = "level " + std::to_string(level) + " has an unexpected size";
+            return false;
+        }
+        size_t offset = image.data.size();
+        image.data.insert(image.data.end(), file.data() + entry[0], file.data() + entry[0] + entry[1]);
+        image.levels.push_back({levelWidth, levelHeight, offset, static_cast<size_t>(entry[1])});
+    }
+    return true;
+}
+
+bool loadCompressedCache(const std::filesystem::path &cachePath, const std::filesystem::path &sourcePath, CompressedImage &image)
+{
+    std::error_code error;
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    if(!std::filesystem::exists(cachePath, error) || !sourceStamp(sourcePath, sourceSize, sourceTime)) return false;
+
+    MappedFile file;
+    if(!file.open(cachePath) || file.size() < sizeof(CacheHeader)) return false;
+    CacheHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if(std::memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0 || header.version != cacheVersion
+       || header.sourceSize != sourceSize || header.sourceTime != sourceTime || !knownFormat(header.format)
+       || header.levelCount == 0 || header.levelCount > fullLevelCount(maxTextureSize, maxTextureSize)
+       || file.size() < sizeof(CacheHeader) + static_cast<uint64_t>(header.levelCount) * sizeof(CacheLevel)) {
+        return false;
+    }
+
+    //the levels have to be the mip chain of the first one, each exactly as large as its blocks
+    image.format = header.format;
+    image.levels.clear();
+    uint64_t offset = 0;
+    uint32_t width = 0, height = 0;
+    for (uint32_t level = 0; level < header.levelCount; level++) {
+        CacheLevel entry;
+        std::memcpy(&entry, file.data() + sizeof(CacheHeader) + level * sizeof(CacheLevel), sizeof(entry));
+        if(level == 0) {
+            width = entry.width;
+            height = entry.height;
+            if(width == 0 || height == 0 || width > maxTextureSize || height > maxTextureSize
+               || header.levelCount > fullLevelCount(width, height)) return false;
+        }
+        if(entry.width != std::max(width >> level, 1u) || entry.height != std::max(height >> level, 1u)
+           || entry.size != levelSize(header.format, entry.width, entry.height)) return false;
+        image.levels.push_back({static_cast<int>(entry.width), static_cast<int>(entry.height), static_cast<size_t>(offset),
+                                static_cast<size_t>(entry.size)});
+        offset += entry.size;
+    }
+    uint64_t dataOffset = sizeof(CacheHeader) + static_cast<uint64_t>(header.levelCount) * sizeof(CacheLevel);
+    if(dataOffset + offset != file.size()) return false;
+    image.data.assign(file.data() + dataOffset, file.data() + file.size());
+    return true;
+}
+
+bool saveCompressedCache(const std::filesystem::path &cachePath, const std::filesystem::path &sourcePath, const CompressedImage &image)
+{
+    CacheHeader header{};
+    std::memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.version = cacheVersion;
+    header.format = image.format;
+    header.levelCount = static_cast<uint32_t>(image.levels.size());
+    if(!sourceStamp(sourcePath, header.sourceSize, header.sourceTime)) return false;
+
+    //written next to the final file and renamed, two programs loading the same texture never see half a file
+    std::error_code error;
+    std::filesystem::create_directories(cachePath.parent_path(), error);
+    std::filesystem::path temporaryPath = cachePath;
+    temporaryPath += ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (const CompressedImage::Level& level : image.levels) {
+            CacheLevel entry{static_cast<uint32_t>(level.width), static_cast<uint32_t>(level.height), level.size};
+            file.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+        }
+        file.write(reinterpret_cast<const char*>(image.data.data()), image.data.size());
+        if(!file) {
+            std::cerr << "Could not write the texture cache " << temporaryPath << std::endl;
+            return false;
+        }
+    }
+    std::filesystem::rename(temporaryPath, cachePath, error);
+    if(error) {
+        std::cerr << "Could not write the texture cache " << cachePath << ": " << error.message() << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,67 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+{
+    if(threadCount == 0) {
+        unsigned int hardwareThreads = std::thread::hardware_concurrency();
+        threadCount = std::max(hardwareThreads > 1 ? hardwareThreads - 1 : 1u, 1u);
+    }
+    workers.reserve(threadCount);
+    for (unsigned int i = 0; i < threadCount; i++)
+    {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+void ThreadPool::workerLoop()
+{
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobAvailable.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if(jobs.empty()) return; //stopping and everything is done
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            runningJobs++;
+        }
+        job();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            runningJobs--;
+            if(jobs.empty() && runningJobs == 0) allDone.notify_all();
+        }
+    }
+}
+
+void ThreadPool::enqueue(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    jobAvailable.notify_one();
+}
+
+void ThreadPool::waitIdle()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    allDone.wait(lock, [this] { return jobs.empty() && runningJobs == 0; });
+}
+
+size_t ThreadPool::getPendingJobs()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return jobs.size() + runningJobs;
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    jobAvailable.notify_all();
+    for (std::thread& worker : workers) worker.join();
+}
@@ -0,0 +1,91 @@
+#include "TrajectoryFormat.h"
+
+#ifdef FLEAVES_HAS_LZ4
+#include <lz4.h>
+#endif
+#ifdef FLEAVES_HAS_ZSTD
+#include <zstd.h>
+#endif
+
+bool isCompressionAvailable(TrajectoryCompression compression)
+{
+    switch (compression) {
+        case TrajectoryCompression::none: return true;
+#ifdef FLEAVES_HAS_LZ4
+        case TrajectoryCompression::lz4: return true;
+#endif
+#ifdef FLEAVES_HAS_ZSTD
+        case TrajectoryCompression::zstd: return true;
+#endif
+        default: return false;
+    }
+}
+
+TrajectoryCompression defaultTrajectoryCompression()
+{
+    if(isCompressionAvailable(TrajectoryCompression::zstd)) return TrajectoryCompression::zstd;
+    if(isCompressionAvailable(TrajectoryCompression::lz4)) return TrajectoryCompression::lz4;
+    return TrajectoryCompression::none;
+}
+
+const char *compressionName(TrajectoryCompression compression)
+{
+    switch (compression) {
+        case TrajectoryCompression::none: return "none";
+        case TrajectoryCompression::lz4: return "lz4";
+        case TrajectoryCompression::zstd: return "zstd";
+    }
+    return "unknown";
+}
+
+bool compressChunk(TrajectoryCompression compression, const std::vector<uint8_t> &raw, std::vector<uint8_t> &compressed)
+{
+    switch (compression) {
+        case TrajectoryCompression::none:
+            compressed = raw;
+            return true;
+#ifdef FLEAVES_HAS_LZ4
+        case TrajectoryCompression::lz4: {
+            compressed.resize(LZ4_compressBound(static_cast<int>(raw.size())));
+            int size = LZ4_compress_default(reinterpret_cast<const char*>(raw.data()), reinterpret_cast<char*>(compressed.data()),
+                                            static_cast<int>(raw.size()), static_cast<int>(compressed.size()));
+            compressed.resize(size > 0 ? size : 0);
+            return size > 0;
+        }
+#endif
+#ifdef FLEAVES_HAS_ZSTD
+        case TrajectoryCompression::zstd: {
+            compressed.resize(ZSTD_compressBound(raw.size()));
+            //level 3 is the zstd default, fast enough to keep up with the recording on the I/O thread
+            size_t size = ZSTD_compress(compressed.data(), compressed.size(), raw.data(), raw.size(), 3);
+            if(ZSTD_isError(size)) return false;
+            compressed.resize(size);
+            return true;
+        }
+#endif
+        default:
+            return false;
+    }
+}
+
+bool decompressChunk(TrajectoryCompression compression, const uint8_t *data, size_t size, std::vector<uint8_t> &raw, size_t rawSize)
+{
+    raw.resize(rawSize);
+    switch (compression) {
+        case TrajectoryCompression::none:
+            if(size != rawSize) return false;
+            std::memcpy(raw.data(), data, size);
+            return true;
+#ifdef FLEAVES_HAS_LZ4
+        case TrajectoryCompression::lz4:
+            return LZ4_decompress_safe(reinterpret_cast<const char*>(data), reinterpret_cast<char*>(raw.data()),
+                                       static_cast<int>(size), static_cast<int>(rawSize)) == static_cast<int>(rawSize);
+#endif
+#ifdef FLEAVES_HAS_ZSTD
+        case TrajectoryCompression::zstd:
+            return ZSTD_decompress(raw.data(), rawSize, data, size) == rawSize;
+#endif
+        default:
+            return false;
+    }
+}
@@ -0,0 +1,259 @@
+#include "TrajectoryPlayer.h"
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+
+bool TrajectoryPlayer::open(const std::filesystem::path &path)
+{
+    close();
+    if(!file.open(path)) return false;
+    if(file.size() < sizeof(TrajectoryHeader)) {
+        std::cerr << path << " is not a trajectory recording" << std::endl;
+        return false;
+    }
+    std::memcpy(&header, file.data(), sizeof(TrajectoryHeader));
+    if(std::memcmp(header.magic, trajectoryMagic, sizeof(trajectoryMagic)) != 0 || header.version != trajectoryVersion
+       || header.headerSize != sizeof(TrajectoryHeader) || header.particleCount == 0 || header.positionScale <= 0.0f) {
+        std::cerr << path << " is not a trajectory recording of version " << trajectoryVersion << std::endl;
+        return false;
+    }
+    //the index is only written when the recording is stopped properly, otherwise walk the chunks
+    if((!readIndex() && !scanChunks()) || frameCount == 0) {
+        std::cerr << path << " does not contain any complete frames" << std::endl;
+        return false;
+    }
+    if(!readChunkTimes()) {
+        std::cerr << path << " has chunks without a valid step duration" << std::endl;
+        return false;
+    }
+
+    size_t valueCount = static_cast<size_t>(trajectoryStreamCount) * header.particleCount;
+    frame.values.assign(valueCount, 0);
+    previousFrame.values.assign(valueCount, 0);
+    positions.assign(header.particleCount, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    orientations.assign(header.particleCount, glm::uvec4(0u));
+    currentChunk = -1;
+    frameValid = false;
+    uploadedFrame = -1;
+    playbackTime = 0.0f;
+    playing = true;
+    opened = true;
+
+    std::cout << "Opened trajectory " << path << " | " << header.particleCount << " particles, " << frameCount << " frames in "
+              << index.size() << " chunks" << std::endl;
+    return true;
+}
+
+bool TrajectoryPlayer::readIndex()
+{
+    if(file.size() < sizeof(TrajectoryHeader) + sizeof(TrajectoryFooter)) return false;
+    TrajectoryFooter footer;
+    std::memcpy(&footer, file.data() + file.size() - sizeof(TrajectoryFooter), sizeof(TrajectoryFooter));
+    if(std::memcmp(footer.magic, trajectoryFooterMagic, sizeof(trajectoryFooterMagic)) != 0) return false;
+    uint64_t indexSize = static_cast<uint64_t>(footer.chunkCount) * sizeof(TrajectoryIndexEntry);
+    //the index sits right in front of the footer, compared without sums that could wrap around
+    if(footer.chunkCount == 0 || indexSize > file.size() - sizeof(TrajectoryHeader) - sizeof(TrajectoryFooter)
+       || footer.indexOffset != file.size() - sizeof(TrajectoryFooter) - indexSize
+       || footer.indexOffset < sizeof(TrajectoryHeader) + sizeof(TrajectoryChunkHeader)) return false;
+
+    index.resize(footer.chunkCount);
+    std::memcpy(index.data(), file.data() + footer.indexOffset, indexSize);
+    //every chunk has to lie between the header and the index and the chunks have to follow each other, a corrupt
+    //index falls back to walking the chunks
+    uint64_t chunkStart = sizeof(TrajectoryHeader), nextFrame = 0;
+    for (const TrajectoryIndexEntry& entry : index) {
+        if(entry.offset < chunkStart || entry.offset > footer.indexOffset - sizeof(TrajectoryChunkHeader)
+           || entry.firstFrame != nextFrame || entry.frameCount == 0) {
+            index.clear();
+            return false;
+        }
+        chunkStart = entry.offset + sizeof(TrajectoryChunkHeader);
+        nextFrame += entry.frameCount;
+    }
+    if(nextFrame != footer.frameCount) {
+        index.clear();
+        return false;
+    }
+    frameCount = footer.frameCount;
+    return true;
+}
+
+bool TrajectoryPlayer::scanChunks()
+{
+    index.clear();
+    frameCount = 0;
+    uint64_t offset = sizeof(TrajectoryHeader);
+    //compared without sums that could wrap around, like the index
+    while (sizeof(TrajectoryChunkHeader) <= file.size() - offset) {
+        TrajectoryChunkHeader chunkHeader;
+        std::memcpy(&chunkHeader, file.data() + offset, sizeof(TrajectoryChunkHeader));
+        if(std::memcmp(chunkHeader.magic, trajectoryChunkMagic, sizeof(trajectoryChunkMagic)) != 0) break;
+        //a chunk cut off by a crash is ignored, as is everything after a chunk that doesn't continue the frames
+        if(chunkHeader.storedSize > file.size() - offset - sizeof(TrajectoryChunkHeader)) break;
+        if(chunkHeader.firstFrame != frameCount || chunkHeader.frameCount == 0
+           || chunkHeader.frameCount > std::numeric_limits<uint32_t>::max() - frameCount) break;
+        index.push_back({offset, chunkHeader.firstFrame, chunkHeader.frameCount});
+        frameCount = chunkHeader.firstFrame + chunkHeader.frameCount;
+        offset += sizeof(TrajectoryChunkHeader) + chunkHeader.storedSize;
+    }
+    return !index.empty();
+}
+
+bool TrajectoryPlayer::readChunkTimes()
+{
+    //the index only points at the chunk headers, which are in the file already
+    chunkStarts.clear();
+    frameDurations.clear();
+    float time = 0.0f;
+    for (const TrajectoryIndexEntry& entry : index) {
+        TrajectoryChunkHeader chunkHeader;
+        std::memcpy(&chunkHeader, file.data() + entry.offset, sizeof(TrajectoryChunkHeader));
+        float frameDuration = header.stepsPerFrame * chunkHeader.fixedDT;
+        if(!(frameDuration > 0.0f) || !std::isfinite(frameDuration)) return false;
+        chunkStarts.push_back(time);
+        frameDurations.push_back(frameDuration);
+        time += entry.frameCount * frameDuration;
+    }
+    duration = time;
+    return std::isfinite(duration);
+}
+
+int TrajectoryPlayer::chunkOf(uint32_t frameIndex) const
+{
+    //the index is sorted by frame
+    int chunk = static_cast<int>(index.size()) - 1;
+    for (int low = 0, high = chunk; low <= high; ) {
+        int middle = (low + high) / 2;
+        if(frameIndex < index[middle].firstFrame) high = middle - 1;
+        else if(frameIndex >= index[middle].firstFrame + index[middle].frameCount) low = middle + 1;
+        else return middle;
+    }
+    return chunk;
+}
+
+bool TrajectoryPlayer::loadChunk(int chunk)
+{
+    const TrajectoryIndexEntry& entry = index[chunk];
+    TrajectoryChunkHeader chunkHeader = {};
+    bool inFile = entry.offset <= file.size() && file.size() - entry.offset >= sizeof(TrajectoryChunkHeader);
+    if(inFile) std::memcpy(&chunkHeader, file.data() + entry.offset, sizeof(TrajectoryChunkHeader));
+    inFile = inFile && chunkHeader.storedSize <= file.size() - entry.offset - sizeof(TrajectoryChunkHeader);
+    const uint8_t* payload = inFile ? file.data() + entry.offset + sizeof(TrajectoryChunkHeader) : nullptr;
+    if(!inFile || !decompressChunk(static_cast<TrajectoryCompression>(chunkHeader.compression), payload, chunkHeader.storedSize, chunkData, chunkHeader.rawSize)) {
+        std::cerr << "Could not decode chunk " << chunk << " of the trajectory (compression "
+                  << compressionName(static_cast<TrajectoryCompression>(chunkHeader.compression)) << ")" << std::endl;
+        currentChunk = -1;
+        return false;
+    }
+    currentChunk = chunk;
+    chunkCursor = chunkData.data();
+    frameValid = false;
+    return true;
+}
+
+bool TrajectoryPlayer::decodeFrame(uint32_t frameIndex)
+{
+    int chunk = chunkOf(frameIndex);
+
+    //continue from the last decoded frame if possible, otherwise start over at the keyframe of the chunk
+    bool canContinue = chunk == currentChunk && frameValid && decodedFrame <= frameIndex;
+    if(!canContinue) {
+        if(chunk != currentChunk && !loadChunk(chunk)) return false;
+        chunkCursor = chunkData.data();
+        frameValid = false;
+    }
+    if(frameValid && decodedFrame == frameIndex) return true;
+
+    const uint8_t* end = chunkData.data() + chunkData.size();
+    uint32_t next = frameValid ? decodedFrame + 1 : index[chunk].firstFrame;
+    for (; next <= frameIndex; next++) {
+        std::swap(frame, previousFrame);
+        bool keyframe = next == index[chunk].firstFrame;
+        if(!decodeTrajectoryFrame(chunkCursor, end, frame, keyframe ? nullptr : &previousFrame)) {
+            std::cerr << "Trajectory frame " << next << " is corrupt" << std::endl;
+            frameValid = false;
+            return false;
+        }
+        decodedFrame = next;
+        frameValid = true;
+    }
+    return true;
+}
+
+void TrajectoryPlayer::update(float dT, Emitter &emitter, float speed)
+{
+    if(!opened) return;
+    if(playing) {
+        playbackTime = std::fmod(playbackTime + dT * speed, duration);
+        if(playbackTime < 0.0f) playbackTime += duration;
+    }
+    //the last chunk that starts at or before the playback time, then the frame in it
+    int chunk = std::max(static_cast<int>(std::upper_bound(chunkStarts.begin(), chunkStarts.end(), playbackTime) - chunkStarts.begin()) - 1, 0);
+    uint32_t frameInChunk = static_cast<uint32_t>((playbackTime - chunkStarts[chunk]) / frameDurations[chunk]);
+    uint32_t frameIndex = index[chunk].firstFrame + std::min(frameInChunk, index[chunk].frameCount - 1);
+    if(static_cast<int>(frameIndex) == uploadedFrame) return;
+    if(!decodeFrame(frameIndex)) return;
+
+    //back to floats and the packed orientation layout of the particle buffers, the angular velocity is not recorded.
+    //The variant goes back into the upper bits of w, where the leaf shader picks its texture layer, and the fade into the
+    //position w, so dead particles are drawn at zero size and dying ones shrink like in the simulation
+    uint32_t count = header.particleCount;
+    const int32_t* values = frame.values.data();
+    float invScale = 1.0f / header.positionScale;
+    for (uint32_t i = 0; i < count; i++) {
+        positions[i] = glm::vec4(values[i] * invScale, values[count + i] * invScale, values[2 * count + i] * invScale,
+                                 unpackFade(values[7 * count + i]));
+        orientations[i] = glm::uvec4((static_cast<uint32_t>(values[3 * count + i]) & 0xffff) | (static_cast<uint32_t>(values[4 * count + i]) << 16),
+                                     (static_cast<uint32_t>(values[5 * count + i]) & 0xffff) | (static_cast<uint32_t>(values[6 * count + i]) << 16),
+                                     0u, static_cast<uint32_t>(values[7 * count + i]) & 0xffff0000u);
+    }
+    emitter.uploadParticleFrame(static_cast<int>(count), positions.data(), orientations.data());
+    uploadedFrame = static_cast<int>(frameIndex);
+}
+
+void TrajectoryPlayer::seek(uint32_t frameIndex)
+{
+    if(!opened) return;
+    frameIndex = std::min(frameIndex, frameCount - 1);
+    //the middle of the frame, so rounding never lands on the previous one
+    int chunk = chunkOf(frameIndex);
+    playbackTime = chunkStarts[chunk] + (frameIndex - index[chunk].firstFrame + 0.5f) * frameDurations[chunk];
+}
+
+void TrajectoryPlayer::close()
+{
+    opened = false;
+    file.close();
+    index.clear();
+    chunkStarts.clear();
+    frameDurations.clear();
+    chunkData.clear();
+    currentChunk = -1;
+    frameValid = false;
+    frameCount = 0;
+}
+
+bool TrajectoryPlayer::isOpen() const
+{
+    return opened;
+}
+
+void TrajectoryPlayer::setPlaying(bool playing)
+{
+    this->playing = playing;
+}
+
+bool TrajectoryPlayer::isPlaying() const
+{
+    return playing;
+}
+
+uint32_t TrajectoryPlayer::getFrameCount() const
+{
+    return frameCount;
+}
+
+uint32_t TrajectoryPlayer::getCurrentFrame() const
+{
+    return uploadedFrame < 0 ? 0 : static_cast<uint32_t>(uploadedFrame);
+}
@@ -0,0 +1,250 @@
+#include "TrajectoryRecorder.h"
+#include <chrono>
+#include <type_traits>
+
+static_assert(std::is_trivially_copyable_v<TrajectoryHeader> && sizeof(TrajectoryHeader) == 48, "written as raw bytes");
+static_assert(sizeof(TrajectoryChunkHeader) == 40 && sizeof(TrajectoryIndexEntry) == 16 && sizeof(TrajectoryFooter) == 24, "written as raw bytes");
+
+bool TrajectoryRecorder::start(const std::filesystem::path &path, const Emitter &emitter, int stepsPerFrame,
+                               TrajectoryCompression compression, int framesPerChunk, float positionScale)
+{
+    if(recording) stop();
+    if(!isCompressionAvailable(compression)) {
+        std::cerr << "Compression " << compressionName(compression) << " is not available in this build, recording uncompressed" << std::endl;
+        compression = TrajectoryCompression::none;
+    }
+
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if(!file) {
+        std::cerr << "Could not open " << path << " for recording" << std::endl;
+        return false;
+    }
+    this->path = path;
+
+    header = TrajectoryHeader{};
+    std::memcpy(header.magic, trajectoryMagic, sizeof(trajectoryMagic));
+    header.version = trajectoryVersion;
+    header.headerSize = sizeof(TrajectoryHeader);
+    header.particleCount = static_cast<uint32_t>(emitter.getParticleCount());
+    header.stepsPerFrame = static_cast<uint32_t>(std::max(stepsPerFrame, 1));
+    header.fixedDT = emitter.getFixedDT();
+    header.positionScale = positionScale;
+    header.framesPerChunk = static_cast<uint32_t>(std::max(framesPerChunk, 1));
+    header.compression = static_cast<uint32_t>(compression);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    bytesWritten = sizeof(header);
+
+    size_t valueCount = static_cast<size_t>(trajectoryStreamCount) * header.particleCount;
+    previousFrame.values.assign(valueCount, 0);
+    currentFrame.values.assign(valueCount, 0);
+    chunkData.clear();
+    index.clear();
+    frameCount = 0;
+    chunkFrameCount = 0;
+    droppedFrames = 0;
+    stopRequested = false;
+    encodeQueue.clear();
+
+    recording = true;
+    ioThread = std::thread(&TrajectoryRecorder::ioLoop, this);
+    std::cout << "Recording " << header.particleCount << " particles every " << header.stepsPerFrame << " steps to " << path
+              << " (compression: " << compressionName(compression) << ")" << std::endl;
+    return true;
+}
+
+void TrajectoryRecorder::onStep(const Emitter &emitter)
+{
+    if(!recording) return;
+    if(static_cast<uint32_t>(emitter.getParticleCount()) != header.particleCount) {
+        std::cout << "Particle count changed, recording stopped" << std::endl;
+        stop();
+        return;
+    }
+    uint32_t stepIndex = emitter.getStepIndex();
+    if(stepIndex % header.stepsPerFrame != 0) return;
+
+    auto hasIdleSlot = [this] {
+        for (Slot& slot : slots) if(slot.state == SlotState::idle) return true;
+        return false;
+    };
+    if(lossless && !hasIdleSlot()) {
+        //hand the oldest copy over and wait until the I/O thread gives a slot back
+        if(Slot* slot = oldestCopyingSlot(); slot != nullptr && slot->readback.wait()) queueForEncoding(*slot);
+        std::unique_lock<std::mutex> lock(queueMutex);
+        slotFreed.wait(lock, hasIdleSlot);
+    }
+    for (Slot& slot : slots) {
+        if(slot.state == SlotState::idle) {
+            slot.stepIndex = stepIndex;
+            slot.fixedDT = emitter.getFixedDT();
+            slot.state = SlotState::copying;
+            emitter.readParticleStateAsync(slot.readback, false);
+            return;
+        }
+    }
+    //both staging buffers are still in flight, better lose a frame than stall the simulation
+    droppedFrames++;
+}
+
+void TrajectoryRecorder::setLossless(bool lossless)
+{
+    this->lossless = lossless;
+}
+
+void TrajectoryRecorder::poll()
+{
+    if(!recording) return;
+    //hand the slots over in capture order, a later copy can't be done before an earlier one anyway
+    while (Slot* slot = oldestCopyingSlot()) {
+        if(!slot->readback.ready()) break;
+        queueForEncoding(*slot);
+    }
+}
+
+TrajectoryRecorder::Slot *TrajectoryRecorder::oldestCopyingSlot()
+{
+    Slot* oldest = nullptr;
+    for (Slot& slot : slots) {
+        if(slot.state == SlotState::copying && (oldest == nullptr || slot.stepIndex < oldest->stepIndex)) oldest = &slot;
+    }
+    return oldest;
+}
+
+void TrajectoryRecorder::queueForEncoding(Slot &slot)
+{
+    slot.state = SlotState::encoding;
+    std::lock_guard<std::mutex> lock(queueMutex);
+    encodeQueue.push_back(static_cast<int>(&slot - slots));
+    queueCondition.notify_one();
+}
+
+void TrajectoryRecorder::ioLoop()
+{
+    while (true) {
+        int slotIndex;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCondition.wait(lock, [this] { return !encodeQueue.empty() || stopRequested; });
+            if(encodeQueue.empty()) break; //stop requested and nothing left to write
+            slotIndex = encodeQueue.front();
+            encodeQueue.pop_front();
+        }
+        encodeSlot(slots[slotIndex]);
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            slots[slotIndex].state = SlotState::idle;
+        }
+        slotFreed.notify_all();
+    }
+    finishFile();
+}
+
+void TrajectoryRecorder::encodeSlot(Slot &slot)
+{
+    const void* data = slot.readback.data();
+    if(data == nullptr) return;
+    uint32_t count = header.particleCount;
+    const glm::vec4* positions = static_cast<const glm::vec4*>(data);
+    const glm::uvec4* orientations = reinterpret_cast<const glm::uvec4*>(positions + count);
+
+    //frames with another step duration go into a chunk of their own, so the playback keeps the timing
+    if(chunkFrameCount > 0 && slot.fixedDT != chunkFixedDT) flushChunk();
+    chunkFixedDT = slot.fixedDT;
+
+    //quantize into the streams
+    currentFrame.stepIndex = slot.stepIndex;
+    int32_t* values = currentFrame.values.data();
+    for (uint32_t i = 0; i < count; i++) {
+        values[i] = quantizePosition(positions[i].x, header.positionScale);
+        values[count + i] = quantizePosition(positions[i].y, header.positionScale);
+        values[2 * count + i] = quantizePosition(positions[i].z, header.positionScale);
+        //the orientation is already quantized, the snorm16 halves are used as they are
+        values[3 * count + i] = static_cast<int16_t>(orientations[i].x & 0xffff);
+        values[4 * count + i] = static_cast<int16_t>(orientations[i].x >> 16);
+        values[5 * count + i] = static_cast<int16_t>(orientations[i].y & 0xffff);
+        values[6 * count + i] = static_cast<int16_t>(orientations[i].y >> 16);
+        values[7 * count + i] = packVariantAndFade(orientations[i].w >> 16, positions[i].w);
+    }
+
+    encodeTrajectoryFrame(chunkData, currentFrame, chunkFrameCount == 0 ? nullptr : &previousFrame);
+    std::swap(previousFrame, currentFrame);
+    chunkFrameCount++;
+    frameCount++;
+    if(chunkFrameCount == header.framesPerChunk) flushChunk();
+}
+
+void TrajectoryRecorder::flushChunk()
+{
+    if(chunkFrameCount == 0) return;
+    TrajectoryCompression compression = static_cast<TrajectoryCompression>(header.compression);
+    const std::vector<uint8_t>* payload = &chunkData;
+    if(compression != TrajectoryCompression::none) {
+        if(compressChunk(compression, chunkData, compressedData)) payload = &compressedData;
+        else compression = TrajectoryCompression::none; //the chunk header says how each chunk is stored
+    }
+
+    TrajectoryChunkHeader chunkHeader{};
+    std::memcpy(chunkHeader.magic, trajectoryChunkMagic, sizeof(trajectoryChunkMagic));
+    chunkHeader.firstFrame = frameCount - chunkFrameCount;
+    chunkHeader.frameCount = chunkFrameCount;
+    chunkHeader.compression = static_cast<uint32_t>(compression);
+    chunkHeader.rawSize = chunkData.size();
+    chunkHeader.storedSize = payload->size();
+    chunkHeader.fixedDT = chunkFixedDT;
+
+    index.push_back({bytesWritten, chunkHeader.firstFrame, chunkHeader.frameCount});
+    file.write(reinterpret_cast<const char*>(&chunkHeader), sizeof(chunkHeader));
+    file.write(reinterpret_cast<const char*>(payload->data()), payload->size());
+    bytesWritten += sizeof(chunkHeader) + payload->size();
+
+    chunkData.clear();
+    chunkFrameCount = 0;
+}
+
+void TrajectoryRecorder::finishFile()
+{
+    flushChunk();
+    TrajectoryFooter footer{};
+    footer.indexOffset = bytesWritten;
+    footer.chunkCount = static_cast<uint32_t>(index.size());
+    footer.frameCount = frameCount;
+    std::memcpy(footer.magic, trajectoryFooterMagic, sizeof(trajectoryFooterMagic));
+    file.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(TrajectoryIndexEntry));
+    file.write(reinterpret_cast<const char*>(&footer), sizeof(footer));
+    bytesWritten += index.size() * sizeof(TrajectoryIndexEntry) + sizeof(footer);
+    if(!file) std::cerr << "Writing the trajectory " << path << " failed" << std::endl;
+    file.close();
+}
+
+void TrajectoryRecorder::stop()
+{
+    if(!recording) return;
+    //copies that are still in flight belong to the recording, wait for them and hand them over
+    while (Slot* slot = oldestCopyingSlot()) {
+        if(slot->readback.wait()) queueForEncoding(*slot);
+        else slot->state = SlotState::idle;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopRequested = true;
+    }
+    queueCondition.notify_one();
+    if(ioThread.joinable()) ioThread.join();
+    recording = false;
+
+    uint64_t rawSize = static_cast<uint64_t>(frameCount) * header.particleCount * sizeof(glm::mat4);
+    std::cout << "Recorded " << frameCount << " frames to " << path << " | " << bytesWritten / 1024 << "KB, "
+              << (rawSize > 0 ? 100.0 * bytesWritten / rawSize : 0.0) << "% of the raw mat4 size";
+    if(droppedFrames > 0) std::cout << " | " << droppedFrames << " frames dropped";
+    std::cout << std::endl;
+}
+
+bool TrajectoryRecorder::isRecording() const
+{
+    return recording;
+}
+
+TrajectoryRecorder::~TrajectoryRecorder()
+{
+    stop();
+}
@@ -1,7 +1,37 @@
 #include "UI.h"
+#include <iostream>
 
+//shapes of the spawn rate over time, as factors on the spawn rate
+static const char* rateCurveNames[] = {"Constant", "Ramp Up", "Fade Out", "Swell"};
 
-UI::UI(SDL_Window* window, SDL_GLContext context)
+static std::vector<glm::vec2> rateCurvePreset(int preset)
+{
+    switch (preset) {
+        case 1: return {{0.0f, 0.0f}, {5.0f, 1.0f}};
+        case 2: return {{0.0f, 1.0f}, {10.0f, 0.0f}};
+        case 3: return {{0.0f, 0.2f}, {3.0f, 1.0f}, {6.0f, 0.2f}, {9.0f, 1.0f}};
+        default: return {};
+    }
+}
+
+//the rate curve and the bursts of one emitter, the curves and bursts start over with every respawn
+static void spawnTimingControls(std::vector<glm::vec2>& rateCurve, int& burstCount, float& burstInterval)
+{
+    int preset = -1; //a curve from the command line matches none of them
+    for (int i = 0; i < IM_ARRAYSIZE(rateCurveNames); i++) {
+        if(rateCurvePreset(i) == rateCurve) preset = i;
+    }
+    if (ImGui::Combo("Rate Curve", &preset, rateCurveNames, IM_ARRAYSIZE(rateCurveNames))) {
+        rateCurve = rateCurvePreset(preset);
+    }
+    if (ImGui::InputInt("Burst", &burstCount, 10, 100)) {
+        burstCount = glm::clamp(burstCount, 0, 10000000);
+    }
+    ImGui::SliderFloat("Burst Every", &burstInterval, 0.0f, 10.0f, burstInterval > 0.0f ? "%.1f s" : "once");
+}
+
+
+UI::UI(SDL_Window* window, SDL_GLContext context, CommandQueue& commands) : commands(commands)
 {
     // Setup ImGui context
     IMGUI_CHECKVERSION();
@@ -70,19 +100,32 @@ void UI::update(EmitterParams& emitterParams)
 
     ImGui::Spacing();
 
-    // ImGui::Text("Motion:");
-    // float buttonWidth = (ImGui::GetContentRegionAvail().x - ImGui::GetStyle().ItemSpacing.x) / 2.0f;
-    // if (ImGui::Button(emitterParams.spiralingMotion ? "Spiraling: ON" : "Spiraling: OFF", 
-    //                 ImVec2(buttonWidth, 0))) {
-    //     emitterParams.spiralingMotion = !emitterParams.spiralingMotion;
-    // }
-    // ImGui::SameLine();
-    // if (ImGui::Button(emitterParams.tumbling ? "Tumbling: ON" : "Tumbling: OFF", 
-    //                 ImVec2(buttonWidth, 0))) {
-    //     emitterParams.tumbling = !emitterParams.tumbling;
-    // }
+    ImGui::Text("Motion:");
+    float buttonWidth = (ImGui::GetContentRegionAvail().x - ImGui::GetStyle().ItemSpacing.x) / 2.0f;
+    if (ImGui::Button(emitterParams.spiralingMotion ? "Spiraling: ON" : "Spiraling: OFF", 
+                    ImVec2(buttonWidth, 0))) {
+        emitterParams.spiralingMotion = !emitterParams.spiralingMotion;
+    }
+    ImGui::SameLine();
+    if (ImGui::Button(emitterParams.tumbling ? "Tumbling: ON" : "Tumbling: OFF", 
+                    ImVec2(buttonWidth, 0))) {
+        emitterParams.tumbling = !emitterParams.tumbling;
+    }
+    ImGui::SameLine();
+    ImGui::TextDisabled("(?)");
+    if (ImGui::IsItemHovered(ImGuiHoveredFlags_DelayShort)) {
+        ImGui::SetTooltip("Tumbling: orientation dependent drag and aerodynamic torque\nSpiraling: lift from the leaf's spin, needs tumbling");
+    }
 
-    // ImGui::Spacing();
+    ImGui::Spacing();
+
+    ImGui::Text("Physics Rate:");
+    ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x * 0.9f);
+    //the frames in between are interpolated, so lower rates stay smooth but react later
+    ImGui::SliderFloat("##physicsRate", &emitterParams.physicsRate, 10.0f, 120.0f, "%.1f Hz");
+    ImGui::PopItemWidth();
+
+    ImGui::Spacing();
 
     ImGui::Text("Particle Count:");
     ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x * 0.6f);
@@ -90,13 +133,25 @@ void UI::update(EmitterParams& emitterParams)
     if (ImGui::InputInt("##particleCount", &emitterParams.leafCount, 100, 1000, ImGuiInputTextFlags_EnterReturnsTrue)) {
         // Validate when Enter is pressed
         emitterParams.leafCount = glm::clamp(emitterParams.leafCount, 1, 10000000);
-        SDL_Event event {.type = PARTICLE_COUNT_UPDATED_EVENT};
-        SDL_PushEvent(&event);
+        send(CommandType::resizeParticles);
     }
 
-    // Display actual count
+    // Display actual count, with a spawn rate it is the most particles that can be alive at once
     ImGui::SameLine();
-    ImGui::TextDisabled("(%d)", emitterParams.leafCount);
+    bool spawning = emitterParams.spawnRate > 0.0f || emitterParams.burstCount > 0;
+    ImGui::TextDisabled(spawning ? "(at most %d alive)" : "(%d)", emitterParams.leafCount);
+
+    ImGui::Spacing();
+
+    ImGui::Text("Seed:");
+    ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x * 0.6f);
+    int seed = static_cast<int>(emitterParams.seed);
+    if (ImGui::InputInt("##seed", &seed, 1, 100, ImGuiInputTextFlags_EnterReturnsTrue)) {
+        emitterParams.seed = static_cast<unsigned int>(seed);
+        //restart the simulation so the run only depends on the new seed
+        send(CommandType::changeEmitArea);
+    }
+    ImGui::PopItemWidth();
 
     ImGui::Spacing();
 
@@ -105,9 +160,9 @@ void UI::update(EmitterParams& emitterParams)
     ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x * 0.9f);
     ImGui::SliderFloat("##emitRadius", &emitterParams.emitRadius, 0.1f, 100.0f, "%.1f m");
 
-    if(ImGui::IsItemDeactivatedAfterEdit()) {
-        SDL_Event event {.type = EMIT_AREA_CHANGED_EVENT}; 
-        SDL_PushEvent(&event);
+    //new spawns pick up the radius right away, the particles in flight keep going unless a restart is wanted
+    if(ImGui::IsItemDeactivatedAfterEdit() && respawnOnAreaChange) {
+        send(CommandType::changeEmitArea);
     }
     ImGui::PopItemWidth();
 
@@ -121,6 +176,30 @@ void UI::update(EmitterParams& emitterParams)
 
     ImGui::Spacing();
 
+    ImGui::Text("Spawn Rate:");
+    ImGui::SameLine();
+    ImGui::TextDisabled("(?)");
+    if (ImGui::IsItemHovered(ImGuiHoveredFlags_DelayShort)) {
+        ImGui::SetTooltip("0: all particles are in the air and respawn when they land\nAbove 0: new particles per second, landed and expired ones are recycled\n"
+                          "The curve scales the rate over time, bursts add many particles at once");
+    }
+    ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x * 0.9f);
+    ImGui::SliderFloat("##spawnRate", &emitterParams.spawnRate, 0.0f, 20000.0f, "%.0f / s");
+    spawnTimingControls(emitterParams.rateCurve, emitterParams.burstCount, emitterParams.burstInterval);
+    ImGui::PopItemWidth();
+
+    ImGui::Text("Lifetime:");
+    ImGui::SameLine();
+    ImGui::TextDisabled("(?)");
+    if (ImGui::IsItemHovered(ImGuiHoveredFlags_DelayShort)) {
+        ImGui::SetTooltip("0: until the particle lands\nAbove 0: the particle shrinks away at the end and dies");
+    }
+    ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x * 0.9f);
+    ImGui::SliderFloat("##lifetime", &emitterParams.lifetime, 0.0f, 30.0f, "%.1f s");
+    ImGui::PopItemWidth();
+
+    ImGui::Spacing();
+
     ImGui::Text("Emitter Shape:");
     ImGui::Spacing();
     ImGui::Indent(10.0f);
@@ -128,21 +207,97 @@ void UI::update(EmitterParams& emitterParams)
     ImGui::PushStyleVar(ImGuiStyleVar_FramePadding, ImVec2(4, 4));
     if (ImGui::RadioButton("Circle", emitterParams.shape == EmitterShape::circleShape)) {
         emitterParams.shape = EmitterShape::circleShape;
-        SDL_Event event {.type = EMIT_AREA_CHANGED_EVENT}; 
-        SDL_PushEvent(&event);
+        if(respawnOnAreaChange) send(CommandType::changeEmitArea);
 
     }
     ImGui::SameLine();
     if (ImGui::RadioButton("Box", emitterParams.shape == EmitterShape::boxShape)) {
         emitterParams.shape = EmitterShape::boxShape;
-        SDL_Event event {.type = EMIT_AREA_CHANGED_EVENT}; 
-        SDL_PushEvent(&event);
+        if(respawnOnAreaChange) send(CommandType::changeEmitArea);
 
     }
+    ImGui::SameLine();
+    if (ImGui::RadioButton("Disc", emitterParams.shape == EmitterShape::discShape)) {
+        emitterParams.shape = EmitterShape::discShape;
+        if(respawnOnAreaChange) send(CommandType::changeEmitArea);
+    }
+    if (ImGui::RadioButton("Sphere##emitter", emitterParams.shape == EmitterShape::sphereShape)) {
+        emitterParams.shape = EmitterShape::sphereShape;
+        if(respawnOnAreaChange) send(CommandType::changeEmitArea);
+    }
+    ImGui::SameLine();
+    if (ImGui::RadioButton("Tree Crown", emitterParams.shape == EmitterShape::meshShape)) {
+        emitterParams.shape = EmitterShape::meshShape;
+        if(respawnOnAreaChange) send(CommandType::changeEmitArea);
+    }
     ImGui::PopStyleVar();
     ImGui::Unindent(10.0f);
     ImGui::Spacing();
 
+    ImGui::Checkbox("Respawn on Area Change", &respawnOnAreaChange);
+    ImGui::SameLine();
+    ImGui::TextDisabled("(?)");
+    if (ImGui::IsItemHovered(ImGuiHoveredFlags_DelayShort)) {
+        ImGui::SetTooltip("Off: leaves in the air keep falling, only new spawns use the new radius and shape\nOn: every change restarts all leaves");
+    }
+    ImGui::Spacing();
+
+    ImGui::Text("More Emitters:");
+    ImGui::SameLine();
+    ImGui::TextDisabled("(?)");
+    if (ImGui::IsItemHovered(ImGuiHoveredFlags_DelayShort)) {
+        ImGui::SetTooltip("Every emitter spawns its own particles, all of them share the buffers and are simulated and drawn together");
+    }
+    int removedEmitter = -1;
+    for (size_t i = 0; i < emitterParams.emitters.size(); i++) {
+        EmitterSource& source = emitterParams.emitters[i];
+        ImGui::PushID(static_cast<int>(i));
+        if (ImGui::TreeNode("emitter", "Emitter %d", static_cast<int>(i) + 2)) {
+            ImGui::DragFloat3("Origin", &source.origin.x, 0.1f, -50.0f, 50.0f, "%.1f");
+            ImGui::SliderFloat("Radius", &source.emitRadius, 0.1f, 100.0f, "%.1f m");
+            ImGui::SliderFloat("Height", &source.emitHeight, 0.1f, 200.0f, "%.1f m");
+            //same order as EmitterShape
+            const char* shapes[] = {"Box", "Circle", "Disc", "Sphere", "Tree Crown"};
+            int shape = static_cast<int>(source.shape);
+            if (ImGui::Combo("Shape", &shape, shapes, IM_ARRAYSIZE(shapes))) {
+                source.shape = static_cast<EmitterShape>(shape);
+            }
+            if (ImGui::InputInt("Particles", &source.leafCount, 100, 1000, ImGuiInputTextFlags_EnterReturnsTrue)) {
+                source.leafCount = glm::clamp(source.leafCount, 1, 10000000);
+                send(CommandType::resizeParticles);
+            }
+            ImGui::SliderFloat("Spawn Rate", &source.spawnRate, 0.0f, 20000.0f, "%.0f / s");
+            spawnTimingControls(source.rateCurve, source.burstCount, source.burstInterval);
+            ImGui::SliderFloat("Lifetime", &source.lifetime, 0.0f, 30.0f, "%.1f s");
+            if (ImGui::Button("Remove")) {
+                removedEmitter = static_cast<int>(i);
+            }
+            ImGui::TreePop();
+        }
+        ImGui::PopID();
+    }
+    if(removedEmitter >= 0) {
+        emitterParams.emitters.erase(emitterParams.emitters.begin() + removedEmitter);
+        send(CommandType::resizeParticles);
+    }
+    if(emitterParams.emitters.size() + 1 < maxEmitters && ImGui::Button("Add Emitter", ImVec2{-1, 0})) {
+        //around the main emitter, so the new one is visible right away
+        EmitterSource source;
+        float angle = emitterParams.emitters.size() * 2.4f;
+        source.origin = glm::vec3(cosf(angle) * 12.0f, 0.0f, sinf(angle) * 12.0f);
+        emitterParams.emitters.push_back(source);
+        send(CommandType::resizeParticles);
+    }
+    ImGui::Spacing();
+
+    ImGui::Checkbox("Scene Colliders", &emitterParams.sceneColliders);
+    ImGui::SameLine();
+    ImGui::TextDisabled("(?)");
+    if (ImGui::IsItemHovered(ImGuiHoveredFlags_DelayShort)) {
+        ImGui::SetTooltip("Leaves bounce off, slide down and settle on the house, wall and tree");
+    }
+    ImGui::Spacing();
+
     //#######################################################################################################################################
     //PARTICLE SETTINGS
     //#######################################################################################################################################
@@ -218,12 +373,10 @@ void UI::update(EmitterParams& emitterParams)
 
     if (ImGui::Button("Reset to Defaults", ImVec2(-1, 0))) {
         if(emitterParams.shape != EmitterShape::circleShape || emitterParams.size != 20.0f){
-            SDL_Event event {.type = EMIT_AREA_CHANGED_EVENT}; 
-            SDL_PushEvent(&event);
+            send(CommandType::changeEmitArea);
         }
-        if(emitterParams.leafCount != 10000) {
-            SDL_Event event {.type = PARTICLE_COUNT_UPDATED_EVENT}; 
-            SDL_PushEvent(&event);
+        if(emitterParams.leafCount != 10000 || !emitterParams.emitters.empty()) {
+            send(CommandType::resizeParticles);
         }
         emitterParams = EmitterParams {
         glm::vec3(0.0f, 0.0f, 0.0f),  // windForce
@@ -247,15 +400,104 @@ void UI::update(EmitterParams& emitterParams)
     ImGui::Spacing();
     float width = (ImGui::GetContentRegionAvail().x - ImGui::GetStyle().ItemSpacing.x) / 2.0f;
     if(ImGui::Button("Start", ImVec2{width, 0})){
-        SDL_Event event {.type = START_SIMULATION_EVENT}; 
-        // Push the event to SDLs event queue
-        SDL_PushEvent(&event);
+        send(CommandType::startSimulation);
     }
     ImGui::SameLine();
     if(ImGui::Button("Stop", ImVec2{width, 0})){
-        SDL_Event event {.type = STOP_SIMULATION_EVENT}; 
-        // Push the event to SDLs event queue
-        SDL_PushEvent(&event);
+        send(CommandType::stopSimulation);
+    }
+
+    if(ImGui::Button("Benchmark Physics", ImVec2{-1, 0})){
+        send(CommandType::benchmarkPhysics);
+    }
+    if(ImGui::Button("Benchmark Spawning", ImVec2{-1, 0})){
+        send(CommandType::benchmarkSpawn);
+    }
+
+    ImGui::Spacing();
+    ImGui::Text("Snapshot:");
+    ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x * 0.9f);
+    ImGui::InputText("##snapshotPath", snapshotPath, sizeof(snapshotPath));
+    ImGui::PopItemWidth();
+    if(ImGui::Button("Save", ImVec2{width, 0})){
+        send(CommandType::saveSnapshot);
+    }
+    ImGui::SameLine();
+    if(ImGui::Button("Load", ImVec2{width, 0})){
+        send(CommandType::loadSnapshot);
+    }
+
+    ImGui::Spacing();
+    ImGui::Text("Trajectory Recording:");
+    ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x * 0.9f);
+    ImGui::InputText("##trajectoryPath", trajectoryPath, sizeof(trajectoryPath));
+    ImGui::SliderInt("##recordEvery", &recordEverySteps, 1, 10, "every %d steps");
+    ImGui::PopItemWidth();
+    if(ImGui::Button(recording ? "Stop Recording" : "Start Recording", ImVec2{-1, 0})){
+        send(CommandType::toggleRecording);
+    }
+
+    ImGui::Spacing();
+    ImGui::Text("Trajectory Playback:");
+    ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x * 0.9f);
+    ImGui::InputText("##playbackPath", playbackPath, sizeof(playbackPath));
+    ImGui::PopItemWidth();
+    if(ImGui::Button(playbackOpen ? "Close Playback" : "Open Playback", ImVec2{-1, 0})){
+        send(CommandType::togglePlayback);
+    }
+    if(playbackOpen) {
+        if(ImGui::Button(playbackPlaying ? "Pause" : "Play", ImVec2{width, 0})){
+            send(CommandType::pausePlayback);
+        }
+        ImGui::SameLine();
+        ImGui::PushItemWidth(width);
+        ImGui::SliderFloat("##playbackSpeed", &playbackSpeed, 0.1f, 4.0f, "%.1fx");
+        ImGui::PopItemWidth();
+        ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x * 0.9f);
+        int frame = playbackFrame;
+        //scrubbing sends a seek for every frame the slider passes, the player only decodes what it needs for the last one
+        if(ImGui::SliderInt("##playbackFrame", &frame, 0, std::max(playbackFrameCount - 1, 0), "frame %d")) {
+            send(CommandType::seekPlayback, frame);
+        }
+        ImGui::PopItemWidth();
+    }
+
+    ImGui::Spacing();
+    ImGui::Text("Frame Capture:");
+    ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x * 0.9f);
+    ImGui::InputText("##capturePath", capturePath, sizeof(capturePath));
+    ImGui::PopItemWidth();
+    //settings only apply when a capture is started
+    ImGui::BeginDisabled(capturing);
+    ImGui::RadioButton("PNG", &captureFormat, 0);
+    ImGui::SameLine();
+    ImGui::RadioButton("Y4M", &captureFormat, 1);
+    ImGui::SameLine();
+    ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x * 0.9f);
+    ImGui::InputFloat("##captureFps", &captureFps, 0.0f, 0.0f, "%.0f fps");
+    ImGui::PopItemWidth();
+    captureFps = glm::clamp(captureFps, 1.0f, 240.0f);
+    ImGui::EndDisabled();
+    if(ImGui::Button(capturing ? "Stop Capture" : "Start Capture", ImVec2{-1, 0})){
+        send(CommandType::toggleCapture);
+    }
+    if(capturing) ImGui::Text("%d frames captured", capturedFrames);
+
+    ImGui::Spacing();
+    ImGui::Text("Frame Governor:");
+    ImGui::Checkbox("##governorEnabled", &governorEnabled);
+    ImGui::SameLine();
+    ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x * 0.9f);
+    ImGui::SliderFloat("##governorFps", &governorFps, 20.0f, 144.0f, "target %.0f fps");
+    ImGui::PopItemWidth();
+    ImGui::SameLine();
+    ImGui::TextDisabled("(?)");
+    if (ImGui::IsItemHovered(ImGuiHoveredFlags_DelayShort)) {
+        ImGui::SetTooltip("Lowers the physics rate first and then the share of simulated particles\nwhen frames take longer than the target, and raises them again after a few seconds of headroom");
+    }
+    ImGui::Text("CPU %.1f ms | GPU %.1f ms", governorCpuMs, governorGpuMs);
+    if(governorEnabled) {
+        ImGui::Text("Level %d: %.0f Hz physics, %.0f%% of the particles", governorLevel, governorPhysicsRate, governorParticleShare * 100.0f);
     }
 
     ImGui::Checkbox("Demo Window", &show_demo_window);
@@ -269,6 +511,95 @@ void UI::update(EmitterParams& emitterParams)
     ImGui::Render();
 }
 
+const char *UI::getSnapshotPath() const
+{
+    return snapshotPath;
+}
+
+const char *UI::getTrajectoryPath() const
+{
+    return trajectoryPath;
+}
+
+int UI::getRecordEverySteps() const
+{
+    return recordEverySteps;
+}
+
+void UI::setRecording(bool recording)
+{
+    this->recording = recording;
+}
+
+const char *UI::getPlaybackPath() const
+{
+    return playbackPath;
+}
+
+float UI::getPlaybackSpeed() const
+{
+    return playbackSpeed;
+}
+
+void UI::setPlaybackState(bool open, bool playing, int frame, int frameCount)
+{
+    playbackOpen = open;
+    playbackPlaying = playing;
+    playbackFrame = frame;
+    playbackFrameCount = frameCount;
+}
+
+const char *UI::getCapturePath() const
+{
+    return capturePath;
+}
+
+int UI::getCaptureFormat() const
+{
+    return captureFormat;
+}
+
+float UI::getCaptureFps() const
+{
+    return captureFps;
+}
+
+void UI::setCaptureState(bool capturing, int frames)
+{
+    this->capturing = capturing;
+    capturedFrames = frames;
+}
+
+void UI::send(CommandType type, int value)
+{
+    if(!commands.push(type, value)) std::cerr << "The command queue is full, a UI action was dropped" << std::endl;
+}
+
+bool UI::isGovernorEnabled() const
+{
+    return governorEnabled;
+}
+
+float UI::getGovernorFps() const
+{
+    return governorFps;
+}
+
+void UI::setGovernorEnabled(bool enabled, float fps)
+{
+    governorEnabled = enabled;
+    governorFps = fps;
+}
+
+void UI::setGovernorState(int level, float cpuMs, float gpuMs, float physicsRate, float particleShare)
+{
+    governorLevel = level;
+    governorCpuMs = cpuMs;
+    governorGpuMs = gpuMs;
+    governorPhysicsRate = physicsRate;
+    governorParticleShare = particleShare;
+}
+
 UI::~UI()
 {
 }
\ No newline at end of file
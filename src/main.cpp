@@ -10,11 +10,24 @@
 #include <cstdlib>
 #include <vector>
 #include <random>
+#include <mutex>
 #include "Random.h"
 #include "Camera.h"
 #include "Emitter.h"
 #include "UI.h"
+#include "SdfCollider.h"
+#include "CommandLine.h"
+#include "GoldenState.h"
+#include "Snapshot.h"
+#include "TrajectoryRecorder.h"
+#include "TrajectoryPlayer.h"
+#include "FrameCapture.h"
+#include "BatchMode.h"
+#include "ProgramCache.h"
+#include "SimulationThread.h"
+#include "FrameGovernor.h"
 #include "SDL3/SDL_events.h"
+#include "CommandQueue.h"
 
 float wWidth = 1920.0f;
 float wHeight = 1080.0f;
@@ -49,7 +62,18 @@ double currentTime, lastFrameTime = 0.0;
 float deltaTime;
 bool simulationRunning = false;
 
-int main() {
+int main(int argc, char* argv[]) {
+    CommandLineOptions options = parseCommandLine(argc, argv);
+    if(!options.valid) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    bool goldenMode = !options.goldenRecordPath.empty() || !options.goldenCheckPath.empty();
+    ProgramCache::setEnabled(options.shaderCache);
+    ProgramCache::setDirectory(options.shaderCachePath);
+    //batch runs never touch SDL, so they work on machines without a display
+    if(options.batch) return runBatchMode(options);
+
    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS) < 0) {
         std::cerr << "SDL Init failed: " << SDL_GetError() << std::endl;
         return -1;
@@ -102,7 +126,9 @@ int main() {
 
     std::cout << "OpenGL Version: " << glGetString(GL_VERSION) << std::endl;
 
-    UI ui(window, context);
+    CommandQueue commandQueue;
+    std::vector<Command> commands;
+    UI ui(window, context, commandQueue);
 
     glEnable(GL_DEPTH_TEST);
 
@@ -132,6 +158,8 @@ int main() {
 
     std::vector<glm::vec3>* circleVector = generateCirclePoints(24);
 
+    //the shaders only get submitted here, the driver compiles them while the textures, distance field and meshes are set up
+    Profiler::Start();
     Shader gridShader;
     gridShader.createProgram("./../shaders/grid_vertex.glsl", "./../shaders/grid_fragment.glsl");
     Shader lineShader;
@@ -144,7 +172,34 @@ int main() {
 
     Camera cam;
 
+    //Static scene geometry, converted into a distance field that the compute shader samples for collisions. The build
+    //takes a moment, so it only happens once the colliders are turned on
+    SdfCollider sceneColliders;
+    sceneColliders.addDefaultScene();
+    //the tree crown, leaves with the mesh emitter start on it
+    int crownMesh = sceneColliders.getMeshCount() - 1;
+    for (const std::string& path : options.colliderPaths) sceneColliders.addObjFile(path, glm::mat4(1.0f));
+
+    //Seeded run for the golden state regression check, no interactive simulation
+    if(goldenMode) {
+        int exitCode = runGoldenMode(options, &sceneColliders);
+        SDL_GL_DestroyContext(context);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        return exitCode;
+    }
+
     Emitter emitter(emitterParams);    
+    emitter.setSpawnMesh(sceneColliders.getMeshTriangles(crownMesh));
+
+    SnapshotWriter snapshotWriter;
+    TrajectoryRecorder recorder;
+    emitter.setRecorder(&recorder);
+    TrajectoryPlayer player;
+    FrameCapture capture;
+    if(!options.snapshotPath.empty() && loadSnapshot(options.snapshotPath, emitter, emitterParams)) {
+        simulationRunning = true;
+    }
 
     //Grid object setup
     unsigned int grid_VBO, grid_VAO;
@@ -233,9 +288,59 @@ int main() {
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 
     
+    Shader::finishPending();
+    Profiler::Stop(1, "Startup (shaders, textures, meshes)");
+
+    //writes a pending snapshot and recorded frames once the GPU copies are done, advances a trajectory playback.
+    //The recorder is fed by the simulation steps, so everything that touches them runs on the simulation thread and the
+    //UI only gets a copy of their state
+    struct PlaybackStatus {
+        bool recording = false, open = false, playing = false;
+        int frame = 0, frameCount = 0;
+    };
+    std::mutex playbackMutex;
+    PlaybackStatus playbackStatus;
+    float playbackSpeed = 1.0f;
+    SimulationThread simulation(emitter);
+    simulation.setPoll([&](Emitter& emitter, float frameTime) {
+        snapshotWriter.poll();
+        recorder.poll();
+        float speed;
+        {
+            std::lock_guard<std::mutex> lock(playbackMutex);
+            speed = playbackSpeed;
+        }
+        bool playing = player.isOpen();
+        if(playing) player.update(frameTime, emitter, speed);
+        PlaybackStatus status = {recorder.isRecording(), player.isOpen(), player.isPlaying(),
+                                 static_cast<int>(player.getCurrentFrame()), static_cast<int>(player.getFrameCount())};
+        std::lock_guard<std::mutex> lock(playbackMutex);
+        playbackStatus = status;
+        return playing;
+    });
+
+    //the physics gets a second context from the same share group and its own thread, the render loop only draws copies
+    SDL_GLContext simulationContext = nullptr;
+    if(options.simulationThread) {
+        SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+        simulationContext = SDL_GL_CreateContext(window);
+        //creating a context makes it current, the render loop stays on the first one
+        SDL_GL_MakeCurrent(window, context);
+        if(simulationContext != nullptr) {
+            simulation.start([window, simulationContext] { return SDL_GL_MakeCurrent(window, simulationContext); },
+                             [window] { SDL_GL_MakeCurrent(window, nullptr); });
+        }
+        else std::cerr << "Could not create the simulation context, the simulation runs on the render thread: " << SDL_GetError() << std::endl;
+    }
+
+    //keeps unattended displays at their frame rate when a heavy parameter change lands
+    FrameGovernor governor;
+    if(options.governorFps > 0.0f) ui.setGovernorEnabled(true, options.governorFps);
+
     bool running = true;
     float rotationSpeed = 0.3f;
     float blackHoleRotation = 0.0f;
+    bool captureToggleRequested = false;
 
     lastFrameTime = SDL_GetPerformanceCounter();
 
@@ -248,9 +353,10 @@ int main() {
         //could for example be 1 million for microseconds, 1 billion for nanoseconds etc.
         deltaTime = (currentTime - lastFrameTime) / SDL_GetPerformanceFrequency(); 
         lastFrameTime = currentTime;
+        //captured videos advance by exactly one frame per rendered frame, no matter how long rendering takes
+        if(capture.isCapturing()) deltaTime = capture.getFrameTime();
 
         //std::cout << deltaTime << " " << deltaTime / SDL_GetPerformanceFrequency() << " " << SDL_GetPerformanceFrequency() << std::endl;
-        // std::cout << START_SIMULATION_EVENT << " " << STOP_SIMULATION_EVENT << std::endl;
 
         SDL_Event event;
         while (SDL_PollEvent(&event))
@@ -282,6 +388,8 @@ int main() {
             }
         }
 
+        //everything up to the UI goes into the capture framebuffer while capturing
+        capture.beginFrame();
         glClearColor(1, 1, 1, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -290,25 +398,99 @@ int main() {
         glm::mat4 view = cam.getViewMatrix();
         glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1280.0f/720.0f, 0.1f, 250.0f);
 
+        //the polls run on the simulation thread, the render loop only hands over the frame time and doesn't wait
+        {
+            std::lock_guard<std::mutex> lock(playbackMutex);
+            playbackSpeed = ui.getPlaybackSpeed();
+        }
+        simulation.frame(deltaTime);
+        ui.setCaptureState(capture.isCapturing(), capture.getCapturedFrames());
         ui.update(emitterParams);
 
-        while (SDL_PollEvent(&event)) {
-            if(event.type == START_SIMULATION_EVENT) {
-                std::cout << "Start the simulation event received!" << std::endl;
+        //only the commands of the UI, the input events were all handled above
+        commandQueue.drain(commands);
+        for (const Command& command : commands) {
+            switch (command.type) {
+            case CommandType::startSimulation:
+                std::cout << "Start the simulation command received!" << std::endl;
                 simulationRunning = true;
-            }
-            else if(event.type == STOP_SIMULATION_EVENT) {
-                std::cout << "Stop the simulation event received!" << std::endl;
+                break;
+            case CommandType::stopSimulation:
+                std::cout << "Stop the simulation command received!" << std::endl;
                 simulationRunning = false;
+                break;
+            case CommandType::resizeParticles:
+                simulation.run([&](Emitter& emitter) { emitter.resizeParticleCount(emitterParams); });
+                break;
+            case CommandType::changeEmitArea:
+                simulation.run([&](Emitter& emitter) { emitter.changeEmitArea(emitterParams); });
+                break;
+            case CommandType::benchmarkPhysics:
+                simulation.run([&](Emitter& emitter) { emitter.benchmarkPhysics(emitterParams, 200); });
+                break;
+            case CommandType::benchmarkSpawn:
+                simulation.run([&](Emitter& emitter) { emitter.benchmarkSpawn(emitterParams, 1 << 20); });
+                break;
+            case CommandType::saveSnapshot:
+                simulation.run([&](Emitter& emitter) { snapshotWriter.save(emitter, emitterParams, ui.getSnapshotPath()); });
+                break;
+            case CommandType::loadSnapshot:
+                simulation.run([&](Emitter& emitter) { loadSnapshot(ui.getSnapshotPath(), emitter, emitterParams); });
+                break;
+            case CommandType::toggleRecording:
+                simulation.run([&](Emitter& emitter) {
+                    if(recorder.isRecording()) recorder.stop();
+                    else if(!player.isOpen()) recorder.start(ui.getTrajectoryPath(), emitter, ui.getRecordEverySteps());
+                });
+                break;
+            case CommandType::togglePlayback:
+                simulation.run([&](Emitter& emitter) {
+                    if(player.isOpen()) {
+                        //hand the buffers back to the simulation with a fresh set of particles
+                        player.close();
+                        emitter.resizeParticleCount(emitterParams);
+                        emitter.changeEmitArea(emitterParams);
+                    }
+                    else {
+                        if(recorder.isRecording()) recorder.stop();
+                        player.open(ui.getPlaybackPath());
+                    }
+                });
+                break;
+            case CommandType::pausePlayback:
+                simulation.run([&](Emitter&) { player.setPlaying(!player.isPlaying()); });
+                break;
+            case CommandType::seekPlayback:
+                simulation.run([&](Emitter&) { player.seek(static_cast<uint32_t>(command.value)); });
+                break;
+            case CommandType::toggleCapture:
+                //the frame is already being drawn into the window or the capture framebuffer, switch after it ended
+                captureToggleRequested = true;
+                break;
             }
-            else if(event.type == PARTICLE_COUNT_UPDATED_EVENT) {
-                emitter.resizeParticleCount(emitterParams);
-            }
-            else if(event.type == EMIT_AREA_CHANGED_EVENT) {
-                emitter.changeEmitArea(emitterParams);
-            }
         }
 
+        //may be a frame behind, the commands above only show up here once they have been run
+        PlaybackStatus playback;
+        {
+            std::lock_guard<std::mutex> lock(playbackMutex);
+            playback = playbackStatus;
+        }
+        ui.setRecording(playback.recording);
+        ui.setPlaybackState(playback.open, playback.playing, playback.frame, playback.frameCount);
+
+        //the distance field is built the first time the colliders are turned on. It is built here because the mesh of it
+        //is drawn with this context, the simulation only gets it once it is complete
+        if(emitterParams.sceneColliders && !sceneColliders.isBuilt()) {
+            sceneColliders.build(0.2f);
+            glFinish();
+            simulation.run([&](Emitter& emitter) { emitter.setColliders(&sceneColliders); });
+        }
+
+        governor.setEnabled(ui.isGovernorEnabled());
+        governor.setTargetFps(ui.getGovernorFps());
+        governor.beginGpuFrame();
+
         glm::mat4 model = glm::mat4(1.0f);
 
         glEnable(GL_BLEND);
@@ -342,21 +524,26 @@ int main() {
         lineShader.setVec3f("color", zColor);
         glDrawArrays(GL_LINES, 0, 2);
 
-        //Draw the Gizmos Shape
+        //Draw the Gizmos Shape, one per emitter
         glLineWidth(3.0f);
-        model = glm::translate(model, glm::vec3 {0, emitterParams.emitHeight, 0});
-        model = glm::scale(model, glm::vec3 {emitterParams.emitRadius});
-        lineShader.setMatrix4("model", model);
         lineShader.setVec3f("color", xColor);
+        for (const EmitterSource& source : allEmitters(emitterParams)) {
+            model = glm::translate(glm::mat4(1.0f), source.origin + glm::vec3 {0, source.emitHeight, 0});
+            model = glm::scale(model, glm::vec3 {source.emitRadius});
+            lineShader.setMatrix4("model", model);
+
+            //the sphere is centered at the emit height, the circle is its equator. The mesh has no gizmo, the crown is drawn
+            //with the scene colliders
+            if(source.shape == EmitterShape::circleShape || source.shape == EmitterShape::discShape ||
+               source.shape == EmitterShape::sphereShape) {
+                glBindVertexArray(circleVAO);
+                glDrawArrays(GL_LINE_LOOP, 0, circleVector->size());
 
-        if(emitterParams.shape == EmitterShape::circleShape) {
-            glBindVertexArray(circleVAO);
-            glDrawArrays(GL_LINE_LOOP, 0, circleVector->size());
-
-        }
-        else if(emitterParams.shape == EmitterShape::boxShape){
-            glBindVertexArray(quadVAO);
-            glDrawArrays(GL_LINE_LOOP, 0, sizeof(quadVertices) / 3 / 4);
+            }
+            else if(source.shape == EmitterShape::boxShape){
+                glBindVertexArray(quadVAO);
+                glDrawArrays(GL_LINE_LOOP, 0, sizeof(quadVertices) / 3 / 4);
+            }
         }
 
         glLineWidth(1.0f);
@@ -364,30 +551,12 @@ int main() {
 
         //Update and draw the black holes
         blackHoleRotation += deltaTime * emitterParams.blackHoleSpeed;
-        float r = emitterParams.blackHoleRadius;
-        float angle = glm::radians(emitterParams.blackHoleAngle);
+        orbitBlackHoles(emitterParams, blackHoleRotation);
+        glm::vec3 bHPos1 = emitterParams.blackHolePositions[0];
+        glm::vec3 bHPos2 = emitterParams.blackHolePositions[1];
         blackHoleShader.setMatrix4("view", view);
         blackHoleShader.setMatrix4("projection", projection);
 
-        glm::vec3 bHPos1 = glm::vec3{cos(blackHoleRotation) * r, sin(blackHoleRotation) * r, 0};
-        float y = bHPos1.y;
-        float z = bHPos1.z;
-        bHPos1.y = cos(angle) * y - sin(angle) * z;
-        bHPos1.z = sin(angle) * y + cos(angle) * z;
-        // std::cout << cos(angle) << " " << sin(angle) << std::endl;
-        bHPos1.y += 6.35f;
-
-        glm::vec3 bHPos2 = glm::vec3{cos(blackHoleRotation - glm::pi<float>()) * r, sin(blackHoleRotation - glm::pi<float>()) * r, 0};
-        y = bHPos2.y;
-        z = bHPos2.z;
-        bHPos2.y = cos(angle) * y - sin(angle) * z;
-        bHPos2.z = sin(angle) * y + cos(angle) * z;
-        // std::cout << cos(angle) << " " << sin(angle) << std::endl;
-        bHPos2.y += 6.35f;
-
-        emitterParams.blackHolePositions[0] = bHPos1;
-        emitterParams.blackHolePositions[1] = bHPos2;
-
         glm::mat4 bHModel = glm::mat4(1.0f);
         bHModel = glm::translate(bHModel, bHPos1);
         glUseProgram(blackHoleShader.ID);
@@ -406,18 +575,54 @@ int main() {
         glDrawElements(GL_TRIANGLES, sphereIndices->size(), GL_UNSIGNED_INT, 0);
 
 
-        //Actually draw all the leaves
-        if(simulationRunning) {
-            emitter.update(deltaTime, emitterParams);
-            emitter.draw(view, projection, emitterParams);
+        if(emitterParams.sceneColliders) {
+            sceneColliders.draw(view, projection);
         }
-        
+
+        //uploads textures that finished decoding and writes captured frames once the GPU copies are done
+        Texture::pollPending();
+        capture.poll();
+
+        //captures have to be reproducible, they always run at full quality
+        EmitterParams governedParams = capture.isCapturing() ? emitterParams : governor.apply(emitterParams);
+        //Actually draw all the leaves, a trajectory playback replaces the simulation while it is open.
+        //The simulation only gets the frame time here and steps on its own, the newest finished state is drawn
+        if(playback.open) {
+            simulation.draw(view, projection, emitterParams);
+        }
+        else if(simulationRunning) {
+            //captured videos have to show every step in the frame it belongs to
+            simulation.setLockstep(capture.isCapturing());
+            simulation.update(deltaTime, governedParams);
+            simulation.draw(view, projection, governedParams);
+        }
+        capture.endFrame(static_cast<int>(wWidth), static_cast<int>(wHeight));
+        governor.endGpuFrame();
+
+        if(captureToggleRequested) {
+            captureToggleRequested = false;
+            if(capture.isCapturing()) capture.stop();
+            else {
+                CaptureFormat format = ui.getCaptureFormat() == 0 ? CaptureFormat::pngSequence : CaptureFormat::y4mVideo;
+                std::string path = ui.getCapturePath();
+                if(format == CaptureFormat::y4mVideo && std::filesystem::path(path).extension() != ".y4m") path += ".y4m";
+                capture.start(path, format, static_cast<int>(wWidth), static_cast<int>(wHeight), ui.getCaptureFps());
+            }
+        }
+
+        //the time spent on the frame so far, waiting for the swap doesn't count. Captures and playback aren't governed
+        float workTime = static_cast<float>((SDL_GetPerformanceCounter() - currentTime) / SDL_GetPerformanceFrequency());
+        governor.update(workTime, deltaTime, simulationRunning && !playback.open && !capture.isCapturing(), simulation.takeGpuTime());
+        ui.setGovernorState(governor.getLevelIndex(), governor.getCpuTime() * 1000.0f, governor.getGpuTime() * 1000.0f,
+                            governedParams.physicsRate, governor.getLevel().particleShare);
 
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
         SDL_GL_SwapWindow(window);
 
     }
-    
+
+    simulation.stop();
+    if(simulationContext != nullptr) SDL_GL_DestroyContext(simulationContext);
 
     return 0;
 }
\ No newline at end of file